@@ -0,0 +1,1382 @@
+#include "audioEngine.h"
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <thread>
+
+#include "logSink.h"
+#include "trace.h"
+
+#define LOG_TAG "AudioEngine"
+#define LOGV(...) logPrint(LogLevel::Verbose, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) logPrint(LogLevel::Debug, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) logPrint(LogLevel::Info, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) logPrint(LogLevel::Warn, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) logPrint(LogLevel::Error, LOG_TAG, __VA_ARGS__)
+
+#include "utils.h"
+#include "openalInitializer.h"
+
+// Sound instance class
+class SoundInstance {
+private:
+    SoundSource m_source;
+    SourceGroup m_sources; // one per channel, changed together
+    AlBufferPair m_buffers;
+    std::unique_ptr<SoundStream> m_stream;
+    StreamFeeder &m_streamFeeder;
+    BufferCache &m_bufferCache;
+    SourcePool &m_sourcePool;
+    LoadWorkerPool &m_loadPool;
+    bool m_streaming;
+    float m_duration;
+    int64_t m_frames;      // static sounds, frames per source
+    ALint m_sampleRate;    // static sounds
+    float m_gain;
+    float m_fadeGain;      // set by crossfades, on top of the gain
+    std::atomic<bool> m_isPlaying;
+    bool m_paused;         // control thread, between pause() and resume()
+    MotionPose m_pose;
+    SoundMotion m_motion;
+    uint32_t m_clockEpoch; // bumped when the position jumps
+
+public:
+    SoundInstance(SoundSource source, StreamFeeder &streamFeeder, BufferCache &bufferCache, SourcePool &sourcePool,
+                  LoadWorkerPool &loadPool, bool streaming)
+            : m_source(std::move(source)),
+              m_buffers({AL_NONE, AL_NONE}),
+              m_streamFeeder(streamFeeder), m_bufferCache(bufferCache), m_sourcePool(sourcePool),
+              m_loadPool(loadPool), m_streaming(streaming),
+              m_duration(0.0f), m_frames(0), m_sampleRate(0), m_gain(1.0f), m_fadeGain(1.0f), m_isPlaying(false),
+              m_paused(false), m_pose({0.0f, 1.0f, 0.0f}), m_clockEpoch(0) {}
+
+    ~SoundInstance() {
+        stop();
+    }
+
+    bool load(const SoundLoadOptions &loadOptions) {
+        if (m_streaming) {
+            return loadStream(false);
+        }
+
+        // Buffers of the same file loaded by another instance (or recently stopped) are shared
+        std::string bufferKey;
+        bool shareable = getLoadKey(m_source, loadOptions, bufferKey);
+        if (shareable && m_bufferCache.acquire(bufferKey, m_buffers)) {
+            LOGD("Reusing loaded buffers for: %s", m_source.describe().c_str());
+        } else {
+            // A cache hit is faster than decoding even the first chunk
+            if (loadOptions.progressive && !isSoundCached(m_source, loadOptions) && loadStream(true, loadOptions)) {
+                return true;
+            }
+
+            m_buffers = LoadSound(m_source, loadOptions);
+            if (!m_buffers.first) {
+                LOGE("Failed to load sound buffer for: %s", m_source.describe().c_str());
+                return false;
+            }
+            traceCounterAdd(TraceCounter::AlBufferBytes,
+                            (int64_t) (BufferCache::getBufferBytes(m_buffers.first) +
+                                       BufferCache::getBufferBytes(m_buffers.second)));
+            if (shareable) {
+                m_buffers = m_bufferCache.add(bufferKey, m_buffers);
+            }
+        }
+
+        // One source per channel, stereo needs a second one for the second buffer
+        if (!acquireSources(m_buffers.second != AL_NONE ? 2 : 1)) {
+            stop();
+            return false;
+        }
+        setupSource(m_sources[0], m_buffers.first);
+        if (hasStereo()) {
+            setupSource(m_sources[1], m_buffers.second);
+        }
+
+        m_duration = getDurationSeconds(m_buffers.first);
+        // Split loads hold one channel per buffer, but a buffer's frame spans all of its channels
+        ALint bytes = 0, bits = 16, channels = 1;
+        alGetBufferi(m_buffers.first, AL_SIZE, &bytes);
+        alGetBufferi(m_buffers.first, AL_BITS, &bits);
+        alGetBufferi(m_buffers.first, AL_CHANNELS, &channels);
+        alGetBufferi(m_buffers.first, AL_FREQUENCY, &m_sampleRate);
+        m_frames = (bits > 0 && channels > 0) ? (int64_t) bytes * 8 / (bits * channels) : 0;
+        LOGD("Sound loaded successfully: %s (duration: %.2fs, stereo: %s)",
+             m_source.describe().c_str(), m_duration,
+             (m_buffers.second != AL_NONE) ? "yes" : "no");
+        return true;
+    }
+
+    // The engine's event loop reports when the sound finished
+    void play() {
+        if (m_isPlaying) return;
+
+        m_isPlaying = true;
+        if (m_stream) {
+            m_stream->setPlaying(true);
+        } else {
+            m_sources.play();
+        }
+
+        LOGD("Started playing sound: %s", m_source.describe().c_str());
+    }
+
+    // Like play(), with the sound starting at a device clock time
+    void playAt(const DeviceClock &clock, int64_t clockNs) {
+        if (m_isPlaying) return;
+
+        m_isPlaying = true;
+        if (m_stream) {
+            m_stream->playAt(clock, clockNs);
+        } else {
+            clock.playAt(m_sources.size(), m_sources.data(), clockNs);
+        }
+        LOGD("Scheduled sound: %s", m_source.describe().c_str());
+    }
+
+    // Takes back a playAt() whose time hasn't come yet, the sound is left unplayed at its start
+    void cancelStart() {
+        if (!m_isPlaying) return;
+
+        m_isPlaying = false;
+        m_paused = false;
+        m_clockEpoch++;
+        if (m_stream) {
+            m_stream->setPlaying(false);
+            m_stream->seek(0.0f);
+        } else {
+            m_sources.rewind();
+        }
+        LOGD("Cancelled scheduled start of sound: %s", m_source.describe().c_str());
+    }
+
+    // Device clock time at which the sound will have played to its end, false unless playing
+    bool getEndClock(const DeviceClock &clock, int64_t &endClockNs) const {
+        if (m_stream) {
+            return m_stream->getEndClock(clock, endClockNs);
+        }
+        if (!isAdvancing() || m_sampleRate <= 0) return false;
+
+        int64_t frame, clockNs;
+        if (!clock.getSourceClock(m_sources.leader(), frame, clockNs)) return false;
+        endClockNs = clockNs + std::max<int64_t>(0, m_frames - frame) * 1000000000 / m_sampleRate;
+        return true;
+    }
+
+    void stop() {
+        m_isPlaying = false;
+        m_paused = false;
+
+        // The feeder must not touch the stream once its sources are gone
+        if (m_stream) {
+            m_streamFeeder.remove(m_stream.get());
+        }
+
+        // Back to the pool, stopped and detached, before the stream deletes its queued buffers
+        for (ALsizei i = 0; i < m_sources.size(); i++) {
+            m_sourcePool.release(m_sources[i]);
+        }
+        m_sources.clear();
+
+        // Shared buffers only lose a reference, the others are deleted
+        if (m_buffers.first != AL_NONE && !m_bufferCache.release(m_buffers)) {
+            BufferCache::deleteBuffers(m_buffers);
+        }
+        m_buffers = {AL_NONE, AL_NONE};
+
+        if (m_stream) {
+            m_stream->close();
+        }
+
+        LOGD("Sound stopped: %s", m_source.describe().c_str());
+    }
+
+    void pause() {
+        if (!m_isPlaying) return;
+
+        m_paused = true;
+        if (m_stream) {
+            m_stream->setPlaying(false);
+        } else {
+            m_sources.pause();
+        }
+        LOGD("Sound paused: %s", m_source.describe().c_str());
+    }
+
+    void resume() {
+        if (!m_isPlaying) return;
+
+        m_paused = false;
+        if (m_stream) {
+            m_stream->setPlaying(true);
+        } else {
+            m_sources.play();
+        }
+        LOGD("Sound resumed: %s", m_source.describe().c_str());
+    }
+
+    void updatePosition(float angle, float radius, float height, float stereoAngle) {
+        m_pose = {angle, radius, height};
+        UpdateBatch batch;
+        setChannelPositions(m_sources.data(), m_sources.size(), angle, radius, height, stereoAngle);
+    }
+
+    const MotionPose &getPose() const { return m_pose; }
+
+    // The trajectory runs on the sound's own clock, starting from its current playback time
+    void setTrajectory(std::unique_ptr<Trajectory> trajectory) {
+        m_motion.set(std::move(trajectory), getMotionTime());
+    }
+
+    // Keeps the running trajectory going, only its wobble changes
+    void setWobble(float depth, float cyclesPerSecond) {
+        m_motion.setWobble(depth, cyclesPerSecond, m_pose, getMotionTime());
+    }
+
+    const Trajectory *getTrajectory() const { return m_motion.get(); }
+
+    void clearTrajectory() { m_motion.clear(); }
+
+    /* Moves the sources along the trajectory, returns false if there is
+     * nothing left to move. The clock of a paused (or not started) sound
+     * stands still, so it needs no more ticks until it plays.
+     */
+    bool updateMotion(float stereoAngle) {
+        if (!m_motion.get() || m_sources.empty()) return false;
+
+        double time = getMotionTime();
+        MotionPose pose = m_motion.evaluate(time);
+        updatePosition(pose.angle, pose.radius, pose.height, stereoAngle);
+        return m_isPlaying && !m_paused && m_motion.isMoving(time);
+    }
+
+    // Reports stream underruns and decode errors, static sounds have none
+    void setStreamEventHandler(std::function<void(StreamEvent)> handler) const {
+        if (m_stream) {
+            m_stream->setEventHandler(std::move(handler));
+        }
+    }
+
+    void setGain(float gain) {
+        m_gain = gain;
+        applyGain();
+    }
+
+    void setFadeGain(float fadeGain) {
+        m_fadeGain = fadeGain;
+        applyGain();
+    }
+
+    // Realigns the channels if they drifted apart, returns the drift in frames
+    ALint correctDrift() const {
+        if (m_stream) {
+            return m_stream->correctDrift();
+        }
+        return m_sources.correctDrift();
+    }
+
+    // True while the playback position moves (not paused, stopped or starved)
+    bool isAdvancing() const {
+        return m_sources.getState() == AL_PLAYING;
+    }
+
+    void setPlaybackTime(float seconds) {
+        TRACE_SCOPE("Seek");
+        m_clockEpoch++;
+        if (m_stream) {
+            m_stream->seek(seconds);
+            return;
+        }
+
+        m_sources.setSecondsOffset(seconds);
+    }
+
+    float getPlaybackTime() const {
+        if (m_stream) {
+            return m_stream->getPlaybackTime();
+        }
+
+        ALfloat seconds = 0.0f;
+        alGetSourcef(m_sources.leader(), AL_SEC_OFFSET, &seconds);
+        return (alGetError() == AL_NO_ERROR) ? seconds : -1.0f;
+    }
+
+    /* Position the listener hears, and the output latency behind it in
+     * seconds. A paused sound is heard up to its offset once the output has
+     * drained, so only an advancing one is compensated.
+     */
+    float getHeardTime(const DeviceClock &clock, float &latency) const {
+        latency = 0.0f;
+        float position = getPlaybackTime();
+        int64_t frame = -1, latencyNs = 0;
+        if (m_sources.empty() || !clock.getSourceLatency(m_sources.leader(), frame, latencyNs)) return position;
+
+        // A static sound's offset is read together with the latency, a stream's counts from its queue
+        if (!m_stream && frame >= 0 && m_sampleRate > 0) {
+            position = (float) frame / (float) m_sampleRate;
+        }
+        latency = (float) latencyNs / 1e9f;
+        return isAdvancing() ? std::max(0.0f, position - latency) : position;
+    }
+
+    uint32_t getClockEpoch() const { return m_clockEpoch; }
+
+    float getDuration() const { return m_duration; }
+
+    bool isPlaying() const { return m_isPlaying; }
+
+    bool hasStereo() const { return m_sources.size() > 1; }
+
+    bool isStreaming() const { return m_streaming; }
+
+    // Source whose state tells whether the sound is still playing
+    ALuint getSource() const { return m_sources.leader(); }
+
+    // True once the whole sound was played, a paused sound or a stream waiting for data is not finished
+    bool hasFinished() const {
+        if (m_stream) {
+            return m_stream->isFinished();
+        }
+
+        ALint state = m_sources.getState();
+        return alGetError() != AL_NO_ERROR || state == AL_STOPPED;
+    }
+
+private:
+    double getMotionTime() const {
+        return std::max(0.0f, getPlaybackTime());
+    }
+
+    /* A progressive stream keeps every decoded chunk queued, so it ends up
+     * holding the whole track. Returns false for tracks too short to be worth
+     * it, which are loaded at once instead.
+     */
+    bool loadStream(bool progressive, const SoundLoadOptions &loadOptions = {}) {
+        m_stream = std::make_unique<SoundStream>();
+        if (!m_stream->open(m_source, progressive)) {
+            if (!progressive) {
+                LOGE("Failed to open sound stream for: %s", m_source.describe().c_str());
+            }
+            m_stream.reset();
+            return false;
+        }
+        if (progressive && m_stream->getDuration() < PROGRESSIVE_MIN_SECONDS) {
+            m_stream.reset();
+            return false;
+        }
+
+        if (!acquireSources(m_stream->isStereo() ? 2 : 1)) {
+            m_stream.reset();
+            return false;
+        }
+        for (ALsizei i = 0; i < m_sources.size(); i++) {
+            setupSource(m_sources[i], AL_NONE);
+        }
+        if (progressive) {
+            shareWhenDecoded(loadOptions);
+        }
+
+        // Only the first chunk is decoded here, the feeder thread queues the rest
+        if (!m_stream->start(m_sources)) {
+            LOGE("Failed to decode the first chunk of: %s", m_source.describe().c_str());
+            stop();
+            m_stream.reset();
+            return false;
+        }
+        m_streamFeeder.add(m_stream.get());
+
+        m_duration = m_stream->getDuration();
+        LOGD("Sound %s opened successfully: %s (duration: %.2fs, stereo: %s)",
+             progressive ? "progressive load" : "stream", m_source.describe().c_str(), m_duration, hasStereo() ? "yes" : "no");
+        return true;
+    }
+
+    /* Once the progressive decode finished, loads the track into the buffer
+     * cache (kept idle for the next load) and the PCM cache, so a replay needs
+     * no decode. The feeder thread only posts the track to the load workers,
+     * and the task only uses engine-wide state.
+     */
+    void shareWhenDecoded(const SoundLoadOptions &loadOptions) {
+        std::string bufferKey, cacheKey;
+        if (!getLoadKey(m_source, loadOptions, bufferKey)) return;
+        getCacheKey(m_source, loadOptions, cacheKey);
+
+        BufferCache &bufferCache = m_bufferCache;
+        LoadWorkerPool &loadPool = m_loadPool;
+        PcmCache *pcmCache = loadOptions.cache;
+        ScratchArena *scratch = loadOptions.scratch;
+        int targetRate = loadOptions.targetRate;
+        m_stream->setDecodedHandler([&bufferCache, &loadPool, pcmCache, scratch, targetRate, bufferKey,
+                                     cacheKey](DecodedTrack track) {
+            loadPool.submit([&bufferCache, pcmCache, scratch, targetRate, bufferKey, cacheKey, track]() {
+                AlBufferPair buffers = uploadDecodedTrack(track, targetRate, pcmCache, cacheKey, scratch);
+                if (!buffers.first) return;
+                traceCounterAdd(TraceCounter::AlBufferBytes,
+                                (int64_t) (BufferCache::getBufferBytes(buffers.first) +
+                                           BufferCache::getBufferBytes(buffers.second)));
+                bufferCache.release(bufferCache.add(bufferKey, buffers));
+                LOGD("Progressive load shared: %s", bufferKey.c_str());
+            });
+        });
+    }
+
+    bool acquireSources(ALsizei channels) {
+        TRACE_SCOPE("AcquireSources");
+        ALuint sources[SOURCE_GROUP_MAX_SOURCES];
+        if (!m_sourcePool.acquire(sources, channels)) {
+            LOGE("No free source left for: %s", m_source.describe().c_str());
+            return false;
+        }
+        m_sources.assign(sources, channels);
+        return true;
+    }
+
+    void applyGain() const {
+        m_sources.setf(AL_GAIN, m_gain * m_fadeGain);
+    }
+
+    static void setupSource(ALuint source, ALuint buffer) {
+        alSourcei(source, AL_SOURCE_RELATIVE, AL_TRUE);
+        alSource3f(source, AL_POSITION, 0.0f, 0.0f, -1.0f);
+        alSourcei(source, AL_BUFFER, static_cast<ALint>(buffer));
+
+        ALenum error = alGetError();
+        if (error != AL_NO_ERROR) {
+            LOGE("Error setting up source: %s", alGetString(error));
+        }
+    }
+};
+
+SoundInstance *AudioEngine::findSound(SoundId soundId) {
+    SoundSlot *slot = m_sounds.get(soundId);
+    return slot ? slot->sound.get() : nullptr;
+}
+
+AudioEngine::AudioEngine()
+        : m_device(nullptr), m_context(nullptr), m_stopFlag(false), m_bufferCache(BUFFER_CACHE_IDLE_BYTES),
+          m_droppedCommands(0), m_commandsOverflowing(false), m_snapshot(std::make_shared<EngineSnapshot>()), m_parameterBlock(nullptr),
+          m_positionTickInterval(std::chrono::milliseconds(0)), m_drift(),
+          m_stereoAngle(INITIAL_STEREO_ANGLE), m_mixRate(SAMPLE_RATE), m_loadResampling(false),
+          m_progressiveLoading(false), m_loadPool(LOAD_WORKER_THREADS) {}
+
+AudioEngine::~AudioEngine() {
+    cleanup();
+}
+
+bool AudioEngine::initialize(const std::string &selectedHrtf, DeviceProfile profile) {
+    const DeviceProfileConfig &profileConfig = getDeviceProfileConfig(profile);
+    LOGI("Initializing OpenAL with HRTF: %s, profile: %s", selectedHrtf.c_str(), profileConfig.name);
+    m_hrtfName = selectedHrtf;
+
+    m_device = alcOpenDevice(nullptr);
+    if (!m_device) {
+        LOGE("Failed to open OpenAL device");
+        return false;
+    }
+
+    loadHRTF(m_device, selectedHrtf.c_str());
+
+    std::vector<ALCint> attributes;
+    appendDeviceProfileAttributes(profile, attributes);
+    if (!attributes.empty()) {
+        // Attributes reset the device again, so the HRTF picked above has to be asked for with them
+        ALCint hrtfId = findHRTF(m_device, selectedHrtf.c_str());
+        attributes.insert(attributes.end(), {ALC_HRTF_SOFT, ALC_TRUE});
+        if (hrtfId >= 0) {
+            attributes.insert(attributes.end(), {ALC_HRTF_ID_SOFT, hrtfId});
+        }
+        attributes.push_back(0);
+    }
+
+    m_context = alcCreateContext(m_device, attributes.empty() ? nullptr : attributes.data());
+    if (!m_context) {
+        LOGE("Failed to create OpenAL context");
+        alcCloseDevice(m_device);
+        m_device = nullptr;
+        return false;
+    }
+
+    if (!alcMakeContextCurrent(m_context)) {
+        LOGE("Failed to make context current");
+        cleanup();
+        return false;
+    }
+
+    if (!m_sourcePool.create(m_device)) {
+        LOGE("Failed to generate any source");
+        cleanup();
+        return false;
+    }
+
+    ALCint frequency = 0, refresh = 0;
+    alcGetIntegerv(m_device, ALC_FREQUENCY, 1, &frequency);
+    alcGetIntegerv(m_device, ALC_REFRESH, 1, &refresh);
+    m_mixRate = (frequency > 0) ? frequency : SAMPLE_RATE;
+    LOGI("Device mixing rate: %d Hz, %d updates per second", m_mixRate, refresh);
+    if (profileConfig.motionRateHz > 0.0f) {
+        setMotionRate(profileConfig.motionRateHz);
+    }
+    m_deviceClock.load(m_device);
+    UpdateBatch::load();
+
+    m_eventLoop.start([this](SoundId soundId) { onSourceStopped(soundId); },
+                      [this]() { m_streamFeeder.wake(); });
+    m_motionTimer.start([this]() { return tickControl(); });
+    m_powerMeter.reset();
+
+    // Set up listener
+    alListenerfv(AL_POSITION, LISTENER_POSITION);
+    alListener3f(AL_VELOCITY, 0.0f, 0.0f, 0.0f);
+    alListenerfv(AL_ORIENTATION, LISTENER_ORIENTATION);
+
+    LOGI("OpenAL initialized successfully");
+    return true;
+}
+
+void AudioEngine::cleanup() {
+    m_motionTimer.stop();
+    {
+        // Queued commands are dropped, there is nothing left for them to act on
+        std::lock_guard<std::mutex> lock(m_soundsMutex);
+        EngineCommand command;
+        while (m_commands.pop(command)) {}
+        {
+            std::lock_guard<std::mutex> overflowLock(m_overflowMutex);
+            m_overflowCommands.clear();
+            m_commandsOverflowing = false;
+        }
+        stopAllSoundsLocked();
+    }
+    // Cancelled loads stop within one decode chunk, wait for them before the context goes away
+    m_loadPool.shutdown();
+    m_eventLoop.stop();
+    m_deviceClock.unload();
+    m_sourcePool.destroy();
+    m_bufferCache.trim();
+
+    if (m_context) {
+        alcMakeContextCurrent(nullptr);
+        alcDestroyContext(m_context);
+        m_context = nullptr;
+    }
+
+    if (m_device) {
+        alcCloseDevice(m_device);
+        m_device = nullptr;
+    }
+
+    LOGI("OpenAL cleanup completed");
+}
+
+SoundId AudioEngine::createSound(const SoundSource &source, bool streaming) {
+    if (!source.isValid()) {
+        LOGE("Invalid sound source: %s", source.describe().c_str());
+        return SlotMap<SoundSlot>::INVALID_HANDLE;
+    }
+    LOGD("Creating %s sound instance for file: %s", streaming ? "streaming" : "static",
+         source.describe().c_str());
+
+    auto sound = std::make_unique<SoundInstance>(source, m_streamFeeder, m_bufferCache, m_sourcePool, m_loadPool,
+                                                 streaming);
+    if (!sound->load(makeLoadOptions())) {
+        LOGE("Failed to load sound for file: %s", source.describe().c_str());
+        return SlotMap<SoundSlot>::INVALID_HANDLE;
+    }
+
+    std::lock_guard<std::mutex> lock(m_soundsMutex);
+    SoundInstance *instance = sound.get();
+    SoundId soundId = m_sounds.insert({std::move(sound), nullptr});
+    watchStreamEvents(soundId, *instance);
+    publishSnapshotLocked();
+    LOGD("Created sound %" PRIx64 " for file: %s", soundId, source.describe().c_str());
+    return soundId;
+}
+
+SoundId AudioEngine::createSoundAsync(const SoundSource &source, bool streaming) {
+    if (!source.isValid()) {
+        LOGE("Invalid sound source: %s", source.describe().c_str());
+        return SlotMap<SoundSlot>::INVALID_HANDLE;
+    }
+    auto pending = std::make_shared<PendingLoad>();
+    pending->sound = std::make_unique<SoundInstance>(source, m_streamFeeder, m_bufferCache, m_sourcePool, m_loadPool,
+                                                     streaming);
+
+    SoundId soundId;
+    {
+        std::lock_guard<std::mutex> lock(m_soundsMutex);
+        soundId = m_sounds.insert({nullptr, pending});
+    }
+    LOGD("Queueing %s sound instance %" PRIx64 " for file: %s", streaming ? "streaming" : "static",
+         soundId, source.describe().c_str());
+    m_loadPool.submit([this, soundId, pending]() { runAsyncLoad(soundId, pending); });
+
+    return soundId;
+}
+
+bool AudioEngine::cancelSoundLoad(SoundId soundId) {
+    std::lock_guard<std::mutex> lock(m_soundsMutex);
+    SoundSlot *slot = m_sounds.get(soundId);
+    if (!slot || !slot->pending) return false;
+
+    slot->pending->cancelled = true;
+    m_sounds.erase(soundId);
+    LOGD("Cancelled loading sound: %" PRIx64, soundId);
+    return true;
+}
+
+void AudioEngine::playSound(SoundId soundId) {
+    pushCommand(makeCommand(CommandType::Play, soundId));
+}
+
+void AudioEngine::stopSound(SoundId soundId) {
+    pushCommand(makeCommand(CommandType::Stop, soundId));
+}
+
+void AudioEngine::stopAllSounds() {
+    pushCommand(makeCommand(CommandType::StopAll, SlotMap<SoundSlot>::INVALID_HANDLE));
+}
+
+void AudioEngine::pauseSound(SoundId soundId) {
+    pushCommand(makeCommand(CommandType::Pause, soundId));
+}
+
+void AudioEngine::resumeSound(SoundId soundId) {
+    pushCommand(makeCommand(CommandType::Resume, soundId));
+}
+
+void AudioEngine::setSoundPosition(SoundId soundId, float angle, float radius, float height) {
+    pushCommand(makeCommand(CommandType::Position, soundId, angle, radius, height));
+}
+
+void AudioEngine::setSoundGain(SoundId soundId, float gain) {
+    pushCommand(makeCommand(CommandType::Gain, soundId, gain));
+}
+
+void AudioEngine::setPlaybackTime(SoundId soundId, float seconds) {
+    pushCommand(makeCommand(CommandType::Seek, soundId, seconds));
+}
+
+void AudioEngine::queueNext(SoundId current, SoundId next, float crossfadeSeconds) {
+    EngineCommand command = makeCommand(CommandType::QueueNext, current,
+                                        std::min(TRANSITION_MAX_CROSSFADE, std::max(0.0f, crossfadeSeconds)));
+    command.nextSoundId = next;
+    pushCommand(std::move(command));
+}
+
+void AudioEngine::clearQueuedNext(SoundId current) {
+    pushCommand(makeCommand(CommandType::ClearNext, current));
+}
+
+float SoundStatus::positionAt(std::chrono::steady_clock::time_point capturedAt,
+                              std::chrono::steady_clock::time_point now) const {
+    if (!advancing) return position;
+    float elapsed = std::max(0.0f, std::chrono::duration<float>(now - capturedAt).count());
+    float result = position + elapsed + correction * std::min(1.0f, elapsed / PLAYBACK_CLOCK_SLEW_SECONDS);
+    return (duration > 0.0f) ? std::min(result, duration) : result;
+}
+
+float AudioEngine::getPlaybackTime(SoundId soundId) const {
+    float position, latency;
+    return getPlaybackClock(soundId, position, latency) ? position : -1.0f;
+}
+
+bool AudioEngine::getPlaybackClock(SoundId soundId, float &position, float &latency) const {
+    std::shared_ptr<const EngineSnapshot> snapshot = std::atomic_load(&m_snapshot);
+    auto it = snapshot->sounds.find(soundId);
+    if (it == snapshot->sounds.end()) return false;
+
+    position = it->second.positionAt(snapshot->capturedAt, std::chrono::steady_clock::now());
+    latency = it->second.latency;
+    return true;
+}
+
+float AudioEngine::getSoundDuration(SoundId soundId) const {
+    std::shared_ptr<const EngineSnapshot> snapshot = std::atomic_load(&m_snapshot);
+    auto it = snapshot->sounds.find(soundId);
+    return (it != snapshot->sounds.end()) ? it->second.duration : 0.0f;
+}
+
+uint64_t AudioEngine::getDroppedCommands() const {
+    return m_droppedCommands.load(std::memory_order_relaxed);
+}
+
+void AudioEngine::setSoundTrajectory(SoundId soundId, const Trajectory &trajectory) {
+    EngineCommand command = makeCommand(CommandType::Trajectory, soundId);
+    command.trajectory = std::make_unique<Trajectory>(trajectory);
+    pushCommand(std::move(command));
+}
+
+void AudioEngine::setSoundWobble(SoundId soundId, float depth, float cyclesPerSecond) {
+    pushCommand(makeCommand(CommandType::Wobble, soundId, depth, cyclesPerSecond));
+}
+
+void AudioEngine::animateSoundPosition(SoundId soundId, const MotionPose &target, float seconds) {
+    pushCommand(makeCommand(CommandType::Animate, soundId, target.angle, target.radius, target.height, seconds));
+}
+
+void AudioEngine::clearSoundMotion(SoundId soundId) {
+    pushCommand(makeCommand(CommandType::ClearMotion, soundId));
+}
+
+void AudioEngine::setParameterBlock(ParameterBlock *parameterBlock) {
+    m_parameterBlock = parameterBlock;
+    m_motionTimer.wake();
+}
+
+void AudioEngine::setMotionRate(float hz) {
+    m_motionTimer.setRate(hz);
+    LOGD("Motion update rate set to: %.1f Hz", hz);
+}
+
+void AudioEngine::setStereoAngle(float angle) {
+    m_stereoAngle = angle;
+    LOGD("Stereo angle set to: %f radians", angle);
+}
+
+void AudioEngine::setDecodeCache(const std::string &directory, uint64_t budgetBytes) {
+    m_pcmCache.configure(directory, budgetBytes);
+}
+
+void AudioEngine::setScratchCap(uint64_t capBytes) {
+    m_scratchArena.setCap(capBytes);
+}
+
+void AudioEngine::setBufferCacheBudget(uint64_t idleBytes) {
+    m_bufferCache.setIdleBudget(idleBytes);
+}
+
+void AudioEngine::trimScratch() {
+    m_scratchArena.trim();
+    LOGD("Decode scratch memory trimmed");
+}
+
+ScratchArenaStats AudioEngine::getScratchStats() {
+    return m_scratchArena.getStats();
+}
+
+void AudioEngine::setLoadResampling(bool enabled) {
+    m_loadResampling = enabled;
+    LOGD("Load-time resampling to %d Hz %s", m_mixRate, enabled ? "enabled" : "disabled");
+}
+
+void AudioEngine::setProgressiveLoading(bool enabled) {
+    m_progressiveLoading = enabled;
+    LOGD("Progressive loading %s", enabled ? "enabled" : "disabled");
+}
+
+void AudioEngine::setEventHandler(EngineEventHandler handler) {
+    m_eventHandler = std::move(handler);
+    m_exporter.setHandlers(
+            [this](uint64_t exportId, float progress) {
+                postEvent(CallbackEventType::ExportProgress, exportId, 0, progress);
+            },
+            [this](uint64_t exportId, ExportResult result) {
+                postEvent(CallbackEventType::ExportFinished, exportId, result);
+            });
+}
+
+uint64_t AudioEngine::startExport(const SoundSource &source, const std::string &outputPath, ExportFormat format,
+                                  SoundId trajectorySoundId) {
+    ExportJob job;
+    job.source = source;
+    job.outputPath = outputPath;
+    job.format = format;
+    job.stereoAngle = m_stereoAngle;
+    job.hrtfName = m_hrtfName;
+    std::copy(LISTENER_POSITION, LISTENER_POSITION + 3, job.listenerPosition);
+    std::copy(LISTENER_ORIENTATION, LISTENER_ORIENTATION + 6, job.listenerOrientation);
+    {
+        std::lock_guard<std::mutex> lock(m_soundsMutex);
+        SoundInstance *sound = findSound(trajectorySoundId);
+        if (sound && sound->getTrajectory()) {
+            job.trajectory = *sound->getTrajectory();
+        } else if (sound) {
+            job.trajectory.base = sound->getPose();
+        }
+    }
+
+    uint64_t exportId = m_exporter.start(std::move(job));
+    if (exportId == 0) {
+        LOGW("Export already running, not exporting: %s", source.describe().c_str());
+    } else {
+        LOGI("Exporting %s to %s as export %" PRIu64, source.describe().c_str(), outputPath.c_str(), exportId);
+    }
+    return exportId;
+}
+
+bool AudioEngine::cancelExport(uint64_t exportId) {
+    return m_exporter.cancel(exportId);
+}
+
+float AudioEngine::getExportProgress() const {
+    return m_exporter.getProgress();
+}
+
+SourceGroupDrift AudioEngine::getDriftStats() {
+    std::lock_guard<std::mutex> lock(m_soundsMutex);
+    return m_drift;
+}
+
+SourcePoolStats AudioEngine::getSourcePoolStats() {
+    return m_sourcePool.getStats();
+}
+
+EnginePowerStats AudioEngine::getPowerStats() {
+    EnginePowerStats stats = m_powerMeter.read();
+    if (m_device) {
+        alcGetIntegerv(m_device, ALC_FREQUENCY, 1, &stats.frequency);
+        alcGetIntegerv(m_device, ALC_REFRESH, 1, &stats.refresh);
+    }
+    return stats;
+}
+
+void AudioEngine::setPositionTickInterval(uint32_t intervalMs) {
+    m_positionTickInterval = std::chrono::milliseconds(intervalMs);
+    m_motionTimer.wake();
+    LOGD("Position tick interval set to: %u ms", intervalMs);
+}
+
+void AudioEngine::postEvent(CallbackEventType type, SoundId soundId, int32_t code, float value) {
+    if (m_eventHandler) m_eventHandler(type, soundId, code, value);
+}
+
+SoundLoadOptions AudioEngine::makeLoadOptions() {
+    SoundLoadOptions loadOptions;
+    loadOptions.cache = &m_pcmCache;
+    loadOptions.scratch = &m_scratchArena;
+    if (m_loadResampling)
+        loadOptions.targetRate = m_mixRate;
+    loadOptions.progressive = m_progressiveLoading;
+    return loadOptions;
+}
+
+void AudioEngine::runAsyncLoad(SoundId soundId, const std::shared_ptr<PendingLoad> &pending) {
+    SoundLoadOptions loadOptions = makeLoadOptions();
+    loadOptions.cancelled = &pending->cancelled;
+    bool loaded = !pending->cancelled && pending->sound->load(loadOptions);
+
+    bool cancelled;
+    std::unique_ptr<SoundInstance> discarded;
+    {
+        std::lock_guard<std::mutex> lock(m_soundsMutex);
+        // A cancelled load's slot is already gone, and may have been reused since
+        cancelled = pending->cancelled;
+        SoundSlot *slot = cancelled ? nullptr : m_sounds.get(soundId);
+        if (slot && loaded) {
+            slot->sound = std::move(pending->sound);
+            slot->pending.reset();
+            watchStreamEvents(soundId, *slot->sound);
+            publishSnapshotLocked();
+            // A transition may be waiting for this sound
+            if (!m_transitions.empty()) m_motionTimer.wake();
+        } else {
+            if (slot) m_sounds.erase(soundId);
+            discarded = std::move(pending->sound);
+        }
+    }
+    // Releases the sources and buffers of a cancelled or failed load
+    discarded.reset();
+
+    if (cancelled) {
+        LOGD("Discarded cancelled load: %" PRIx64, soundId);
+        return;
+    }
+    if (!loaded) {
+        LOGE("Failed to load sound asynchronously: %" PRIx64, soundId);
+    }
+    postEvent(CallbackEventType::Loaded, soundId, 0, loaded ? 1.0f : 0.0f);
+}
+
+void AudioEngine::watchStreamEvents(SoundId soundId, const SoundInstance &sound) {
+    sound.setStreamEventHandler([this, soundId](StreamEvent event) {
+        if (event == StreamEvent::Underrun) {
+            postEvent(CallbackEventType::Underrun, soundId);
+        } else {
+            postEvent(CallbackEventType::Error, soundId, CALLBACK_ERROR_DECODE_FAILED);
+        }
+    });
+}
+
+EngineCommand AudioEngine::makeCommand(CommandType type, SoundId soundId, float value0, float value1,
+                                       float value2, float value3) {
+    EngineCommand command;
+    command.type = type;
+    command.soundId = soundId;
+    command.values[0] = value0;
+    command.values[1] = value1;
+    command.values[2] = value2;
+    command.values[3] = value3;
+    return command;
+}
+
+// A later command of the same kind supersedes these, so they may be dropped when the queue is full
+static bool isCoalescableCommand(CommandType type) {
+    return type == CommandType::Position || type == CommandType::Gain;
+}
+
+void AudioEngine::pushCommand(EngineCommand command) {
+    // Once commands overflowed, the next ones queue behind them so they still apply in order
+    if (m_commandsOverflowing.load(std::memory_order_acquire) || !m_commands.push(command)) {
+        if (isCoalescableCommand(command.type)) {
+            m_droppedCommands.fetch_add(1, std::memory_order_relaxed);
+            LOGW("Command queue full, dropped command %d", (int) command.type);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_overflowMutex);
+        m_overflowCommands.push_back(std::move(command));
+        m_commandsOverflowing.store(true, std::memory_order_release);
+    }
+    m_motionTimer.wake();
+}
+
+void AudioEngine::applyOverflowCommandsLocked() {
+    std::deque<EngineCommand> commands;
+    {
+        std::lock_guard<std::mutex> lock(m_overflowMutex);
+        commands.swap(m_overflowCommands);
+        m_commandsOverflowing.store(false, std::memory_order_release);
+    }
+    if (!commands.empty()) {
+        LOGW("Applying %zu commands that overflowed the queue", commands.size());
+    }
+    for (EngineCommand &command: commands) {
+        applyCommandLocked(command);
+    }
+}
+
+bool AudioEngine::tickControl() {
+    std::lock_guard<std::mutex> lock(m_soundsMutex);
+    bool moving = false;
+    ParameterBlock *parameterBlock = m_parameterBlock;
+    {
+        // Everything the tick changes reaches the mixer in the same period
+        UpdateBatch batch;
+
+        EngineCommand command;
+        for (size_t applied = 0; applied < COMMAND_BATCH_LIMIT && m_commands.pop(command); applied++) {
+            applyCommandLocked(command);
+        }
+        if (m_commandsOverflowing.load(std::memory_order_acquire) && m_commands.empty()) {
+            applyOverflowCommandsLocked();
+        }
+        if (parameterBlock) {
+            applyParameterInputsLocked(*parameterBlock);
+        }
+
+        float stereoAngle = m_stereoAngle;
+        m_sounds.forEach([stereoAngle, &moving](SoundId /*soundId*/, SoundSlot &slot) {
+            if (slot.sound) moving |= slot.sound->updateMotion(stereoAngle);
+        });
+        moving |= updateTransitionsLocked();
+    }
+    checkDriftLocked();
+
+    std::shared_ptr<const EngineSnapshot> snapshot = publishSnapshotLocked();
+    bool advancing = false;
+    for (const auto &[soundId, status]: snapshot->sounds) {
+        advancing |= status.advancing;
+    }
+    if (parameterBlock) {
+        publishParametersLocked(*parameterBlock, *snapshot);
+    }
+    bool positionTicks = postPositionTicks(*snapshot);
+    if (advancing) {
+        // Nothing else may keep the thread ticking, the refresh catches underruns and stalls
+        m_motionTimer.wakeAt(snapshot->capturedAt + PLAYBACK_SNAPSHOT_REFRESH_INTERVAL);
+    }
+
+    // Playing sounds keep the thread ticking while someone reads their position,
+    // and so do commands left over from a full batch
+    return moving || (advancing && (parameterBlock || positionTicks)) || !m_commands.empty() ||
+           m_commandsOverflowing.load(std::memory_order_relaxed);
+}
+
+void AudioEngine::checkDriftLocked() {
+    auto now = std::chrono::steady_clock::now();
+    if (now < m_nextDriftCheck) {
+        m_motionTimer.wakeAt(m_nextDriftCheck);
+        return;
+    }
+
+    bool watching = false;
+    m_sounds.forEach([this, &watching](SoundId soundId, SoundSlot &slot) {
+        if (!slot.sound || !slot.sound->hasStereo() || !slot.sound->isAdvancing()) return;
+        watching = true;
+
+        ALint drift = slot.sound->correctDrift();
+        m_drift.checks++;
+        m_drift.maxFrames = std::max<int64_t>(m_drift.maxFrames, drift);
+        if (drift > SOURCE_GROUP_DRIFT_TOLERANCE) {
+            m_drift.corrections++;
+            LOGW("Realigned channels of sound %" PRIx64 " after %d frames of drift", soundId, drift);
+        }
+    });
+
+    if (watching) {
+        m_nextDriftCheck = now + SOURCE_GROUP_DRIFT_INTERVAL;
+        m_motionTimer.wakeAt(m_nextDriftCheck);
+    } else {
+        // Checked again on the next tick, e.g. the one starting a sound
+        m_nextDriftCheck = std::chrono::steady_clock::time_point();
+    }
+}
+
+int64_t AudioEngine::getTransitionClock() const {
+    if (m_deviceClock.canSchedule()) return m_deviceClock.now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool AudioEngine::updateTransitionsLocked() {
+    if (m_transitions.empty()) return false;
+
+    bool ticking = false;
+    int64_t now = getTransitionClock();
+    for (auto it = m_transitions.begin(); it != m_transitions.end();) {
+        SoundId currentId = it->first;
+        QueuedTransition &transition = it->second;
+        SoundInstance *current = findSound(currentId);
+        SoundInstance *next = findSound(transition.next);
+        int64_t fadeNs = (int64_t) (transition.crossfade * 1e9f);
+
+        bool startedByHand = transition.state == TransitionState::Waiting && next && next->isPlaying();
+        if (!m_sounds.get(transition.next) || startedByHand) {
+            it = m_transitions.erase(it);
+            continue;
+        }
+
+        if (transition.state == TransitionState::Waiting) {
+            if (!next) {
+                // Still loading, runAsyncLoad() wakes the thread once it is done
+                ++it;
+                continue;
+            }
+            if (!current) {
+                // The current sound ended before the next one was ready, start it late rather than never
+                LOGW("Sound %" PRIx64 " was not ready in time to follow %" PRIx64, transition.next, currentId);
+                next->play();
+                m_eventLoop.watch(next->getSource(), transition.next);
+                it = m_transitions.erase(it);
+                continue;
+            }
+
+            int64_t startClock;
+            if (!getTransitionStart(*current, fadeNs, now, startClock)) {
+                ++it; // paused or not started, the playback calls wake the thread
+                continue;
+            }
+            int64_t leadNs = std::chrono::duration_cast<std::chrono::nanoseconds>(TRANSITION_SCHEDULE_LEAD).count();
+            if (startClock - now > leadNs) {
+                m_motionTimer.wakeAt(std::chrono::steady_clock::now()
+                                     + std::chrono::nanoseconds(startClock - now - leadNs));
+                ++it;
+                continue;
+            }
+
+            next->setFadeGain(fadeNs > 0 ? 0.0f : 1.0f);
+            if (m_deviceClock.canSchedule()) {
+                next->playAt(m_deviceClock, startClock);
+            } else if (startClock <= now) {
+                next->play();
+            } else {
+                ticking = true; // without the device clock, start on the first tick past the start
+                ++it;
+                continue;
+            }
+            m_eventLoop.watch(next->getSource(), transition.next);
+            transition.state = TransitionState::Scheduled;
+            transition.startClock = std::max(startClock, now);
+            LOGD("Scheduled sound %" PRIx64 " after %" PRIx64 " (crossfade: %.2fs)",
+                 transition.next, currentId, transition.crossfade);
+        }
+
+        if (now < transition.startClock) {
+            // A seek or pause of the current sound moves its end, schedule again from scratch
+            int64_t startClock;
+            if (!current || !getTransitionStart(*current, fadeNs, now, startClock)
+                || std::llabs(startClock - transition.startClock) > TRANSITION_RESCHEDULE_TOLERANCE_NS) {
+                if (next) {
+                    next->cancelStart();
+                    m_eventLoop.unwatch(next->getSource());
+                }
+                transition.state = TransitionState::Waiting;
+            }
+            ticking = true;
+            ++it;
+            continue;
+        }
+
+        if (fadeNs <= 0) {
+            // Gapless, nothing to fade
+            it = m_transitions.erase(it);
+            continue;
+        }
+
+        // The incoming sound is playing, fade until the outgoing one is over
+        float progress = (float) (now - transition.startClock) / (float) fadeNs;
+        if (!current || !current->isAdvancing()) progress = 1.0f;
+        float outgoing, incoming;
+        getCrossfadeGains(progress, outgoing, incoming);
+        if (current) current->setFadeGain(outgoing);
+        if (next) next->setFadeGain(incoming);
+
+        if (progress >= 1.0f) {
+            it = m_transitions.erase(it);
+        } else {
+            ticking = true;
+            ++it;
+        }
+    }
+    return ticking;
+}
+
+bool AudioEngine::getTransitionStart(const SoundInstance &current, int64_t fadeNs, int64_t now,
+                                     int64_t &startClock) const {
+    int64_t endClock;
+    if (m_deviceClock.canSchedule()) {
+        if (!current.getEndClock(m_deviceClock, endClock)) return false;
+    } else {
+        if (!current.isAdvancing()) return false;
+        float remaining = std::max(0.0f, current.getDuration() - std::max(0.0f, current.getPlaybackTime()));
+        endClock = now + (int64_t) (remaining * 1e9f);
+    }
+    startClock = endClock - fadeNs;
+    return true;
+}
+
+void AudioEngine::applyParameterInputsLocked(ParameterBlock &parameterBlock) {
+    ParameterInput input;
+    for (uint32_t index = 0; index < PARAMETER_BLOCK_RECORDS; index++) {
+        SoundId soundId = m_sounds.handleAt(index);
+        if (soundId == SlotMap<SoundSlot>::INVALID_HANDLE || !parameterBlock.readInput(index, input)) continue;
+        // Writes for a previous sound of the slot are dropped
+        SoundInstance *sound = findSound(soundId);
+        if (!sound || (SoundId) input.soundId != soundId) continue;
+
+        if (input.hasPosition) {
+            sound->clearTrajectory();
+            sound->updatePosition(input.angle, input.radius, input.height, m_stereoAngle);
+        }
+        if (input.hasGain) {
+            sound->setGain(input.gain);
+        }
+    }
+}
+
+void AudioEngine::publishParametersLocked(ParameterBlock &parameterBlock, const EngineSnapshot &snapshot) {
+    for (uint32_t index = 0; index < PARAMETER_BLOCK_RECORDS; index++) {
+        SoundId soundId = m_sounds.handleAt(index);
+        SoundInstance *sound = findSound(soundId);
+        if (!sound) {
+            parameterBlock.clear(index);
+            continue;
+        }
+
+        ParameterState state = PARAMETER_STATE_LOADED;
+        if (sound->isAdvancing()) {
+            state = PARAMETER_STATE_PLAYING;
+        } else if (sound->isPlaying()) {
+            state = PARAMETER_STATE_PAUSED;
+        }
+        auto status = snapshot.sounds.find(soundId);
+        float position = (status != snapshot.sounds.end()) ? status->second.position : 0.0f;
+        parameterBlock.publish(index, (int64_t) soundId, state, position, sound->getDuration());
+    }
+}
+
+bool AudioEngine::postPositionTicks(const EngineSnapshot &snapshot) {
+    std::chrono::milliseconds interval = m_positionTickInterval;
+    if (interval.count() <= 0) return false;
+    if (snapshot.capturedAt < m_nextPositionTick) return true;
+
+    for (const auto &[soundId, status]: snapshot.sounds) {
+        if (status.advancing) {
+            postEvent(CallbackEventType::PositionTick, soundId, 0, status.position);
+        }
+    }
+    m_nextPositionTick = snapshot.capturedAt + interval;
+    return true;
+}
+
+void AudioEngine::applyCommandLocked(EngineCommand &command) {
+    SoundId soundId = command.soundId;
+    const float *values = command.values;
+    if (command.type == CommandType::StopAll) {
+        stopAllSoundsLocked();
+        return;
+    }
+    if (command.type == CommandType::Stop) {
+        stopSoundLocked(soundId);
+        return;
+    }
+    if (command.type == CommandType::ClearNext) {
+        clearTransitionLocked(soundId);
+        return;
+    }
+
+    SoundInstance *sound = findSound(soundId);
+    if (!sound) {
+        LOGW("Sound not found for ID: %" PRIx64, soundId);
+        return;
+    }
+
+    switch (command.type) {
+        case CommandType::Play:
+            sound->play();
+            m_eventLoop.watch(sound->getSource(), soundId);
+            break;
+        case CommandType::Pause:
+            sound->pause();
+            break;
+        case CommandType::Resume:
+            sound->resume();
+            break;
+        case CommandType::Seek:
+            sound->setPlaybackTime(values[0]);
+            break;
+        case CommandType::Position: {
+            // A position set by hand replaces any running trajectory
+            sound->clearTrajectory();
+            sound->updatePosition(values[0], values[1], values[2], m_stereoAngle);
+
+            ALenum error = alGetError();
+            if (error != AL_NO_ERROR) {
+                LOGW("Error updating position for sound %" PRIx64 ": %s", soundId, alGetString(error));
+            }
+            break;
+        }
+        case CommandType::Gain:
+            sound->setGain(values[0]);
+            break;
+        case CommandType::Trajectory:
+            sound->setTrajectory(std::move(command.trajectory));
+            break;
+        case CommandType::Wobble:
+            sound->setWobble(values[0], values[1]);
+            break;
+        case CommandType::Animate: {
+            MotionPose target = {values[0], values[1], values[2]};
+            auto trajectory = std::make_unique<Trajectory>();
+            trajectory->type = TrajectoryType::Keyframes;
+            trajectory->base = target;
+            trajectory->keyframes = {{0.0f, sound->getPose(), Easing::Linear},
+                                     {std::max(0.0f, values[3]), target, Easing::EaseInOut}};
+            sound->setTrajectory(std::move(trajectory));
+            break;
+        }
+        case CommandType::ClearMotion:
+            sound->clearTrajectory();
+            break;
+        case CommandType::QueueNext:
+            if (!m_sounds.get(command.nextSoundId) || command.nextSoundId == soundId) {
+                LOGW("Sound not found to queue after %" PRIx64 ": %" PRIx64, soundId, command.nextSoundId);
+                break;
+            }
+            clearTransitionLocked(soundId);
+            m_transitions[soundId] = {command.nextSoundId, values[0], TransitionState::Waiting, 0};
+            break;
+        default:
+            break;
+    }
+}
+
+void AudioEngine::clearTransitionLocked(SoundId soundId) {
+    auto it = m_transitions.find(soundId);
+    if (it == m_transitions.end()) return;
+
+    const QueuedTransition &transition = it->second;
+    SoundInstance *next = findSound(transition.next);
+    if (next && transition.state == TransitionState::Scheduled && getTransitionClock() < transition.startClock) {
+        next->cancelStart();
+        m_eventLoop.unwatch(next->getSource());
+    } else if (next) {
+        next->setFadeGain(1.0f);
+    }
+    m_transitions.erase(it);
+}
+
+void AudioEngine::stopSoundLocked(SoundId soundId) {
+    // Stopping by hand cancels what was queued after the sound, finishing doesn't
+    clearTransitionLocked(soundId);
+    SoundSlot removed;
+    if (!m_sounds.erase(soundId, &removed)) return;
+
+    if (removed.sound) {
+        m_eventLoop.unwatch(removed.sound->getSource());
+        removed.sound->stop();
+    } else if (removed.pending) {
+        removed.pending->cancelled = true;
+    }
+}
+
+void AudioEngine::stopAllSoundsLocked() {
+    m_sounds.forEach([this](SoundId /*soundId*/, SoundSlot &slot) {
+        if (slot.sound) {
+            m_eventLoop.unwatch(slot.sound->getSource());
+            slot.sound->stop();
+        } else if (slot.pending) {
+            slot.pending->cancelled = true;
+        }
+    });
+    m_sounds.clear();
+    m_transitions.clear();
+    publishSnapshotLocked();
+    LOGI("All sounds stopped");
+}
+
+std::shared_ptr<const EngineSnapshot> AudioEngine::publishSnapshotLocked() {
+    std::shared_ptr<const EngineSnapshot> previous = std::atomic_load(&m_snapshot);
+    auto snapshot = std::make_shared<EngineSnapshot>();
+    snapshot->capturedAt = std::chrono::steady_clock::now();
+    snapshot->sounds.reserve(m_sounds.size());
+    m_sounds.forEach([this, &snapshot, &previous](SoundId soundId, SoundSlot &slot) {
+        if (!slot.sound) return;
+        const SoundInstance &sound = *slot.sound;
+        SoundStatus status = {};
+        status.position = std::max(0.0f, sound.getHeardTime(m_deviceClock, status.latency));
+        status.duration = sound.getDuration();
+        status.advancing = sound.isAdvancing();
+        status.epoch = sound.getClockEpoch();
+
+        /* The offset only moves once per mixer update, so the measurement jitters
+         * around the interpolated clock. Small errors are slewed from where
+         * readers already are instead of stepping the clock back.
+         */
+        auto last = previous->sounds.find(soundId);
+        if (status.advancing && last != previous->sounds.end() && last->second.epoch == status.epoch) {
+            float expected = last->second.positionAt(previous->capturedAt, snapshot->capturedAt);
+            float error = status.position - expected;
+            if (std::fabs(error) <= PLAYBACK_CLOCK_RESYNC_SECONDS) {
+                status.position = expected;
+                status.correction = std::max(error, -PLAYBACK_CLOCK_SLEW_SECONDS / 2.0f);
+            }
+        }
+        snapshot->sounds[soundId] = status;
+    });
+    std::shared_ptr<const EngineSnapshot> published(std::move(snapshot));
+    std::atomic_store(&m_snapshot, published);
+    return published;
+}
+
+void AudioEngine::onSourceStopped(SoundId soundId) {
+    std::unique_ptr<SoundInstance> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_soundsMutex);
+        SoundInstance *sound = findSound(soundId);
+        if (!sound || !sound->isPlaying() || !sound->hasFinished()) return;
+
+        m_eventLoop.unwatch(sound->getSource());
+        SoundSlot removed;
+        m_sounds.erase(soundId, &removed);
+        finished = std::move(removed.sound);
+        publishSnapshotLocked();
+        // The sound queued after this one starts now if it missed its schedule
+        if (m_transitions.count(soundId)) m_motionTimer.wake();
+    }
+    finished.reset();
+
+    postEvent(CallbackEventType::Finished, soundId);
+    LOGD("Sound finished and cleaned up: %" PRIx64, soundId);
+}
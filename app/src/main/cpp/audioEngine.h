@@ -0,0 +1,400 @@
+#ifndef INC_8DMUSICPLAYER_AUDIOENGINE_H
+#define INC_8DMUSICPLAYER_AUDIOENGINE_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "AL/al.h"
+#include "AL/alc.h"
+#include "AL/alext.h"
+
+#include "soundLoader.h"
+#include "soundStream.h"
+#include "loadWorkerPool.h"
+#include "bufferCache.h"
+#include "playbackEvents.h"
+#include "motion.h"
+#include "slotMap.h"
+#include "mpscRing.h"
+#include "parameterBlock.h"
+#include "engineEvents.h"
+#include "sourcePool.h"
+#include "sourceGroup.h"
+#include "playbackQueue.h"
+#include "offlineRenderer.h"
+#include "deviceProfile.h"
+
+// Constants
+// Mixing rate assumed if the device doesn't report one
+constexpr int SAMPLE_RATE = 44100;
+constexpr float INITIAL_STEREO_ANGLE = M_PI / 6.0f;
+constexpr ALfloat LISTENER_POSITION[] = {0.0f, 0.0f, 1.0f};
+constexpr ALfloat LISTENER_ORIENTATION[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f};
+constexpr size_t LOAD_WORKER_THREADS = 2;
+// With progressive loading, uncached tracks longer than this start playing while the rest is still decoding
+constexpr float PROGRESSIVE_MIN_SECONDS = 60.0f;
+// Memory kept by buffers of stopped sounds, so replaying them needs no decode
+constexpr uint64_t BUFFER_CACHE_IDLE_BYTES = 256ULL * 1024 * 1024;
+/* Commands queued between two control ticks, callers don't wait when it is
+ * full: position and gain updates are dropped (a later one supersedes them),
+ * the other commands go to a locked overflow queue
+ */
+constexpr size_t COMMAND_QUEUE_CAPACITY = 1024;
+// Commands applied per tick, the rest wait for the next tick so a flood can't stall motion
+constexpr size_t COMMAND_BATCH_LIMIT = 256;
+// A queued sound is scheduled again if the end of the current one moved more than this
+constexpr int64_t TRANSITION_RESCHEDULE_TOLERANCE_NS = 1000000;
+// The playback clock folds a measured error into its rate over this long, so it never steps back
+constexpr float PLAYBACK_CLOCK_SLEW_SECONDS = 0.5f;
+// Larger errors (a skipped mixer update, a device change) make the clock jump to the measurement
+constexpr float PLAYBACK_CLOCK_RESYNC_SECONDS = 0.25f;
+// The snapshot is measured again this often while a sound plays, so a stalled one stops advancing
+constexpr std::chrono::milliseconds PLAYBACK_SNAPSHOT_REFRESH_INTERVAL(250);
+
+// Type aliases
+// Generational slot map handle, stale IDs of stopped sounds find nothing
+using SoundId = uint64_t;
+using AlBufferPair = std::pair<ALuint, ALuint>;
+
+// Defined in audioEngine.cpp, only the engine creates and drives sound instances
+class SoundInstance;
+
+// Sound being loaded on the worker pool, owned by its load task until it completes
+struct PendingLoad {
+    std::unique_ptr<SoundInstance> sound;
+    std::atomic<bool> cancelled{false};
+};
+
+// A sound is either loading (pending is set) or loaded (sound is set)
+struct SoundSlot {
+    std::unique_ptr<SoundInstance> sound;
+    std::shared_ptr<PendingLoad> pending;
+};
+
+enum class CommandType : uint8_t {
+    Play,
+    Pause,
+    Resume,
+    Stop,
+    StopAll,
+    Seek,        // values: seconds
+    Position,    // values: angle, radius, height
+    Gain,        // values: gain
+    Trajectory,  // trajectory
+    Wobble,      // values: depth, cycles per second
+    Animate,     // values: angle, radius, height, seconds
+    ClearMotion,
+    QueueNext,   // nextSoundId, values: crossfade seconds
+    ClearNext,
+};
+
+// Fixed-size record queued by the playback calls and applied on the control thread
+struct EngineCommand {
+    CommandType type = CommandType::Play;
+    SoundId soundId = 0;
+    SoundId nextSoundId = 0;
+    float values[4] = {};
+    std::unique_ptr<Trajectory> trajectory;
+};
+
+/* Position heard at the snapshot's capture time, compensated for the output
+ * latency. While advancing it moves with the wall clock, plus a correction
+ * applied gradually over PLAYBACK_CLOCK_SLEW_SECONDS.
+ */
+struct SoundStatus {
+    float position;
+    float duration;
+    bool advancing;
+    float correction;  // seconds still to fold in, never below -PLAYBACK_CLOCK_SLEW_SECONDS / 2
+    float latency;     // output latency in seconds, the time a sample takes to be heard
+    uint32_t epoch;    // SoundInstance::getClockEpoch(), the position jumped if it changed
+
+    float positionAt(std::chrono::steady_clock::time_point capturedAt,
+                     std::chrono::steady_clock::time_point now) const;
+};
+
+enum class TransitionState : uint8_t {
+    Waiting,    // for the current sound to near its end, or for the next one to load
+    Scheduled,  // the next sound starts at startClock
+};
+
+// Next sound queued after a current one, crossfading over the last seconds of the current one
+struct QueuedTransition {
+    SoundId next;
+    float crossfade;     // seconds, 0 for gapless
+    TransitionState state;
+    int64_t startClock;  // nanoseconds, on the device clock if it can schedule, else on steady_clock
+};
+
+// Playback state of every loaded sound, published by the control thread as a whole
+struct EngineSnapshot {
+    std::chrono::steady_clock::time_point capturedAt;
+    std::unordered_map<SoundId, SoundStatus> sounds;
+};
+
+/* Spatial audio engine, free of any platform API: events go to the
+ * EngineEventHandler and log messages to the LogSink, so it builds and runs
+ * the same on Android (behind the JNI layer in openalplayer.cpp) and on a
+ * desktop host for profiling and benchmarks.
+ */
+class AudioEngine {
+private:
+    ALCdevice *m_device;
+    ALCcontext *m_context;
+    std::atomic<bool> m_stopFlag;
+    // Set before initialize(), the other threads post to it until they are stopped
+    EngineEventHandler m_eventHandler;
+    // Renders on a loopback device of its own, independent of the engine's device and context
+    OfflineRenderer m_exporter;
+    std::string m_hrtfName;
+
+    // Declared before the sounds, since their streams unregister from it when destroyed
+    StreamFeeder m_streamFeeder;
+    PcmCache m_pcmCache;
+    ScratchArena m_scratchArena;
+    BufferCache m_bufferCache;
+    SourcePool m_sourcePool;
+    SlotMap<SoundSlot> m_sounds;
+    // Held by the control thread, the loaders and the event loop, but never by the playback calls
+    std::mutex m_soundsMutex;
+    MpscRing<EngineCommand, COMMAND_QUEUE_CAPACITY> m_commands;
+    std::atomic<uint64_t> m_droppedCommands;
+    std::mutex m_overflowMutex;
+    std::deque<EngineCommand> m_overflowCommands;     // needs m_overflowMutex
+    std::atomic<bool> m_commandsOverflowing;          // set while m_overflowCommands holds commands
+    std::shared_ptr<const EngineSnapshot> m_snapshot; // std::atomic_load/store only
+    std::atomic<ParameterBlock *> m_parameterBlock;
+    std::atomic<std::chrono::milliseconds> m_positionTickInterval;
+    std::chrono::steady_clock::time_point m_nextPositionTick; // control thread only
+    PlaybackEventLoop m_eventLoop;
+    DeviceClock m_deviceClock;
+    SourceGroupDrift m_drift;                           // needs m_soundsMutex
+    std::chrono::steady_clock::time_point m_nextDriftCheck; // control thread only
+    std::unordered_map<SoundId, QueuedTransition> m_transitions; // by current sound, needs m_soundsMutex
+    // Control thread: drains the commands, moves the sources and publishes the snapshot
+    MotionTimer m_motionTimer;
+    std::atomic<float> m_stereoAngle;
+    int m_mixRate;
+    PowerMeter m_powerMeter;
+    std::atomic<bool> m_loadResampling;
+    std::atomic<bool> m_progressiveLoading;
+    LoadWorkerPool m_loadPool;
+
+    // Loaded sound for the ID, nullptr if it is stale or still loading. Needs m_soundsMutex
+    SoundInstance *findSound(SoundId soundId);
+
+public:
+    AudioEngine();
+
+    ~AudioEngine();
+
+    // Initialization
+    /* Opens the default device with the profile's attributes. The profile's
+     * OpenAL Soft config overrides are applied separately, with
+     * applyDeviceProfileConfig() before the first device is opened.
+     */
+    bool initialize(const std::string &selectedHrtf, DeviceProfile profile = DeviceProfile::Default);
+
+    void cleanup();
+
+    // Sound management
+    SoundId createSound(const SoundSource &source, bool streaming = false);
+
+    /* Returns the ID right away and loads the sound on the worker pool, the
+     * callback's onSoundLoaded reports whether it is ready to play.
+     */
+    SoundId createSoundAsync(const SoundSource &source, bool streaming = false);
+
+    // Returns false if the sound is not loading anymore (already loaded, failed or unknown)
+    bool cancelSoundLoad(SoundId soundId);
+
+    /* The playback calls below queue a command and return right away, they
+     * never wait for the engine. Commands apply in order on the control
+     * thread's next tick, IDs that went stale by then are ignored.
+     */
+    void playSound(SoundId soundId);
+
+    void stopSound(SoundId soundId);
+
+    void stopAllSounds();
+
+    void pauseSound(SoundId soundId);
+
+    void resumeSound(SoundId soundId);
+
+    // Sound control
+    void setSoundPosition(SoundId soundId, float angle, float radius, float height);
+
+    void setSoundGain(SoundId soundId, float gain);
+
+    void setPlaybackTime(SoundId soundId, float seconds);
+
+    /* Starts next as soon as current ends, on the exact sample with the
+     * device clock, or crossfades the two over the last seconds of current.
+     * Load next ahead (createSoundAsync) so it is ready in time. Replaces any
+     * sound queued after current before.
+     */
+    void queueNext(SoundId current, SoundId next, float crossfadeSeconds);
+
+    // Takes back queueNext(), unless the next sound already started
+    void clearQueuedNext(SoundId current);
+
+    /* Position the listener hears, behind the source offset by the output
+     * latency (often 40-100ms over Bluetooth). Answered from the last published
+     * snapshot and interpolated in between, so polling it is cheap, and it
+     * never goes back unless the sound is seeked. -1 if the sound is unknown
+     * or still loading.
+     */
+    float getPlaybackTime(SoundId soundId) const;
+
+    // getPlaybackTime() and the output latency behind it, false if the sound is unknown or still loading
+    bool getPlaybackClock(SoundId soundId, float &position, float &latency) const;
+
+    float getSoundDuration(SoundId soundId) const;
+
+    // Position and gain updates dropped because the command queue was full
+    uint64_t getDroppedCommands() const;
+
+    // Motion
+    void setSoundTrajectory(SoundId soundId, const Trajectory &trajectory);
+
+    // Adds an elevation wobble to the running trajectory, or to the current position if there is none
+    void setSoundWobble(SoundId soundId, float depth, float cyclesPerSecond);
+
+    // Eases from the current position to the target over the duration (of playback time)
+    void animateSoundPosition(SoundId soundId, const MotionPose &target, float seconds);
+
+    void clearSoundMotion(SoundId soundId);
+
+    /* Shares positions and playback state with Kotlin through the block. The
+     * control thread then keeps ticking while a sound plays, to pick up
+     * position writes and publish the playback positions.
+     */
+    void setParameterBlock(ParameterBlock *parameterBlock);
+
+    void setMotionRate(float hz);
+
+    // Configuration
+    void setStereoAngle(float angle);
+
+    void setDecodeCache(const std::string &directory, uint64_t budgetBytes);
+
+    // Limits the idle decode scratch memory kept between loads (SCRATCH_DEFAULT_CAP by default), 0 for no limit
+    void setScratchCap(uint64_t capBytes);
+
+    void setBufferCacheBudget(uint64_t idleBytes);
+
+    void trimScratch();
+
+    ScratchArenaStats getScratchStats();
+
+    // Converts sounds loaded from now on to the device's mixing rate (streams keep their own rate)
+    void setLoadResampling(bool enabled);
+
+    /* Starts uncached tracks over PROGRESSIVE_MIN_SECONDS before their decode
+     * finishes, they are shared and cached once it did. Disabled by default,
+     * as they play without the load-time resampling and take about twice
+     * their memory while they play.
+     */
+    void setProgressiveLoading(bool enabled);
+
+    // Receives the sound and export events, set once before initialize()
+    void setEventHandler(EngineEventHandler handler);
+
+    /* Renders a track to a file on the export thread, moving along the
+     * trajectory of another sound (or standing where it stands) from the start
+     * of the track, with the current HRTF and stereo angle. Returns the
+     * export's ID, 0 if another export is running.
+     */
+    uint64_t startExport(const SoundSource &source, const std::string &outputPath, ExportFormat format,
+                         SoundId trajectorySoundId);
+
+    bool cancelExport(uint64_t exportId);
+
+    float getExportProgress() const;
+
+    SourceGroupDrift getDriftStats();
+
+    SourcePoolStats getSourcePoolStats();
+
+    // CPU time and wakeups since initialize(), with the device's actual rate and refresh
+    EnginePowerStats getPowerStats();
+
+    // Posts onPositionTick for every playing sound at this interval, 0 turns the ticks off
+    void setPositionTickInterval(uint32_t intervalMs);
+
+private:
+    void postEvent(CallbackEventType type, SoundId soundId, int32_t code = 0, float value = 0.0f);
+
+    SoundLoadOptions makeLoadOptions();
+
+    // Runs on a load worker
+    void runAsyncLoad(SoundId soundId, const std::shared_ptr<PendingLoad> &pending);
+
+    void watchStreamEvents(SoundId soundId, const SoundInstance &sound);
+
+    static EngineCommand makeCommand(CommandType type, SoundId soundId, float value0 = 0.0f, float value1 = 0.0f,
+                                     float value2 = 0.0f, float value3 = 0.0f);
+
+    void pushCommand(EngineCommand command);
+
+    // Runs on the control thread, the commands and the motion of a tick apply in one batch
+    bool tickControl();
+
+    /* Applies the commands that overflowed the ring, once the ring is empty,
+     * since they were queued after everything in it
+     */
+    void applyOverflowCommandsLocked();
+
+    /* Realigns the channels of playing multichannel sounds that drifted
+     * apart, once per SOURCE_GROUP_DRIFT_INTERVAL. Sets an alarm for the next
+     * check while any of them plays.
+     */
+    void checkDriftLocked();
+
+    // Current time of the transitions' clock, in nanoseconds
+    int64_t getTransitionClock() const;
+
+    /* Schedules the queued sounds nearing their start and runs the
+     * crossfades. Returns true while a transition needs the next ticks, the
+     * others set an alarm for when they get close.
+     */
+    bool updateTransitionsLocked();
+
+    // When the next sound must start so its fade ends with the current sound, false unless it is playing
+    bool getTransitionStart(const SoundInstance &current, int64_t fadeNs, int64_t now, int64_t &startClock) const;
+
+    // Position and gain writes from Kotlin, applied like the matching commands
+    void applyParameterInputsLocked(ParameterBlock &parameterBlock);
+
+    void publishParametersLocked(ParameterBlock &parameterBlock, const EngineSnapshot &snapshot);
+
+    // Returns false if the ticks are turned off
+    bool postPositionTicks(const EngineSnapshot &snapshot);
+
+    void applyCommandLocked(EngineCommand &command);
+
+    // Drops the transition after the sound, taking back the next sound's start if it is still ahead
+    void clearTransitionLocked(SoundId soundId);
+
+    // Stale IDs are ignored, the slot's generation changed when the sound went away
+    void stopSoundLocked(SoundId soundId);
+
+    void stopAllSoundsLocked();
+
+    // Replaces the snapshot read by the queries, readers keep the old one alive as long as they need it
+    std::shared_ptr<const EngineSnapshot> publishSnapshotLocked();
+
+    // Runs on the event loop thread, for every watched source that stopped
+    void onSourceStopped(SoundId soundId);
+};
+
+#endif //INC_8DMUSICPLAYER_AUDIOENGINE_H
@@ -0,0 +1,121 @@
+// Measures how long playback calls wait on the engine, with the calls locking the engine
+// mutex as before, against pushing commands into the MpscRing drained by the control thread.
+// Several caller threads (UI, service, callbacks) issue paced calls while the control thread
+// ticks at the motion rate and holds the engine for a while on each tick, as the AL calls
+// for many moving sources do.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mpscRing.h"
+
+constexpr int CALLER_THREADS = 4;
+constexpr auto CALL_INTERVAL = std::chrono::microseconds(200);
+constexpr auto RUN_TIME = std::chrono::seconds(2);
+constexpr auto TICK_PERIOD = std::chrono::microseconds(8333); // 120 Hz
+constexpr auto TICK_WORK = std::chrono::microseconds(1500);
+constexpr size_t SOUNDS = 16;
+
+struct Command {
+    uint64_t soundId;
+    float values[4];
+};
+
+struct Engine {
+    std::mutex mutex;
+    float positions[SOUNDS][3] = {};
+    MpscRing<Command, 1024> commands;
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> dropped{0};
+
+    void apply(const Command &command) {
+        float *position = positions[command.soundId % SOUNDS];
+        position[0] = command.values[0];
+        position[1] = command.values[1];
+        position[2] = command.values[2];
+    }
+};
+
+static void spinFor(std::chrono::microseconds duration) {
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {}
+}
+
+static void runControlThread(Engine &engine, bool drainRing) {
+    auto deadline = std::chrono::steady_clock::now();
+    while (engine.running) {
+        {
+            std::lock_guard<std::mutex> lock(engine.mutex);
+            if (drainRing) {
+                Command command;
+                while (engine.commands.pop(command))
+                    engine.apply(command);
+            }
+            spinFor(TICK_WORK);
+        }
+        deadline += TICK_PERIOD;
+        std::this_thread::sleep_until(deadline);
+    }
+}
+
+static void runCaller(Engine &engine, bool useRing, int thread, std::vector<double> &latencies) {
+    auto next = std::chrono::steady_clock::now();
+    auto end = next + RUN_TIME;
+    for (uint64_t call = 0; std::chrono::steady_clock::now() < end; call++) {
+        Command command = {call * CALLER_THREADS + thread, {(float) call, 1.0f, 0.0f, 0.0f}};
+
+        auto start = std::chrono::steady_clock::now();
+        if (useRing) {
+            if (!engine.commands.push(command))
+                engine.dropped++;
+        } else {
+            std::lock_guard<std::mutex> lock(engine.mutex);
+            engine.apply(command);
+        }
+        auto finish = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<double, std::micro>(finish - start).count());
+
+        next += CALL_INTERVAL;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+static void runMode(const char *name, bool useRing) {
+    Engine engine;
+    std::thread control(runControlThread, std::ref(engine), useRing);
+
+    std::vector<std::vector<double>> latencies(CALLER_THREADS);
+    std::vector<std::thread> callers;
+    for (int thread = 0; thread < CALLER_THREADS; thread++)
+        callers.emplace_back(runCaller, std::ref(engine), useRing, thread, std::ref(latencies[thread]));
+    for (std::thread &caller: callers)
+        caller.join();
+    engine.running = false;
+    control.join();
+
+    std::vector<double> all;
+    for (const auto &thread: latencies)
+        all.insert(all.end(), thread.begin(), thread.end());
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double p) { return all[std::min(all.size() - 1, (size_t) (p * all.size()))]; };
+    size_t blocked = std::count_if(all.begin(), all.end(), [](double us) { return us > 100.0; });
+
+    printf("%-6s %zu calls: p50 %.2f us, p99 %.2f us, p99.9 %.2f us, max %.2f us, %.2f%% over 100 us, %llu dropped\n",
+           name, all.size(), percentile(0.5), percentile(0.99), percentile(0.999), all.back(),
+           100.0 * blocked / all.size(), (unsigned long long) engine.dropped.load());
+}
+
+int main() {
+    printf("%d caller threads, one call every %lld us each, control tick every %lld us holding the engine %lld us\n",
+           CALLER_THREADS, (long long) CALL_INTERVAL.count(), (long long) TICK_PERIOD.count(),
+           (long long) TICK_WORK.count());
+    runMode("mutex", false);
+    runMode("ring", true);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+// Measures the stereo deinterleave kernels used by processStereoSound and SoundStream,
+// comparing the scalar loop against the kernels selected for the current CPU.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "deinterleave.h"
+
+// A whole 60s track at 44.1kHz (memory bound) and a single streaming chunk (cache resident)
+constexpr size_t TRACK_FRAMES = 44100 * 60;
+constexpr size_t CHUNK_FRAMES = 16384;
+// Every measurement splits about this many frames in total
+constexpr size_t BENCH_TOTAL_FRAMES = TRACK_FRAMES * 20;
+
+static double measureGBps(DeinterleaveFn fn, const void *in, void *left, void *right, size_t frames, size_t sampleSize) {
+    size_t iterations = BENCH_TOTAL_FRAMES / frames;
+    fn(in, left, right, frames); // warm up
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        fn(in, left, right, frames);
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double bytes = (double) frames * 2 * sampleSize * (double) iterations;
+    return bytes / seconds / 1e9;
+}
+
+static bool runType(const char *type, DeinterleaveFn scalar, DeinterleaveFn vector, size_t sampleSize, size_t frames) {
+    std::vector<unsigned char> in(frames * 2 * sampleSize);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (unsigned char) rand();
+
+    std::vector<unsigned char> expected(in.size()), actual(in.size());
+    unsigned char *expectedLeft = expected.data(), *expectedRight = expectedLeft + frames * sampleSize;
+    unsigned char *actualLeft = actual.data(), *actualRight = actualLeft + frames * sampleSize;
+
+    double scalarGBps = measureGBps(scalar, in.data(), expectedLeft, expectedRight, frames, sampleSize);
+    double vectorGBps = measureGBps(vector, in.data(), actualLeft, actualRight, frames, sampleSize);
+
+    // Odd frame counts also exercise the scalar tails of the vector kernels
+    vector(in.data(), actualLeft, actualRight, frames - 7);
+    scalar(in.data(), expectedLeft, expectedRight, frames - 7);
+    bool matches = memcmp(expected.data(), actual.data(), expected.size()) == 0;
+
+    printf("%-6s scalar %7.2f GB/s   %-6s %7.2f GB/s   speedup %5.2fx   %s\n",
+           type, scalarGBps, getDeinterleaveKernels().name, vectorGBps, vectorGBps / scalarGBps,
+           matches ? "ok" : "MISMATCH");
+    return matches;
+}
+
+int main() {
+    const DeinterleaveKernels &scalar = getScalarDeinterleaveKernels();
+    const DeinterleaveKernels &vector = getDeinterleaveKernels();
+    bool ok = true;
+    for (size_t frames: {TRACK_FRAMES, CHUNK_FRAMES}) {
+        printf("Deinterleaving %zu stereo frames at a time\n", frames);
+        ok &= runType("byte", scalar.split8, vector.split8, 1, frames);
+        ok &= runType("short", scalar.split16, vector.split16, 2, frames);
+        ok &= runType("float", scalar.split32, vector.split32, 4, frames);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
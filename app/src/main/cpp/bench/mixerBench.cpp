@@ -0,0 +1,406 @@
+// Measures the spatial mixer's throughput in rendered frames per CPU-second. An ALC_SOFT_loopback
+// device mixes as fast as the CPU allows, while the engine's own source pool, source groups and
+// channel placement drive its sources, orbiting the listener at the motion rate like 8D playback.
+// Swept over the number of active sources, the HRTF datasets in assets/hrtfs, the output rate and
+// mono vs split-stereo tracks. The results are written as JSON, so runs before and after an OpenAL
+// Soft upgrade, or with different HRTFs, can be compared. --trace also records the engine's trace
+// events as Chrome trace JSON.
+//
+//   mixer_bench [--hrtf-dir DIR] [--seconds S] [--output FILE] [--trace FILE] [--quick]
+
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "AL/al.h"
+#include "AL/alc.h"
+#include "AL/alext.h"
+
+#include "motion.h"
+#include "openalInitializer.h"
+#include "sourceGroup.h"
+#include "sourcePool.h"
+#include "trace.h"
+#include "utils.h"
+
+#ifndef SYMPHONY_HRTF_DIR
+#define SYMPHONY_HRTF_DIR "."
+#endif
+
+constexpr int SOURCE_COUNTS[] = {1, 2, 4, 8, 16, 32, 64, 128};
+constexpr int QUICK_SOURCE_COUNTS[] = {1, 16, 128};
+constexpr ALCint OUTPUT_RATES[] = {44100, 48000};
+// Asked of the loopback device, so the pool can hold the largest case
+constexpr ALCint MAX_SOURCES = 128;
+// Length of the looped noise each track plays
+constexpr float TRACK_SECONDS = 4.0f;
+constexpr float DEFAULT_RENDER_SECONDS = 5.0f;
+constexpr float QUICK_RENDER_SECONDS = 1.0f;
+// Same as the engine's defaults
+constexpr float STEREO_ANGLE = M_PI / 6.0f;
+constexpr ALfloat LISTENER_POSITION[] = {0.0f, 0.0f, 1.0f};
+constexpr ALfloat LISTENER_ORIENTATION[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f};
+// Turns per second of the orbits
+constexpr float ORBIT_RATE = 0.125f;
+
+struct Loopback {
+    LPALCLOOPBACKOPENDEVICESOFT openDevice;
+    LPALCISRENDERFORMATSUPPORTEDSOFT isRenderFormatSupported;
+    LPALCRENDERSAMPLESSOFT renderSamples;
+};
+
+struct BenchCase {
+    std::string hrtf;   // dataset name, without the rate suffix
+    ALCint rate;
+    ALsizei channels;   // 1 for mono tracks, 2 for split stereo
+    int sources;
+};
+
+struct BenchResult {
+    std::string hrtfUsed;
+    int64_t frames;
+    double cpuSeconds;
+    double wallSeconds;
+};
+
+static std::string g_alVersion;
+static std::string g_alRenderer;
+
+static double getCpuSeconds() {
+    timespec time = {};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec * 1e-9;
+}
+
+// Dataset names with the rates they come in, from files named like CIAIR_48000.mhr
+static std::set<std::string> findHrtfFiles(const std::string &directory) {
+    std::set<std::string> names;
+    DIR *dir = opendir(directory.c_str());
+    if (!dir) return names;
+    while (dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mhr") == 0)
+            names.insert(name.substr(0, name.size() - 4));
+    }
+    closedir(dir);
+    return names;
+}
+
+static std::vector<std::string> getDatasets(const std::set<std::string> &files) {
+    std::vector<std::string> datasets;
+    for (const std::string &name: files) {
+        size_t separator = name.rfind('_');
+        if (separator == std::string::npos) continue;
+        std::string dataset = name.substr(0, separator);
+        if (std::find(datasets.begin(), datasets.end(), dataset) == datasets.end())
+            datasets.push_back(dataset);
+    }
+    return datasets;
+}
+
+static char g_configPath[] = "/tmp/mixer_bench_alsoft_XXXXXX";
+
+static void removeConfig() {
+    unlink(g_configPath);
+}
+
+/* OpenAL Soft reads its config before the first device is opened, point it at
+ * the assets. The file is removed at exit, once nothing can read it anymore.
+ */
+static bool useHrtfDirectory(const std::string &directory) {
+    int fd = mkstemp(g_configPath);
+    if (fd < 0) return false;
+    atexit(removeConfig);
+    FILE *config = fdopen(fd, "w");
+    if (!config) {
+        close(fd);
+        return false;
+    }
+    bool written = fprintf(config, "[general]\nhrtf-paths = %s\n", directory.c_str()) > 0;
+    if (fclose(config) != 0 || !written) return false;
+    setenv("ALSOFT_CONF", g_configPath, 1);
+    return true;
+}
+
+// 16-bit noise at the output rate, as the engine's buffers are after load-time resampling
+static ALuint createNoiseBuffer(ALCint rate, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> distribution(-8000, 8000);
+    std::vector<short> samples((size_t) (TRACK_SECONDS * rate));
+    for (short &sample: samples)
+        sample = (short) distribution(random);
+
+    ALuint buffer = AL_NONE;
+    alGenBuffers(1, &buffer);
+    alBufferData(buffer, AL_FORMAT_MONO16, samples.data(), (ALsizei) (samples.size() * sizeof(short)), rate);
+    return buffer;
+}
+
+// Runs with the loopback context current
+static bool renderCase(const Loopback &loopback, ALCdevice *device, const BenchCase &benchCase,
+                       float renderSeconds, BenchResult &result) {
+    alListenerfv(AL_POSITION, LISTENER_POSITION);
+    alListenerfv(AL_ORIENTATION, LISTENER_ORIENTATION);
+
+    SourcePool pool;
+    pool.create(device);
+
+    ALuint buffers[2] = {AL_NONE, AL_NONE};
+    for (ALsizei i = 0; i < benchCase.channels; i++)
+        buffers[i] = createNoiseBuffer(benchCase.rate, 1234u + i);
+
+    int tracks = benchCase.sources / benchCase.channels;
+    std::vector<SourceGroup> groups(tracks);
+    std::vector<Trajectory> trajectories(tracks);
+    bool acquired = true;
+    for (int t = 0; t < tracks && acquired; t++) {
+        ALuint sources[2] = {AL_NONE, AL_NONE};
+        acquired = pool.acquire(sources, benchCase.channels);
+        if (!acquired) break;
+        groups[t].assign(sources, benchCase.channels);
+        for (ALsizei i = 0; i < benchCase.channels; i++) {
+            alSourcei(sources[i], AL_SOURCE_RELATIVE, AL_TRUE);
+            alSourcei(sources[i], AL_BUFFER, (ALint) buffers[i]);
+            alSourcei(sources[i], AL_LOOPING, AL_TRUE);
+        }
+        trajectories[t].type = TrajectoryType::Orbit;
+        trajectories[t].rate = ORBIT_RATE;
+        trajectories[t].base.angle = (float) (2.0 * M_PI * t / tracks);
+    }
+
+    if (acquired) {
+        // Positions move once per control tick, between the mixer's blocks
+        ALCsizei blockFrames = (ALCsizei) (benchCase.rate / MOTION_DEFAULT_RATE_HZ);
+        std::vector<float> block(blockFrames * 2);
+        int64_t totalFrames = (int64_t) (renderSeconds * benchCase.rate);
+
+        for (SourceGroup &group: groups)
+            group.play();
+
+        double cpuStart = getCpuSeconds();
+        auto wallStart = std::chrono::steady_clock::now();
+        int64_t renderedFrames = 0;
+        while (renderedFrames < totalFrames) {
+            double time = (double) renderedFrames / benchCase.rate;
+            {
+                UpdateBatch batch;
+                for (int t = 0; t < tracks; t++) {
+                    MotionPose pose = trajectories[t].evaluate(time);
+                    setChannelPositions(groups[t].data(), groups[t].size(), pose.angle, pose.radius, pose.height,
+                                        STEREO_ANGLE);
+                }
+            }
+            ALCsizei frames = (ALCsizei) std::min<int64_t>(blockFrames, totalFrames - renderedFrames);
+            loopback.renderSamples(device, block.data(), frames);
+            renderedFrames += frames;
+        }
+        result.cpuSeconds = getCpuSeconds() - cpuStart;
+        result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        result.frames = renderedFrames;
+
+        volatile float sink = block[0];
+        (void) sink;
+    }
+
+    for (SourceGroup &group: groups) {
+        for (ALsizei i = 0; i < group.size(); i++)
+            pool.release(group[i]);
+    }
+    pool.destroy();
+    alDeleteBuffers(benchCase.channels, buffers);
+    return acquired;
+}
+
+static bool runCase(const Loopback &loopback, const BenchCase &benchCase, float renderSeconds, BenchResult &result) {
+    ALCdevice *device = loopback.openDevice(nullptr);
+    if (!device || !loopback.isRenderFormatSupported(device, benchCase.rate, ALC_STEREO_SOFT, ALC_FLOAT_SOFT)) {
+        fprintf(stderr, "No float stereo loopback device at %d Hz\n", benchCase.rate);
+        if (device) alcCloseDevice(device);
+        return false;
+    }
+
+    std::string hrtfName = benchCase.hrtf + "_" + std::to_string(benchCase.rate);
+    ALCint hrtfIndex = findHRTF(device, hrtfName.c_str());
+    if (hrtfIndex < 0) {
+        fprintf(stderr, "HRTF %s not found, skipped\n", hrtfName.c_str());
+        alcCloseDevice(device);
+        return false;
+    }
+
+    ALCint attributes[] = {ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+                           ALC_FORMAT_TYPE_SOFT, ALC_FLOAT_SOFT,
+                           ALC_FREQUENCY, benchCase.rate,
+                           ALC_HRTF_SOFT, ALC_TRUE,
+                           ALC_HRTF_ID_SOFT, hrtfIndex,
+                           ALC_MONO_SOURCES, MAX_SOURCES,
+                           0};
+    ALCcontext *context = alcCreateContext(device, attributes);
+    if (!context || !alcMakeContextCurrent(context)) {
+        fprintf(stderr, "Failed to create the loopback context\n");
+        if (context) alcDestroyContext(context);
+        alcCloseDevice(device);
+        return false;
+    }
+    UpdateBatch::load();
+    if (g_alVersion.empty()) {
+        g_alVersion = alGetString(AL_VERSION);
+        g_alRenderer = alGetString(AL_RENDERER);
+    }
+
+    // Numbers without the HRTF actually applied would be misleading
+    ALCint hrtfState = ALC_FALSE;
+    alcGetIntegerv(device, ALC_HRTF_SOFT, 1, &hrtfState);
+    bool rendered = false;
+    if (hrtfState) {
+        result.hrtfUsed = alcGetString(device, ALC_HRTF_SPECIFIER_SOFT);
+        rendered = renderCase(loopback, device, benchCase, renderSeconds, result);
+    } else {
+        fprintf(stderr, "HRTF %s could not be enabled, skipped\n", hrtfName.c_str());
+    }
+
+    alcMakeContextCurrent(nullptr);
+    alcDestroyContext(context);
+    alcCloseDevice(device);
+    return rendered;
+}
+
+static void writeJsonString(FILE *out, const std::string &value) {
+    fputc('"', out);
+    for (char c: value) {
+        if (c == '"' || c == '\\') fputc('\\', out);
+        if ((unsigned char) c >= 0x20) fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+int main(int argc, char **argv) {
+    std::string hrtfDirectory = SYMPHONY_HRTF_DIR;
+    std::string outputPath;
+    std::string tracePath;
+    float renderSeconds = DEFAULT_RENDER_SECONDS;
+    bool quick = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--hrtf-dir" && i + 1 < argc) {
+            hrtfDirectory = argv[++i];
+        } else if (arg == "--seconds" && i + 1 < argc) {
+            renderSeconds = (float) atof(argv[++i]);
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--quick") {
+            quick = true;
+            renderSeconds = QUICK_RENDER_SECONDS;
+        } else {
+            fprintf(stderr, "Usage: %s [--hrtf-dir DIR] [--seconds S] [--output FILE] [--trace FILE] [--quick]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::set<std::string> hrtfFiles = findHrtfFiles(hrtfDirectory);
+    std::vector<std::string> datasets = getDatasets(hrtfFiles);
+    if (datasets.empty() || !useHrtfDirectory(hrtfDirectory)) {
+        fprintf(stderr, "No HRTFs found in %s\n", hrtfDirectory.c_str());
+        return EXIT_FAILURE;
+    }
+    if (quick) datasets.resize(1);
+
+    Loopback loopback = {
+            reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(alcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT")),
+            reinterpret_cast<LPALCISRENDERFORMATSUPPORTEDSOFT>(
+                    alcGetProcAddress(nullptr, "alcIsRenderFormatSupportedSOFT")),
+            reinterpret_cast<LPALCRENDERSAMPLESSOFT>(alcGetProcAddress(nullptr, "alcRenderSamplesSOFT")),
+    };
+    if (!alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback") || !loopback.openDevice ||
+        !loopback.isRenderFormatSupported || !loopback.renderSamples) {
+        fprintf(stderr, "ALC_SOFT_loopback is not supported\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<int> sourceCounts = quick ? std::vector<int>(std::begin(QUICK_SOURCE_COUNTS),
+                                                             std::end(QUICK_SOURCE_COUNTS))
+                                          : std::vector<int>(std::begin(SOURCE_COUNTS), std::end(SOURCE_COUNTS));
+    std::vector<BenchCase> cases;
+    for (const std::string &dataset: datasets) {
+        for (ALCint rate: OUTPUT_RATES) {
+            if (!hrtfFiles.count(dataset + "_" + std::to_string(rate))) continue;
+            for (ALsizei channels = 1; channels <= 2; channels++) {
+                for (int sources: sourceCounts) {
+                    if (sources % channels == 0)
+                        cases.push_back({dataset, rate, channels, sources});
+                }
+            }
+        }
+    }
+
+    if (!tracePath.empty() && !startChromeTrace(tracePath.c_str())) {
+        fprintf(stderr, "Failed to create %s\n", tracePath.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::pair<BenchCase, BenchResult>> results;
+    for (size_t i = 0; i < cases.size(); i++) {
+        const BenchCase &benchCase = cases[i];
+        BenchResult result = {};
+        TraceScope caseScope("MixerBench case");
+        bool rendered = runCase(loopback, benchCase, renderSeconds, result);
+        caseScope.end();
+        if (!rendered) continue;
+
+        double framesPerCpuSecond = result.cpuSeconds > 0.0 ? result.frames / result.cpuSeconds : 0.0;
+        fprintf(stderr, "[%zu/%zu] %s %d Hz, %s, %3d sources: %.0f frames/CPU-s (%.1fx real time)\n",
+                i + 1, cases.size(), benchCase.hrtf.c_str(), benchCase.rate,
+                benchCase.channels == 1 ? "mono  " : "stereo", benchCase.sources, framesPerCpuSecond,
+                framesPerCpuSecond / benchCase.rate);
+        results.emplace_back(benchCase, result);
+    }
+    stopChromeTrace();
+    if (results.empty()) {
+        fprintf(stderr, "No case could be rendered\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = outputPath.empty() ? stdout : fopen(outputPath.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Failed to create %s\n", outputPath.c_str());
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "{\n  \"benchmark\": \"mixer_throughput\",\n  \"openalVersion\": ");
+    writeJsonString(out, g_alVersion);
+    fprintf(out, ",\n  \"openalRenderer\": ");
+    writeJsonString(out, g_alRenderer);
+    fprintf(out, ",\n  \"renderSeconds\": %.3f,\n  \"blockHz\": %.1f,\n  \"results\": [\n",
+            renderSeconds, MOTION_DEFAULT_RATE_HZ);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchCase &benchCase = results[i].first;
+        const BenchResult &result = results[i].second;
+        double framesPerCpuSecond = result.cpuSeconds > 0.0 ? result.frames / result.cpuSeconds : 0.0;
+        fprintf(out, "    {\"hrtf\": ");
+        writeJsonString(out, benchCase.hrtf);
+        fprintf(out, ", \"hrtfSpecifier\": ");
+        writeJsonString(out, result.hrtfUsed);
+        fprintf(out, ", \"rate\": %d, \"layout\": \"%s\", \"sources\": %d, \"tracks\": %d, \"frames\": %lld, "
+                     "\"cpuSeconds\": %.6f, \"wallSeconds\": %.6f, \"framesPerCpuSecond\": %.1f, "
+                     "\"realtimeFactor\": %.2f}%s\n",
+                benchCase.rate, benchCase.channels == 1 ? "mono" : "stereo", benchCase.sources,
+                benchCase.sources / benchCase.channels, (long long) result.frames, result.cpuSeconds,
+                result.wallSeconds, framesPerCpuSecond, framesPerCpuSecond / benchCase.rate,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout) fclose(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+// Measures the load-time Resampler: its accuracy, its one-off cost per track, and the
+// per-period mixer work it saves. The mixer side is approximated by a 4-point cubic
+// resampler like OpenAL Soft's default one, run over the two mono sources of a stereo
+// track, against the plain copy the mixer does once source and device rates match.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "resampler.h"
+
+constexpr uint32_t SOURCE_RATE = 44100;
+constexpr uint32_t DEVICE_RATE = 48000;
+constexpr size_t TRACK_SECONDS = 60;
+// OpenAL Soft's default period on Android
+constexpr size_t PERIOD_FRAMES = 1024;
+constexpr size_t MIX_PERIODS = 20000;
+
+static double measureSnr(const Resampler &resampler, double frequency) {
+    size_t inFrames = SOURCE_RATE * 2;
+    std::vector<float> in(inFrames * 2);
+    for (size_t i = 0; i < inFrames; i++)
+        in[i * 2] = in[i * 2 + 1] = (float) (0.5 * sin(2 * M_PI * frequency * i / SOURCE_RATE));
+
+    size_t outFrames = resampler.getOutputFrames(inFrames);
+    std::vector<float> out(outFrames * 2);
+    resampler.process(in.data(), inFrames, out.data(), 2);
+
+    // Skip the edges, where the input is padded with silence
+    double signal = 0.0, noise = 0.0;
+    for (size_t j = outFrames / 4; j < outFrames * 3 / 4; j++) {
+        double expected = 0.5 * sin(2 * M_PI * frequency * j / DEVICE_RATE);
+        signal += expected * expected;
+        noise += (out[j * 2] - expected) * (out[j * 2] - expected);
+    }
+    return 10.0 * log10(signal / noise);
+}
+
+// Stand-in for the mixer's per-source resampling stage
+static void mixCubic(const float *in, float *out, size_t frames, double step, double &position) {
+    for (size_t i = 0; i < frames; i++) {
+        size_t index = (size_t) position;
+        float mu = (float) (position - index);
+        float s0 = in[index], s1 = in[index + 1], s2 = in[index + 2], s3 = in[index + 3];
+        float a = -0.5f * s0 + 1.5f * s1 - 1.5f * s2 + 0.5f * s3;
+        float b = s0 - 2.5f * s1 + 2.0f * s2 - 0.5f * s3;
+        float c = -0.5f * s0 + 0.5f * s2;
+        out[i] += ((a * mu + b) * mu + c) * mu + s1;
+        position += step;
+    }
+}
+
+static void mixCopy(const float *in, float *out, size_t frames, double &position) {
+    size_t index = (size_t) position;
+    for (size_t i = 0; i < frames; i++)
+        out[i] += in[index + i];
+    position += (double) frames;
+}
+
+static double measurePeriodNs(bool resampled, const std::vector<float> &left, const std::vector<float> &right) {
+    std::vector<float> mix(PERIOD_FRAMES);
+    double step = (double) SOURCE_RATE / DEVICE_RATE;
+    double positions[2] = {0.0, 0.0};
+    size_t limit = left.size() - PERIOD_FRAMES * 2 - 4;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t period = 0; period < MIX_PERIODS; period++) {
+        std::fill(mix.begin(), mix.end(), 0.0f);
+        const std::vector<float> *sources[2] = {&left, &right};
+        for (int s = 0; s < 2; s++) {
+            if (positions[s] >= (double) limit) positions[s] = 0.0;
+            if (resampled)
+                mixCubic(sources[s]->data(), mix.data(), PERIOD_FRAMES, step, positions[s]);
+            else
+                mixCopy(sources[s]->data(), mix.data(), PERIOD_FRAMES, positions[s]);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    volatile float sink = mix[PERIOD_FRAMES / 2];
+    (void) sink;
+    return std::chrono::duration<double, std::nano>(end - start).count() / MIX_PERIODS;
+}
+
+int main() {
+    Resampler resampler(SOURCE_RATE, DEVICE_RATE);
+
+    double snr1k = measureSnr(resampler, 1000.0), snr15k = measureSnr(resampler, 15000.0);
+    printf("Accuracy %u -> %u Hz: SNR %.1f dB at 1 kHz, %.1f dB at 15 kHz\n",
+           SOURCE_RATE, DEVICE_RATE, snr1k, snr15k);
+
+    size_t inFrames = SOURCE_RATE * TRACK_SECONDS;
+    std::vector<short> in(inFrames * 2);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (short) (rand() % 20000 - 10000);
+    std::vector<short> out(resampler.getOutputFrames(inFrames) * 2);
+
+    auto start = std::chrono::steady_clock::now();
+    resampler.process(in.data(), inFrames, out.data(), 2);
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("Load-time conversion of a %zus stereo track: %.3f s (%.0fx realtime)\n",
+           TRACK_SECONDS, seconds, TRACK_SECONDS / seconds);
+
+    std::vector<float> left(DEVICE_RATE * 4), right(DEVICE_RATE * 4);
+    for (size_t i = 0; i < left.size(); i++) {
+        left[i] = (float) rand() / RAND_MAX - 0.5f;
+        right[i] = (float) rand() / RAND_MAX - 0.5f;
+    }
+    double resampledNs = measurePeriodNs(true, left, right);
+    double copiedNs = measurePeriodNs(false, left, right);
+    double periodNs = 1e9 * PERIOD_FRAMES / DEVICE_RATE;
+    printf("Mixer stage per %zu-frame period, stereo track: %.0f ns resampling vs %.0f ns at the device rate "
+           "(%.3f%% vs %.3f%% of the period)\n",
+           PERIOD_FRAMES, resampledNs, copiedNs, 100.0 * resampledNs / periodNs, 100.0 * copiedNs / periodNs);
+
+    return (snr1k > 60.0 && snr15k > 60.0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,151 @@
+#ifndef INC_8DMUSICPLAYER_BUFFERCACHE_H
+#define INC_8DMUSICPLAYER_BUFFERCACHE_H
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "AL/al.h"
+
+#include "logSink.h"
+#include "trace.h"
+#define C_BUFFER_CACHE "C++ Buffer Cache"
+
+/* Engine-wide cache of loaded AL buffers, keyed by source identity and load
+ * format, so a track loaded twice (replay, repeat-one, the same track in two
+ * slots) shares one set of buffers with no decode and no upload.
+ * Buffers are reference counted; once unused they stay around in LRU order
+ * while they fit in the idle budget. Needs the AL context to be current.
+ */
+class BufferCache {
+private:
+    typedef std::pair<ALuint, ALuint> BufferPair;
+
+    struct Entry {
+        BufferPair buffers;
+        uint64_t bytes;
+        int references;
+        std::list<std::string>::iterator idlePosition; // valid while references == 0
+    };
+
+    std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+    std::map<ALuint, std::string> m_keysByBuffer;
+    std::list<std::string> m_idle; // least recently used first
+    uint64_t m_idleBytes;
+    uint64_t m_idleBudgetBytes;
+
+public:
+    explicit BufferCache(uint64_t idleBudgetBytes) : m_idleBytes(0), m_idleBudgetBytes(idleBudgetBytes) {}
+
+    BufferCache(const BufferCache &) = delete;
+    BufferCache &operator=(const BufferCache &) = delete;
+
+    // Takes a reference on the cached buffers for the key, returns false on a miss
+    bool acquire(const std::string &key, BufferPair &buffers) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it == m_entries.end()) return false;
+
+        Entry &entry = it->second;
+        if (entry.references++ == 0) {
+            m_idle.erase(entry.idlePosition);
+            m_idleBytes -= entry.bytes;
+        }
+        buffers = entry.buffers;
+        return true;
+    }
+
+    /* Adds freshly loaded buffers with one reference and returns the buffers
+     * to use. If another load of the same key got there first, the new
+     * buffers are deleted and the cached ones are returned instead.
+     */
+    BufferPair add(const std::string &key, const BufferPair &buffers) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it != m_entries.end()) {
+            deleteBuffers(buffers);
+            Entry &entry = it->second;
+            if (entry.references++ == 0) {
+                m_idle.erase(entry.idlePosition);
+                m_idleBytes -= entry.bytes;
+            }
+            return entry.buffers;
+        }
+
+        Entry entry = {buffers, getBufferBytes(buffers.first) + getBufferBytes(buffers.second), 1, m_idle.end()};
+        m_entries.emplace(key, entry);
+        m_keysByBuffer[buffers.first] = key;
+        return buffers;
+    }
+
+    /* Drops a reference taken by acquire() or add(). Returns false if the
+     * buffers aren't owned by the cache, in which case the caller deletes them.
+     */
+    bool release(const BufferPair &buffers) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto keyIt = m_keysByBuffer.find(buffers.first);
+        if (keyIt == m_keysByBuffer.end()) return false;
+
+        Entry &entry = m_entries.at(keyIt->second);
+        if (--entry.references == 0) {
+            entry.idlePosition = m_idle.insert(m_idle.end(), keyIt->second);
+            m_idleBytes += entry.bytes;
+            evictLocked();
+        }
+        return true;
+    }
+
+    // Sets how much unused buffer memory is kept for later loads, 0 keeps none
+    void setIdleBudget(uint64_t idleBudgetBytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idleBudgetBytes = idleBudgetBytes;
+        evictLocked();
+    }
+
+    // Deletes every unused entry, referenced ones stay valid
+    void trim() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t budget = m_idleBudgetBytes;
+        m_idleBudgetBytes = 0;
+        evictLocked();
+        m_idleBudgetBytes = budget;
+    }
+
+    static uint64_t getBufferBytes(ALuint buffer) {
+        if (buffer == AL_NONE) return 0;
+        ALint size = 0;
+        alGetBufferi(buffer, AL_SIZE, &size);
+        return size > 0 ? (uint64_t) size : 0;
+    }
+
+    // Deletes loaded buffers, taking them off the resident bytes counter
+    static void deleteBuffers(const BufferPair &buffers) {
+        traceCounterAdd(TraceCounter::AlBufferBytes,
+                        -(int64_t) (getBufferBytes(buffers.first) + getBufferBytes(buffers.second)));
+        if (buffers.first != AL_NONE)
+            alDeleteBuffers(1, &buffers.first);
+        if (buffers.second != AL_NONE)
+            alDeleteBuffers(1, &buffers.second);
+    }
+
+private:
+    void evictLocked() {
+        while (!m_idle.empty() && m_idleBytes > m_idleBudgetBytes) {
+            auto it = m_entries.find(m_idle.front());
+            m_idle.pop_front();
+
+            m_idleBytes -= it->second.bytes;
+            m_keysByBuffer.erase(it->second.buffers.first);
+            deleteBuffers(it->second.buffers);
+            logPrint(LogLevel::Debug, C_BUFFER_CACHE, "Evicted %s", it->first.c_str());
+            m_entries.erase(it);
+        }
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_BUFFERCACHE_H
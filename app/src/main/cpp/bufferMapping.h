@@ -0,0 +1,39 @@
+#ifndef INC_8DMUSICPLAYER_BUFFERMAPPING_H
+#define INC_8DMUSICPLAYER_BUFFERMAPPING_H
+
+#include "AL/al.h"
+#include "AL/alext.h"
+
+/* AL_SOFT_map_buffer is still an in-progress extension of OpenAL Soft
+ * (advertised as AL_SOFTX_map_buffer), so it isn't part of alext.h.
+ * These definitions match OpenAL Soft's inprogext.h.
+ */
+#ifndef AL_SOFT_map_buffer
+#define AL_SOFT_map_buffer 1
+typedef unsigned int ALbitfieldSOFT;
+#define AL_MAP_READ_BIT_SOFT                     0x00000001
+#define AL_MAP_WRITE_BIT_SOFT                    0x00000002
+#define AL_MAP_PERSISTENT_BIT_SOFT               0x00000004
+#define AL_PRESERVE_DATA_BIT_SOFT                0x00000008
+typedef void (AL_APIENTRY*LPALBUFFERSTORAGESOFT)(ALuint buffer, ALenum format, const ALvoid *data, ALsizei size, ALsizei freq, ALbitfieldSOFT flags);
+typedef void* (AL_APIENTRY*LPALMAPBUFFERSOFT)(ALuint buffer, ALsizei offset, ALsizei length, ALbitfieldSOFT access);
+typedef void (AL_APIENTRY*LPALUNMAPBUFFERSOFT)(ALuint buffer);
+typedef void (AL_APIENTRY*LPALFLUSHMAPPEDBUFFERSOFT)(ALuint buffer, ALsizei offset, ALsizei length);
+#endif
+
+inline LPALBUFFERSTORAGESOFT alBufferStorageSOFT;
+inline LPALMAPBUFFERSOFT alMapBufferSOFT;
+inline LPALUNMAPBUFFERSOFT alUnmapBufferSOFT;
+
+// Loads the buffer mapping functions, returns false if the current context doesn't support them
+inline bool loadBufferMapping() {
+    if(!alIsExtensionPresent("AL_SOFT_map_buffer") && !alIsExtensionPresent("AL_SOFTX_map_buffer"))
+        return false;
+
+    alBufferStorageSOFT = reinterpret_cast<LPALBUFFERSTORAGESOFT>(alGetProcAddress("alBufferStorageSOFT"));
+    alMapBufferSOFT = reinterpret_cast<LPALMAPBUFFERSOFT>(alGetProcAddress("alMapBufferSOFT"));
+    alUnmapBufferSOFT = reinterpret_cast<LPALUNMAPBUFFERSOFT>(alGetProcAddress("alUnmapBufferSOFT"));
+    return alBufferStorageSOFT && alMapBufferSOFT && alUnmapBufferSOFT;
+}
+
+#endif //INC_8DMUSICPLAYER_BUFFERMAPPING_H
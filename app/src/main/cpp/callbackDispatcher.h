@@ -0,0 +1,267 @@
+#ifndef INC_8DMUSICPLAYER_CALLBACKDISPATCHER_H
+#define INC_8DMUSICPLAYER_CALLBACKDISPATCHER_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <jni.h>
+
+#include "engineEvents.h"
+#include "logSink.h"
+#include "trace.h"
+#define C_CALLBACK_DISPATCHER "C++ Callback Dispatcher"
+
+// Events waiting for delivery past this are dropped, e.g. when the callback blocks
+constexpr size_t CALLBACK_QUEUE_LIMIT = 4096;
+
+struct CallbackEvent {
+    CallbackEventType type;
+    uint64_t soundId;
+    int32_t code;
+    float value;
+    std::chrono::steady_clock::time_point postedAt;
+};
+
+struct CallbackStats {
+    uint64_t delivered;       // events handed to the callback
+    uint64_t dropped;         // events lost to a full queue, or with no callback set
+    uint64_t batches;         // wakeups of the dispatcher thread
+    uint64_t totalLatencyNs;  // posting to the end of the delivery, summed over the events
+    uint64_t maxLatencyNs;
+    uint64_t totalCallNs;     // time spent in the JNI calls, summed over the events
+    uint64_t maxCallNs;
+};
+
+// The callback and its method IDs, a null method means the callback doesn't have it
+struct CallbackTarget {
+    jobject callback;
+    jmethodID onSoundFinished;
+    jmethodID onSoundLoaded;
+    jmethodID onSoundError;
+    jmethodID onPositionTick;
+    jmethodID onUnderrun;
+    jmethodID onExportProgress;
+    jmethodID onExportFinished;
+};
+
+/* Delivers engine events to the Kotlin callback from one thread, attached to
+ * the JVM for its whole life. The callback's method IDs are resolved once in
+ * setCallback(), and events posted from any thread are delivered in batches
+ * in posting order. Posting only takes a short lock, it never calls into Java.
+ */
+class CallbackDispatcher {
+private:
+    JavaVM *m_javaVM;
+    std::thread m_thread;
+    std::mutex m_queueMutex;
+    std::condition_variable m_cv;
+    std::vector<CallbackEvent> m_queue;
+    bool m_running;
+
+    /* Never held during a Java call: a batch is delivered to a copy of the
+     * target, with its own reference, so a callback may replace itself
+     */
+    std::mutex m_callbackMutex;
+    CallbackTarget m_target;
+
+    std::mutex m_statsMutex;
+    CallbackStats m_stats;
+
+public:
+    CallbackDispatcher() : m_javaVM(nullptr), m_running(false), m_target(), m_stats() {}
+
+    ~CallbackDispatcher() {
+        stop();
+    }
+
+    CallbackDispatcher(const CallbackDispatcher &) = delete;
+    CallbackDispatcher &operator=(const CallbackDispatcher &) = delete;
+
+    void start(JavaVM *javaVM) {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        if (m_running || !javaVM) return;
+        m_javaVM = javaVM;
+        m_running = true;
+        m_thread = std::thread(&CallbackDispatcher::run, this);
+    }
+
+    // Delivers what is still queued, then detaches the thread and drops the callback
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            if (!m_running) return;
+            m_running = false;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    // Resolves the method IDs once, methods the callback doesn't have are skipped
+    void setCallback(JNIEnv *env, jobject callback) {
+        std::lock_guard<std::mutex> lock(m_callbackMutex);
+        releaseCallbackLocked(env);
+        if (!callback) return;
+
+        m_target.callback = env->NewGlobalRef(callback);
+        jclass callbackClass = env->GetObjectClass(callback);
+        m_target.onSoundFinished = getMethod(env, callbackClass, "onSoundFinished", "(J)V");
+        m_target.onSoundLoaded = getMethod(env, callbackClass, "onSoundLoaded", "(JZ)V");
+        m_target.onSoundError = getMethod(env, callbackClass, "onSoundError", "(JI)V");
+        m_target.onPositionTick = getMethod(env, callbackClass, "onPositionTick", "(JF)V");
+        m_target.onUnderrun = getMethod(env, callbackClass, "onUnderrun", "(J)V");
+        m_target.onExportProgress = getMethod(env, callbackClass, "onExportProgress", "(JF)V");
+        m_target.onExportFinished = getMethod(env, callbackClass, "onExportFinished", "(JI)V");
+        env->DeleteLocalRef(callbackClass);
+    }
+
+    void post(CallbackEventType type, uint64_t soundId, int32_t code = 0, float value = 0.0f) {
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            if (!m_running || m_queue.size() >= CALLBACK_QUEUE_LIMIT) {
+                std::lock_guard<std::mutex> statsLock(m_statsMutex);
+                m_stats.dropped++;
+                return;
+            }
+            m_queue.push_back({type, soundId, code, value, std::chrono::steady_clock::now()});
+        }
+        m_cv.notify_one();
+    }
+
+    CallbackStats getStats() {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        return m_stats;
+    }
+
+private:
+    static jmethodID getMethod(JNIEnv *env, jclass callbackClass, const char *name, const char *signature) {
+        jmethodID method = env->GetMethodID(callbackClass, name, signature);
+        if (!method) env->ExceptionClear();
+        return method;
+    }
+
+    void releaseCallbackLocked(JNIEnv *env) {
+        if (m_target.callback) env->DeleteGlobalRef(m_target.callback);
+        m_target = {};
+    }
+
+    void run() {
+        JNIEnv *env = nullptr;
+        JavaVMAttachArgs args = {JNI_VERSION_1_6, "AudioCallbacks", nullptr};
+        if (m_javaVM->AttachCurrentThread(&env, &args) != JNI_OK) {
+            logPrint(LogLevel::Error, C_CALLBACK_DISPATCHER, "Failed to attach the callback thread");
+            return;
+        }
+
+        std::vector<CallbackEvent> batch;
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        while (m_running || !m_queue.empty()) {
+            m_cv.wait(lock, [this] { return !m_running || !m_queue.empty(); });
+            batch.swap(m_queue);
+            lock.unlock();
+
+            deliver(env, batch);
+            batch.clear();
+
+            lock.lock();
+        }
+        lock.unlock();
+
+        {
+            std::lock_guard<std::mutex> callbackLock(m_callbackMutex);
+            releaseCallbackLocked(env);
+        }
+        m_javaVM->DetachCurrentThread();
+    }
+
+    void deliver(JNIEnv *env, const std::vector<CallbackEvent> &batch) {
+        if (batch.empty()) return;
+        TRACE_SCOPE("DispatchCallbacks");
+        uint64_t delivered = 0, dropped = 0, totalLatencyNs = 0, maxLatencyNs = 0, totalCallNs = 0, maxCallNs = 0;
+
+        // The whole batch goes to the callback set when it started, even if it gets replaced meanwhile
+        CallbackTarget target;
+        {
+            std::lock_guard<std::mutex> callbackLock(m_callbackMutex);
+            target = m_target;
+            if (target.callback) target.callback = env->NewGlobalRef(target.callback);
+        }
+
+        for (const CallbackEvent &event: batch) {
+            auto callStart = std::chrono::steady_clock::now();
+            if (!call(env, target, event)) {
+                dropped++;
+                continue;
+            }
+            if (env->ExceptionCheck()) {
+                logPrint(LogLevel::Warn, C_CALLBACK_DISPATCHER, "Callback threw an exception");
+                env->ExceptionClear();
+            }
+            auto callEnd = std::chrono::steady_clock::now();
+
+            uint64_t callNs = std::chrono::duration_cast<std::chrono::nanoseconds>(callEnd - callStart).count();
+            uint64_t latencyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(callEnd - event.postedAt).count();
+            delivered++;
+            totalCallNs += callNs;
+            maxCallNs = std::max(maxCallNs, callNs);
+            totalLatencyNs += latencyNs;
+            maxLatencyNs = std::max(maxLatencyNs, latencyNs);
+        }
+        if (target.callback) env->DeleteGlobalRef(target.callback);
+
+        std::lock_guard<std::mutex> statsLock(m_statsMutex);
+        m_stats.batches++;
+        m_stats.delivered += delivered;
+        m_stats.dropped += dropped;
+        m_stats.totalCallNs += totalCallNs;
+        m_stats.maxCallNs = std::max(m_stats.maxCallNs, maxCallNs);
+        m_stats.totalLatencyNs += totalLatencyNs;
+        m_stats.maxLatencyNs = std::max(m_stats.maxLatencyNs, maxLatencyNs);
+    }
+
+    // Returns false if there is no callback, or it doesn't handle the event
+    static bool call(JNIEnv *env, const CallbackTarget &target, const CallbackEvent &event) {
+        if (!target.callback) return false;
+        jlong soundId = (jlong) event.soundId;
+
+        switch (event.type) {
+            case CallbackEventType::Finished:
+                if (!target.onSoundFinished) return false;
+                env->CallVoidMethod(target.callback, target.onSoundFinished, soundId);
+                return true;
+            case CallbackEventType::Loaded:
+                if (!target.onSoundLoaded) return false;
+                env->CallVoidMethod(target.callback, target.onSoundLoaded, soundId, event.value != 0.0f ? JNI_TRUE : JNI_FALSE);
+                return true;
+            case CallbackEventType::Error:
+                if (!target.onSoundError) return false;
+                env->CallVoidMethod(target.callback, target.onSoundError, soundId, (jint) event.code);
+                return true;
+            case CallbackEventType::PositionTick:
+                if (!target.onPositionTick) return false;
+                env->CallVoidMethod(target.callback, target.onPositionTick, soundId, (jfloat) event.value);
+                return true;
+            case CallbackEventType::Underrun:
+                if (!target.onUnderrun) return false;
+                env->CallVoidMethod(target.callback, target.onUnderrun, soundId);
+                return true;
+            case CallbackEventType::ExportProgress:
+                if (!target.onExportProgress) return false;
+                env->CallVoidMethod(target.callback, target.onExportProgress, soundId, (jfloat) event.value);
+                return true;
+            case CallbackEventType::ExportFinished:
+                if (!target.onExportFinished) return false;
+                env->CallVoidMethod(target.callback, target.onExportFinished, soundId, (jint) event.code);
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_CALLBACKDISPATCHER_H
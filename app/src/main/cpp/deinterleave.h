@@ -0,0 +1,237 @@
+#ifndef INC_8DMUSICPLAYER_DEINTERLEAVE_H
+#define INC_8DMUSICPLAYER_DEINTERLEAVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__aarch64__) || (defined(__arm__) && defined(__ARM_NEON))
+#define DEINTERLEAVE_NEON 1
+#include <arm_neon.h>
+#if defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#elif defined(__x86_64__) || defined(__i386__)
+#define DEINTERLEAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Splits interleaved stereo samples into separate left and right planes.
+ * Kernels exist for 8, 16 and 32-bit samples (raw bytes, short and float),
+ * the vectorized variant is picked once at runtime from the CPU features
+ * (NEON on ARM, SSE2/AVX2 on x86) with a scalar loop as fallback.
+ */
+typedef void (*DeinterleaveFn)(const void *interleaved, void *left, void *right, size_t frames);
+
+struct DeinterleaveKernels {
+    const char *name;
+    DeinterleaveFn split8;
+    DeinterleaveFn split16;
+    DeinterleaveFn split32;
+};
+
+template<typename T>
+inline void deinterleaveScalar(const void *interleaved, void *left, void *right, size_t frames) {
+    const T *in = (const T *) interleaved;
+    T *l = (T *) left;
+    T *r = (T *) right;
+    for (size_t i = 0; i < frames; i++) {
+        l[i] = in[2 * i];
+        r[i] = in[2 * i + 1];
+    }
+}
+
+#if DEINTERLEAVE_NEON
+inline void deinterleave8Neon(const void *interleaved, void *left, void *right, size_t frames) {
+    const uint8_t *in = (const uint8_t *) interleaved;
+    uint8_t *l = (uint8_t *) left;
+    uint8_t *r = (uint8_t *) right;
+    size_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        uint8x16x2_t v = vld2q_u8(in + 2 * i);
+        vst1q_u8(l + i, v.val[0]);
+        vst1q_u8(r + i, v.val[1]);
+    }
+    deinterleaveScalar<uint8_t>(in + 2 * i, l + i, r + i, frames - i);
+}
+
+inline void deinterleave16Neon(const void *interleaved, void *left, void *right, size_t frames) {
+    const int16_t *in = (const int16_t *) interleaved;
+    int16_t *l = (int16_t *) left;
+    int16_t *r = (int16_t *) right;
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v = vld2q_s16(in + 2 * i);
+        vst1q_s16(l + i, v.val[0]);
+        vst1q_s16(r + i, v.val[1]);
+    }
+    deinterleaveScalar<int16_t>(in + 2 * i, l + i, r + i, frames - i);
+}
+
+inline void deinterleave32Neon(const void *interleaved, void *left, void *right, size_t frames) {
+    const float *in = (const float *) interleaved;
+    float *l = (float *) left;
+    float *r = (float *) right;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t v = vld2q_f32(in + 2 * i);
+        vst1q_f32(l + i, v.val[0]);
+        vst1q_f32(r + i, v.val[1]);
+    }
+    deinterleaveScalar<float>(in + 2 * i, l + i, r + i, frames - i);
+}
+#endif
+
+#if DEINTERLEAVE_X86
+__attribute__((target("sse2")))
+inline void deinterleave8Sse2(const void *interleaved, void *left, void *right, size_t frames) {
+    const uint8_t *in = (const uint8_t *) interleaved;
+    uint8_t *l = (uint8_t *) left;
+    uint8_t *r = (uint8_t *) right;
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    size_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (in + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (in + 2 * i + 16));
+        __m128i even = _mm_packus_epi16(_mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes));
+        __m128i odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *) (l + i), even);
+        _mm_storeu_si128((__m128i *) (r + i), odd);
+    }
+    deinterleaveScalar<uint8_t>(in + 2 * i, l + i, r + i, frames - i);
+}
+
+__attribute__((target("sse2")))
+inline void deinterleave16Sse2(const void *interleaved, void *left, void *right, size_t frames) {
+    const int16_t *in = (const int16_t *) interleaved;
+    int16_t *l = (int16_t *) left;
+    int16_t *r = (int16_t *) right;
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (in + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (in + 2 * i + 8));
+        // Sign-extend each 16-bit half to 32 bits, then pack them back (never saturates)
+        __m128i even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                       _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        __m128i odd = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+        _mm_storeu_si128((__m128i *) (l + i), even);
+        _mm_storeu_si128((__m128i *) (r + i), odd);
+    }
+    deinterleaveScalar<int16_t>(in + 2 * i, l + i, r + i, frames - i);
+}
+
+__attribute__((target("sse2")))
+inline void deinterleave32Sse2(const void *interleaved, void *left, void *right, size_t frames) {
+    const float *in = (const float *) interleaved;
+    float *l = (float *) left;
+    float *r = (float *) right;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(in + 2 * i);
+        __m128 b = _mm_loadu_ps(in + 2 * i + 4);
+        _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    deinterleaveScalar<float>(in + 2 * i, l + i, r + i, frames - i);
+}
+
+// The AVX2 pack/shuffle instructions work per 128-bit lane, the 64-bit permute restores the order
+__attribute__((target("avx2")))
+inline void deinterleave8Avx2(const void *interleaved, void *left, void *right, size_t frames) {
+    const uint8_t *in = (const uint8_t *) interleaved;
+    uint8_t *l = (uint8_t *) left;
+    uint8_t *r = (uint8_t *) right;
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    size_t i = 0;
+    for (; i + 32 <= frames; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (in + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (in + 2 * i + 32));
+        __m256i even = _mm256_packus_epi16(_mm256_and_si256(a, lowBytes), _mm256_and_si256(b, lowBytes));
+        __m256i odd = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *) (l + i), _mm256_permute4x64_epi64(even, 0xD8));
+        _mm256_storeu_si256((__m256i *) (r + i), _mm256_permute4x64_epi64(odd, 0xD8));
+    }
+    deinterleave8Sse2(in + 2 * i, l + i, r + i, frames - i);
+}
+
+__attribute__((target("avx2")))
+inline void deinterleave16Avx2(const void *interleaved, void *left, void *right, size_t frames) {
+    const int16_t *in = (const int16_t *) interleaved;
+    int16_t *l = (int16_t *) left;
+    int16_t *r = (int16_t *) right;
+    size_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (in + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (in + 2 * i + 16));
+        __m256i even = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16),
+                                          _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+        __m256i odd = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+        _mm256_storeu_si256((__m256i *) (l + i), _mm256_permute4x64_epi64(even, 0xD8));
+        _mm256_storeu_si256((__m256i *) (r + i), _mm256_permute4x64_epi64(odd, 0xD8));
+    }
+    deinterleave16Sse2(in + 2 * i, l + i, r + i, frames - i);
+}
+
+__attribute__((target("avx2")))
+inline void deinterleave32Avx2(const void *interleaved, void *left, void *right, size_t frames) {
+    const float *in = (const float *) interleaved;
+    float *l = (float *) left;
+    float *r = (float *) right;
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256 a = _mm256_loadu_ps(in + 2 * i);
+        __m256 b = _mm256_loadu_ps(in + 2 * i + 8);
+        __m256 even = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 odd = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm256_storeu_ps(l + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even), 0xD8)));
+        _mm256_storeu_ps(r + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(odd), 0xD8)));
+    }
+    deinterleave32Sse2(in + 2 * i, l + i, r + i, frames - i);
+}
+#endif
+
+inline const DeinterleaveKernels &getScalarDeinterleaveKernels() {
+    static const DeinterleaveKernels kernels = {
+            "scalar", deinterleaveScalar<uint8_t>, deinterleaveScalar<int16_t>, deinterleaveScalar<float>
+    };
+    return kernels;
+}
+
+inline DeinterleaveKernels selectDeinterleaveKernels() {
+#if DEINTERLEAVE_NEON
+#if defined(__arm__)
+    if (!(getauxval(AT_HWCAP) & HWCAP_NEON))
+        return getScalarDeinterleaveKernels();
+#endif
+    return {"neon", deinterleave8Neon, deinterleave16Neon, deinterleave32Neon};
+#elif DEINTERLEAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {"avx2", deinterleave8Avx2, deinterleave16Avx2, deinterleave32Avx2};
+    if (__builtin_cpu_supports("sse2"))
+        return {"sse2", deinterleave8Sse2, deinterleave16Sse2, deinterleave32Sse2};
+    return getScalarDeinterleaveKernels();
+#else
+    return getScalarDeinterleaveKernels();
+#endif
+}
+
+// Kernels for the current CPU, selected on first use
+inline const DeinterleaveKernels &getDeinterleaveKernels() {
+    static const DeinterleaveKernels kernels = selectDeinterleaveKernels();
+    return kernels;
+}
+
+template<typename T>
+inline void deinterleaveStereo(const T *interleaved, T *left, T *right, size_t frames) {
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4, "Unsupported sample size");
+    const DeinterleaveKernels &kernels = getDeinterleaveKernels();
+    if (sizeof(T) == 1)
+        kernels.split8(interleaved, left, right, frames);
+    else if (sizeof(T) == 2)
+        kernels.split16(interleaved, left, right, frames);
+    else
+        kernels.split32(interleaved, left, right, frames);
+}
+
+#endif //INC_8DMUSICPLAYER_DEINTERLEAVE_H
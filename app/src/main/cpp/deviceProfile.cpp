@@ -0,0 +1,92 @@
+#include "deviceProfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "logSink.h"
+#define C_DEVICE_PROFILE "C++ Device Profile"
+
+static const DeviceProfileConfig DEVICE_PROFILES[] = {
+        {"default", 0, 0, 0, 0, 0, nullptr, nullptr, 0.0f},
+        // 5ms mixer updates at the usual native rate of Android outputs, so the output isn't resampled
+        {"low-latency", 48000, 200, ALC_STEREO_HRTF_SOFT, 240, 2, "cubic", "full", 200.0f},
+        // 50ms updates, linear resampling and HRTF rendered through first-order ambisonics
+        {"battery-saver", 48000, 20, ALC_STEREO_HRTF_SOFT, 2400, 3, "linear", "ambi1", 20.0f},
+};
+
+const DeviceProfileConfig &getDeviceProfileConfig(DeviceProfile profile) {
+    int index = (int) profile;
+    if (index < 0 || index >= (int) (sizeof(DEVICE_PROFILES) / sizeof(DEVICE_PROFILES[0])))
+        index = 0;
+    return DEVICE_PROFILES[index];
+}
+
+void appendDeviceProfileAttributes(DeviceProfile profile, std::vector<ALCint> &attributes) {
+    const DeviceProfileConfig &config = getDeviceProfileConfig(profile);
+    if (config.frequency > 0) {
+        attributes.push_back(ALC_FREQUENCY);
+        attributes.push_back(config.frequency);
+    }
+    if (config.refresh > 0) {
+        attributes.push_back(ALC_REFRESH);
+        attributes.push_back(config.refresh);
+    }
+    if (config.outputMode != 0) {
+        attributes.push_back(ALC_OUTPUT_MODE_SOFT);
+        attributes.push_back(config.outputMode);
+    }
+}
+
+bool applyDeviceProfileConfig(DeviceProfile profile, const std::string &directory) {
+    const DeviceProfileConfig &config = getDeviceProfileConfig(profile);
+    std::string path = directory + "/alsoft-profile.conf";
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        logPrint(LogLevel::Error, C_DEVICE_PROFILE, "Could not write %s", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "# Written by the engine for the %s profile\n[general]\n", config.name);
+    if (config.frequency > 0) fprintf(file, "frequency = %d\n", config.frequency);
+    if (config.periodSize > 0) fprintf(file, "period_size = %d\n", config.periodSize);
+    if (config.periods > 0) fprintf(file, "periods = %d\n", config.periods);
+    if (config.resampler) fprintf(file, "resampler = %s\n", config.resampler);
+    if (config.hrtfMode) fprintf(file, "hrtf-mode = %s\n", config.hrtfMode);
+    bool written = fclose(file) == 0;
+
+    if (!written || setenv("ALSOFT_CONF", path.c_str(), 1) != 0) {
+        logPrint(LogLevel::Error, C_DEVICE_PROFILE, "Could not apply %s", path.c_str());
+        return false;
+    }
+    logPrint(LogLevel::Info, C_DEVICE_PROFILE, "OpenAL Soft config for the %s profile: %s",
+             config.name, path.c_str());
+    return true;
+}
+
+static int64_t readClockNs(clockid_t clock) {
+    timespec now = {};
+    clock_gettime(clock, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void PowerMeter::reset() {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    m_startWallNs = readClockNs(CLOCK_MONOTONIC);
+    m_startCpuNs = readClockNs(CLOCK_PROCESS_CPUTIME_ID);
+    m_startVoluntary = usage.ru_nvcsw;
+    m_startInvoluntary = usage.ru_nivcsw;
+}
+
+EnginePowerStats PowerMeter::read() const {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    EnginePowerStats stats = {};
+    stats.wallNs = (uint64_t) (readClockNs(CLOCK_MONOTONIC) - m_startWallNs);
+    stats.cpuNs = (uint64_t) (readClockNs(CLOCK_PROCESS_CPUTIME_ID) - m_startCpuNs);
+    stats.voluntarySwitches = (uint64_t) (usage.ru_nvcsw - m_startVoluntary);
+    stats.involuntarySwitches = (uint64_t) (usage.ru_nivcsw - m_startInvoluntary);
+    return stats;
+}
@@ -0,0 +1,77 @@
+#ifndef INC_8DMUSICPLAYER_DEVICEPROFILE_H
+#define INC_8DMUSICPLAYER_DEVICEPROFILE_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "AL/alc.h"
+#include "AL/alext.h"
+
+// Values shared with OpenAlAudioEngine.DEVICE_PROFILE_*
+enum class DeviceProfile : int32_t {
+    Default = 0,      // whatever OpenAL Soft and the device pick
+    LowLatency = 1,   // short periods and a fast control tick, for responsive motion
+    BatterySaver = 2, // long periods, few wakeups and cheaper resampling and HRTF rendering
+};
+
+/* How a profile sets up the output. The ALC attributes apply every time a
+ * context is created; the config overrides are OpenAL Soft options, which it
+ * only reads once per process, before the first device is opened.
+ */
+struct DeviceProfileConfig {
+    const char *name;
+    ALCint frequency;       // ALC_FREQUENCY, 0 leaves the device's own
+    ALCint refresh;         // ALC_REFRESH, mixer updates per second, 0 leaves the default
+    ALCint outputMode;      // ALC_OUTPUT_MODE_SOFT, 0 leaves the default
+    int periodSize;         // period_size in frames, 0 leaves the default
+    int periods;            // periods, 0 leaves the default
+    const char *resampler;  // resampler, nullptr leaves the default
+    const char *hrtfMode;   // hrtf-mode, nullptr leaves the default
+    float motionRateHz;     // control tick rate, 0 leaves the engine's
+};
+
+const DeviceProfileConfig &getDeviceProfileConfig(DeviceProfile profile);
+
+/* Appends the profile's context attributes to the list, without the
+ * terminating 0, so HRTF attributes can follow.
+ */
+void appendDeviceProfileAttributes(DeviceProfile profile, std::vector<ALCint> &attributes);
+
+/* Writes the profile's config overrides to alsoft-profile.conf in the
+ * directory and points ALSOFT_CONF at it. Only affects the process if called
+ * before OpenAL Soft is first used, returns false if the file can't be written.
+ */
+bool applyDeviceProfileConfig(DeviceProfile profile, const std::string &directory);
+
+// Cumulative since the engine was initialized, for comparing profiles
+struct EnginePowerStats {
+    uint64_t wallNs;
+    uint64_t cpuNs;                 // CPU time of the whole process
+    uint64_t voluntarySwitches;     // threads going to sleep, about one per wakeup
+    uint64_t involuntarySwitches;   // threads preempted
+    int32_t frequency;              // ALC_FREQUENCY the device ended up with
+    int32_t refresh;                // ALC_REFRESH the device ended up with
+};
+
+/* Process-wide CPU time and context switches, sampled at initialize() and
+ * diffed on every read. They count every thread of the app, so compare
+ * profiles with the rest of the app idle (screen off, no UI updates).
+ */
+class PowerMeter {
+private:
+    int64_t m_startWallNs;
+    int64_t m_startCpuNs;
+    int64_t m_startVoluntary;
+    int64_t m_startInvoluntary;
+
+public:
+    PowerMeter() : m_startWallNs(0), m_startCpuNs(0), m_startVoluntary(0), m_startInvoluntary(0) {}
+
+    void reset();
+
+    EnginePowerStats read() const;
+};
+
+#endif //INC_8DMUSICPLAYER_DEVICEPROFILE_H
@@ -0,0 +1,28 @@
+#ifndef INC_8DMUSICPLAYER_ENGINEEVENTS_H
+#define INC_8DMUSICPLAYER_ENGINEEVENTS_H
+
+#include <stdint.h>
+
+#include <functional>
+
+enum class CallbackEventType : uint8_t {
+    Finished,     // a sound played to its end
+    Loaded,       // value: 1 if the async load succeeded, 0 if not
+    Error,        // code: CallbackError
+    PositionTick, // value: playback position in seconds
+    Underrun,     // a stream ran dry and restarted
+    ExportProgress, // soundId: export ID, value: progress from 0 to 1
+    ExportFinished, // soundId: export ID, code: ExportResult
+};
+
+enum CallbackError : int32_t {
+    CALLBACK_ERROR_DECODE_FAILED = 1, // a stream failed to read or seek, playback may stop early
+};
+
+/* Receives the engine's events, from the control, loader, event loop and
+ * export threads. It must not block or call back into the engine, the JNI
+ * layer queues them for its callback thread.
+ */
+typedef std::function<void(CallbackEventType type, uint64_t soundId, int32_t code, float value)> EngineEventHandler;
+
+#endif //INC_8DMUSICPLAYER_ENGINEEVENTS_H
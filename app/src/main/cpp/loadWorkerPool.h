@@ -0,0 +1,86 @@
+#ifndef INC_8DMUSICPLAYER_LOADWORKERPOOL_H
+#define INC_8DMUSICPLAYER_LOADWORKERPOOL_H
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of threads that run sound loads (decode + buffer upload) off the
+ * caller's thread. The threads are only started on the first submitted task,
+ * and again on the first one after a shutdown().
+ */
+class LoadWorkerPool {
+private:
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::function<void()>> m_tasks;
+    size_t m_threadCount;
+    bool m_running;
+    uint64_t m_generation; // threads of an older generation exit, even if the pool was started again
+
+public:
+    explicit LoadWorkerPool(size_t threadCount) : m_threadCount(threadCount), m_running(false), m_generation(0) {}
+
+    ~LoadWorkerPool() {
+        shutdown();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+            startLocked();
+        }
+        m_cv.notify_one();
+    }
+
+    // Drops the queued tasks and waits for the running ones to finish
+    void shutdown() {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+            m_tasks.clear();
+            threads.swap(m_threads);
+        }
+        m_cv.notify_all();
+        for (std::thread &thread: threads) {
+            if (thread.joinable())
+                thread.join();
+        }
+    }
+
+private:
+    // Does nothing while the threads are running
+    void startLocked() {
+        if (m_running) return;
+        m_running = true;
+        uint64_t generation = ++m_generation;
+        for (size_t i = 0; i < m_threadCount; i++)
+            m_threads.emplace_back(&LoadWorkerPool::run, this, generation);
+    }
+
+    void run(uint64_t generation) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            auto stopped = [this, generation] { return !m_running || m_generation != generation; };
+            m_cv.wait(lock, [this, &stopped] { return stopped() || !m_tasks.empty(); });
+            if (stopped()) return;
+
+            std::function<void()> task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_LOADWORKERPOOL_H
@@ -0,0 +1,31 @@
+#include "logSink.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <atomic>
+
+// Longer messages are truncated
+constexpr size_t LOG_MESSAGE_MAX = 1024;
+
+static void logToStderr(LogLevel level, const char *tag, const char *message) {
+    static const char LEVEL_NAMES[] = "??VDIWE";
+    int index = (int) level;
+    char name = (index >= 0 && index < (int) sizeof(LEVEL_NAMES) - 1) ? LEVEL_NAMES[index] : '?';
+    fprintf(stderr, "%c/%s: %s\n", name, tag, message);
+}
+
+static std::atomic<LogSink> g_logSink(logToStderr);
+
+void setLogSink(LogSink sink) {
+    g_logSink = sink ? sink : logToStderr;
+}
+
+void logPrint(LogLevel level, const char *tag, const char *format, ...) {
+    char message[LOG_MESSAGE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    g_logSink.load()(level, tag, message);
+}
@@ -0,0 +1,24 @@
+#ifndef INC_8DMUSICPLAYER_LOGSINK_H
+#define INC_8DMUSICPLAYER_LOGSINK_H
+
+// Same order and values as android_LogPriority, so sinks can pass them on as they are
+enum class LogLevel : int {
+    Verbose = 2,
+    Debug = 3,
+    Info = 4,
+    Warn = 5,
+    Error = 6,
+};
+
+typedef void (*LogSink)(LogLevel level, const char *tag, const char *message);
+
+/* Where the engine's log messages go, stderr until a sink is set. The JNI
+ * layer sends them to logcat, desktop builds can keep stderr or capture them.
+ * Safe to call from any thread, nullptr restores stderr.
+ */
+void setLogSink(LogSink sink);
+
+// printf-style, formatted on the caller's stack and handed to the sink
+void logPrint(LogLevel level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#endif //INC_8DMUSICPLAYER_LOGSINK_H
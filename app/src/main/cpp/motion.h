@@ -0,0 +1,302 @@
+#ifndef INC_8DMUSICPLAYER_MOTION_H
+#define INC_8DMUSICPLAYER_MOTION_H
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr float MOTION_DEFAULT_RATE_HZ = 120.0f;
+constexpr float MOTION_MIN_RATE_HZ = 10.0f;
+constexpr float MOTION_MAX_RATE_HZ = 1000.0f;
+
+// Position around the listener, as taken by setPosition (angle in radians)
+struct MotionPose {
+    float angle;
+    float radius;
+    float height;
+};
+
+enum class TrajectoryType {
+    Static,      // stays at the base pose, only useful with a wobble
+    Orbit,       // full turns around the listener at a constant rate
+    PingPong,    // sweeps back and forth around the base angle
+    FigureEight, // azimuth and elevation trace an eight on the sphere around the listener
+    Keyframes,   // path through keyframes, eased between them
+};
+
+enum class Easing {
+    Linear,
+    EaseIn,
+    EaseOut,
+    EaseInOut,
+    Step,        // holds the previous keyframe until this one is reached
+};
+
+struct MotionKeyframe {
+    float time;          // seconds since the start of the trajectory
+    MotionPose pose;
+    Easing easing;       // used on the way from the previous keyframe to this one
+};
+
+/* Parametric path of a sound, evaluated at a time relative to its start. All
+ * rates are in cycles per second (negative orbits turn the other way), any
+ * trajectory can add an elevation wobble on top.
+ */
+struct Trajectory {
+    TrajectoryType type = TrajectoryType::Static;
+    MotionPose base = {0.0f, 1.0f, 0.0f};
+    float rate = 0.0f;
+    float extent = 0.0f;        // PingPong and FigureEight, azimuth amplitude in radians
+    float heightExtent = 0.0f;  // FigureEight, elevation amplitude
+    float wobbleDepth = 0.0f;
+    float wobbleRate = 0.0f;
+    std::vector<MotionKeyframe> keyframes; // sorted by time
+    bool loop = false;
+
+    MotionPose evaluate(double time) const {
+        MotionPose pose = base;
+        double cycles = time * rate;
+
+        switch (type) {
+            case TrajectoryType::Static:
+                break;
+            case TrajectoryType::Orbit:
+                pose.angle = base.angle + (float) (2.0 * M_PI * fractionalPart(cycles));
+                break;
+            case TrajectoryType::PingPong: {
+                // Triangle wave, smoothed so the sweep eases in and out of the turning points
+                double phase = fractionalPart(cycles);
+                double leg = phase < 0.5 ? phase * 2.0 : 2.0 - phase * 2.0;
+                pose.angle = base.angle + extent * (float) (2.0 * applyEasing(Easing::EaseInOut, leg) - 1.0);
+                break;
+            }
+            case TrajectoryType::FigureEight: {
+                double phase = 2.0 * M_PI * fractionalPart(cycles);
+                pose.angle = base.angle + extent * (float) sin(phase);
+                pose.height = base.height + heightExtent * (float) sin(2.0 * phase);
+                break;
+            }
+            case TrajectoryType::Keyframes:
+                pose = evaluateKeyframes(time);
+                break;
+        }
+
+        if (wobbleDepth != 0.0f)
+            pose.height += wobbleDepth * (float) sin(2.0 * M_PI * fractionalPart(time * wobbleRate));
+        return pose;
+    }
+
+    // True if the pose can still change, a finished keyframe path stays put
+    bool isMoving(double time) const {
+        if (wobbleDepth != 0.0f && wobbleRate != 0.0f) return true;
+        if (type == TrajectoryType::Keyframes)
+            return loop || keyframes.empty() || time < keyframes.back().time;
+        return type != TrajectoryType::Static && rate != 0.0f;
+    }
+
+    static double applyEasing(Easing easing, double t) {
+        switch (easing) {
+            case Easing::Linear:
+                return t;
+            case Easing::EaseIn:
+                return t * t * t;
+            case Easing::EaseOut: {
+                double inverse = 1.0 - t;
+                return 1.0 - inverse * inverse * inverse;
+            }
+            case Easing::EaseInOut:
+                return t * t * (3.0 - 2.0 * t);
+            case Easing::Step:
+                return t < 1.0 ? 0.0 : 1.0;
+        }
+        return t;
+    }
+
+private:
+    static double fractionalPart(double value) {
+        return value - floor(value);
+    }
+
+    MotionPose evaluateKeyframes(double time) const {
+        if (keyframes.empty()) return base;
+
+        double duration = keyframes.back().time;
+        if (loop && duration > 0.0)
+            time = fmod(time, duration) + (time < 0.0 ? duration : 0.0);
+        if (time <= keyframes.front().time) return keyframes.front().pose;
+        if (time >= duration) return keyframes.back().pose;
+
+        auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+                                     [](double t, const MotionKeyframe &keyframe) { return t < keyframe.time; });
+        const MotionKeyframe &from = *(next - 1);
+        const MotionKeyframe &to = *next;
+
+        double span = to.time - from.time;
+        float mix = (float) applyEasing(to.easing, span > 0.0 ? (time - from.time) / span : 1.0);
+        return {from.pose.angle + (to.pose.angle - from.pose.angle) * mix,
+                from.pose.radius + (to.pose.radius - from.pose.radius) * mix,
+                from.pose.height + (to.pose.height - from.pose.height) * mix};
+    }
+};
+
+/* A sound's trajectory, running on its playback clock from the time it was
+ * set. Changing only the wobble keeps that origin, so the rest of the motion
+ * carries on from where it is.
+ */
+class SoundMotion {
+private:
+    std::unique_ptr<Trajectory> m_trajectory;
+    double m_start;
+
+public:
+    SoundMotion() : m_start(0.0) {}
+
+    void set(std::unique_ptr<Trajectory> trajectory, double now) {
+        m_start = now;
+        m_trajectory = std::move(trajectory);
+    }
+
+    // Without a trajectory, starts a static one at the pose to carry the wobble
+    void setWobble(float depth, float cyclesPerSecond, const MotionPose &pose, double now) {
+        if (!m_trajectory) {
+            auto trajectory = std::make_unique<Trajectory>();
+            trajectory->base = pose;
+            set(std::move(trajectory), now);
+        }
+        m_trajectory->wobbleDepth = depth;
+        m_trajectory->wobbleRate = cyclesPerSecond;
+    }
+
+    void clear() { m_trajectory.reset(); }
+
+    const Trajectory *get() const { return m_trajectory.get(); }
+
+    MotionPose evaluate(double now) const {
+        return m_trajectory->evaluate(now - m_start);
+    }
+
+    bool isMoving(double now) const {
+        return m_trajectory->isMoving(now - m_start);
+    }
+};
+
+/* Thread that calls the tick function at a fixed rate while it reports
+ * something is moving, and sleeps until wake() otherwise. Ticks are scheduled
+ * on absolute deadlines, so the rate doesn't drift with the tick's own cost;
+ * wake() also brings the next tick forward, for work that shouldn't wait.
+ */
+class MotionTimer {
+private:
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::function<bool()> m_tick;
+    std::chrono::nanoseconds m_period;
+    std::chrono::steady_clock::time_point m_alarm;
+    bool m_running;
+    bool m_awake;
+
+public:
+    MotionTimer() : m_period(periodFromRate(MOTION_DEFAULT_RATE_HZ)),
+                    m_alarm(std::chrono::steady_clock::time_point::max()), m_running(false), m_awake(false) {}
+
+    ~MotionTimer() {
+        stop();
+    }
+
+    MotionTimer(const MotionTimer &) = delete;
+    MotionTimer &operator=(const MotionTimer &) = delete;
+
+    // The tick returns false once nothing moves anymore
+    void start(std::function<bool()> tick) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_running) return;
+        m_tick = std::move(tick);
+        m_running = true;
+        m_thread = std::thread(&MotionTimer::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_running) return;
+            m_running = false;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    // Clamped to [MOTION_MIN_RATE_HZ, MOTION_MAX_RATE_HZ]
+    void setRate(float hz) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_period = periodFromRate(hz);
+    }
+
+    // Ticks as soon as possible, and resumes ticking if the thread was sleeping
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_awake = true;
+        }
+        m_cv.notify_all();
+    }
+
+    /* Ticks at the given time even if nothing moves, the earliest alarm wins.
+     * Alarms are cleared before every tick, so the tick sets them again as needed.
+     */
+    void wakeAt(std::chrono::steady_clock::time_point time) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_alarm = std::min(m_alarm, time);
+        }
+        m_cv.notify_all();
+    }
+
+private:
+    static std::chrono::nanoseconds periodFromRate(float hz) {
+        hz = std::min(MOTION_MAX_RATE_HZ, std::max(MOTION_MIN_RATE_HZ, hz));
+        return std::chrono::nanoseconds((long long) (1e9 / hz));
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto deadline = std::chrono::steady_clock::now();
+        while (m_running) {
+            m_awake = false;
+            m_alarm = std::chrono::steady_clock::time_point::max();
+            lock.unlock();
+            bool moving = m_tick();
+            lock.lock();
+
+            if (!moving) {
+                auto woken = [this] {
+                    return !m_running || m_awake || std::chrono::steady_clock::now() >= m_alarm;
+                };
+                // Re-read on every wakeup, wakeAt() may move the alarm while the thread sleeps
+                while (!woken()) {
+                    if (m_alarm == std::chrono::steady_clock::time_point::max())
+                        m_cv.wait(lock);
+                    else
+                        m_cv.wait_until(lock, m_alarm);
+                }
+                deadline = std::chrono::steady_clock::now();
+                continue;
+            }
+
+            deadline += m_period;
+            auto now = std::chrono::steady_clock::now();
+            if (deadline < now) deadline = now; // fell behind, don't try to catch up with a burst
+            m_cv.wait_until(lock, deadline, [this] { return !m_running || m_awake; });
+        }
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_MOTION_H
@@ -0,0 +1,84 @@
+#ifndef INC_8DMUSICPLAYER_MPSCRING_H
+#define INC_8DMUSICPLAYER_MPSCRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <utility>
+
+/* Bounded lock-free queue for many producers and one consumer. Each cell
+ * carries a sequence number telling whether it is free for the producer of a
+ * given position or holds a value for the consumer, so producers only race on
+ * one compare-exchange of the write position and never wait for each other or
+ * for the consumer. Capacity must be a power of two.
+ */
+template<typename T, size_t Capacity>
+class MpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Separate cache lines, producers hammer the write position
+    alignas(64) Cell m_cells[Capacity];
+    alignas(64) std::atomic<size_t> m_writePosition;
+    alignas(64) size_t m_readPosition;
+
+public:
+    MpscRing() : m_writePosition(0), m_readPosition(0) {
+        for (size_t i = 0; i < Capacity; i++)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRing(const MpscRing &) = delete;
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    /* Any thread, moves the value in. Returns false without waiting if the
+     * ring is full, the value is then left as it was.
+     */
+    bool push(T &value) {
+        size_t position = m_writePosition.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &m_cells[position & (Capacity - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+            if (difference == 0) {
+                if (m_writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            } else if (difference < 0) {
+                return false; // the consumer hasn't freed this cell yet
+            } else {
+                position = m_writePosition.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only
+    bool pop(T &value) {
+        Cell *cell = &m_cells[m_readPosition & (Capacity - 1)];
+        if (cell->sequence.load(std::memory_order_acquire) != m_readPosition + 1) return false;
+
+        value = std::move(cell->value);
+        cell->sequence.store(m_readPosition + Capacity, std::memory_order_release);
+        m_readPosition++;
+        return true;
+    }
+
+    // Consumer thread only
+    bool empty() const {
+        const Cell &cell = m_cells[m_readPosition & (Capacity - 1)];
+        return cell.sequence.load(std::memory_order_acquire) != m_readPosition + 1;
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+};
+
+#endif //INC_8DMUSICPLAYER_MPSCRING_H
@@ -0,0 +1,320 @@
+#ifndef INC_8DMUSICPLAYER_OFFLINERENDERER_H
+#define INC_8DMUSICPLAYER_OFFLINERENDERER_H
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AL/al.h"
+#include "AL/alc.h"
+#include "AL/alext.h"
+#include "sndfile.h"
+
+#include "motion.h"
+#include "openalInitializer.h"
+#include "soundLoader.h"
+#include "utils.h"
+
+#include "logSink.h"
+#define C_OFFLINE_RENDERER "C++ Offline Renderer"
+
+// Output rate of every export, Opus only supports 48kHz anyway
+constexpr ALCint EXPORT_SAMPLE_RATE = 48000;
+// Frames mixed per step, the trajectory moves between steps (about 190 times a second)
+constexpr ALCsizei EXPORT_BLOCK_FRAMES = 256;
+// Progress is reported every time it grows by this much
+constexpr float EXPORT_PROGRESS_STEP = 0.01f;
+
+enum class ExportFormat : int32_t {
+    Wav = 0,     // 16-bit PCM
+    Flac = 1,    // 16-bit
+    Opus = 2,    // Ogg Opus
+    Vorbis = 3,  // Ogg Vorbis
+    Mp3 = 4,
+};
+
+enum ExportResult : int32_t {
+    EXPORT_OK = 0,
+    EXPORT_CANCELLED = 1,
+    EXPORT_ERROR_DEVICE = 2,  // no loopback device, or it rejected the format
+    EXPORT_ERROR_LOAD = 3,    // the track couldn't be decoded
+    EXPORT_ERROR_OUTPUT = 4,  // the output file couldn't be created or written
+};
+
+// Everything an export needs, copied from the engine when it starts
+struct ExportJob {
+    SoundSource source;
+    std::string outputPath;
+    ExportFormat format = ExportFormat::Wav;
+    Trajectory trajectory;   // runs from the start of the track
+    float stereoAngle = 0.0f;
+    std::string hrtfName;
+    ALfloat listenerPosition[3] = {0.0f, 0.0f, 0.0f};
+    ALfloat listenerOrientation[6] = {0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f};
+};
+
+/* Renders a track with its trajectory to a file through an ALC_SOFT_loopback
+ * device, on a thread of its own. The loopback device mixes only when asked,
+ * so the export runs as fast as the CPU allows, with the same HRTF and
+ * positions as live playback. The thread's AL calls go to the loopback
+ * context (ALC_EXT_thread_local_context), the engine keeps playing meanwhile.
+ * One export runs at a time.
+ */
+class OfflineRenderer {
+public:
+    typedef std::function<void(uint64_t exportId, float progress)> ProgressHandler;
+    typedef std::function<void(uint64_t exportId, ExportResult result)> FinishedHandler;
+
+private:
+    std::thread m_thread;
+    std::mutex m_mutex;
+    bool m_running;
+    uint64_t m_exportId;    // of the running or last export
+    std::atomic<bool> m_cancelled;
+    std::atomic<float> m_progress;
+    ProgressHandler m_onProgress;
+    FinishedHandler m_onFinished;
+
+public:
+    OfflineRenderer() : m_running(false), m_exportId(0), m_cancelled(false), m_progress(0.0f) {}
+
+    ~OfflineRenderer() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cancelled = true;
+        }
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    OfflineRenderer(const OfflineRenderer &) = delete;
+    OfflineRenderer &operator=(const OfflineRenderer &) = delete;
+
+    // Called on the export thread
+    void setHandlers(ProgressHandler onProgress, FinishedHandler onFinished) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_onProgress = std::move(onProgress);
+        m_onFinished = std::move(onFinished);
+    }
+
+    // Returns the export's ID, 0 if another export is still running
+    uint64_t start(ExportJob job) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_running) return 0;
+        if (m_thread.joinable())
+            m_thread.join();
+
+        m_running = true;
+        m_cancelled = false;
+        m_progress = 0.0f;
+        uint64_t exportId = ++m_exportId;
+        m_thread = std::thread(&OfflineRenderer::run, this, exportId, std::move(job));
+        return exportId;
+    }
+
+    // The partial file is deleted, returns false if the export isn't running
+    bool cancel(uint64_t exportId) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running || exportId != m_exportId) return false;
+        m_cancelled = true;
+        return true;
+    }
+
+    // Progress of the running or last export, from 0 to 1
+    float getProgress() const { return m_progress; }
+
+private:
+    void run(uint64_t exportId, ExportJob job) {
+        auto started = std::chrono::steady_clock::now();
+        float renderedSeconds = 0.0f;
+        ExportResult result = render(exportId, job, renderedSeconds);
+
+        if (result != EXPORT_OK) {
+            unlink(job.outputPath.c_str());
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        logPrint(LogLevel::Info, C_OFFLINE_RENDERER,
+                 "Export %" PRIu64 " of %s finished with %d: %.1fs of audio in %.1fs (%.1fx real time)",
+                 exportId, job.source.describe().c_str(), (int) result, renderedSeconds, elapsed,
+                 elapsed > 0.0 ? renderedSeconds / elapsed : 0.0);
+
+        FinishedHandler onFinished;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+            onFinished = m_onFinished;
+        }
+        if (onFinished) onFinished(exportId, result);
+    }
+
+    void reportProgress(uint64_t exportId, float progress) {
+        m_progress = progress;
+        ProgressHandler onProgress;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            onProgress = m_onProgress;
+        }
+        if (onProgress) onProgress(exportId, progress);
+    }
+
+    static int getSndfileFormat(ExportFormat format) {
+        switch (format) {
+            case ExportFormat::Wav:
+                return SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+            case ExportFormat::Flac:
+                return SF_FORMAT_FLAC | SF_FORMAT_PCM_16;
+            case ExportFormat::Opus:
+                return SF_FORMAT_OGG | SF_FORMAT_OPUS;
+            case ExportFormat::Vorbis:
+                return SF_FORMAT_OGG | SF_FORMAT_VORBIS;
+            case ExportFormat::Mp3:
+                return SF_FORMAT_MPEG | SF_FORMAT_MPEG_LAYER_III;
+        }
+        return 0;
+    }
+
+    ExportResult render(uint64_t exportId, const ExportJob &job, float &renderedSeconds) {
+        auto loopbackOpenDevice = reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(
+                alcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT"));
+        auto isRenderFormatSupported = reinterpret_cast<LPALCISRENDERFORMATSUPPORTEDSOFT>(
+                alcGetProcAddress(nullptr, "alcIsRenderFormatSupportedSOFT"));
+        auto renderSamples = reinterpret_cast<LPALCRENDERSAMPLESSOFT>(
+                alcGetProcAddress(nullptr, "alcRenderSamplesSOFT"));
+        auto setThreadContext = reinterpret_cast<PFNALCSETTHREADCONTEXTPROC>(
+                alcGetProcAddress(nullptr, "alcSetThreadContext"));
+        if (!loopbackOpenDevice || !isRenderFormatSupported || !renderSamples || !setThreadContext) {
+            logPrint(LogLevel::Error, C_OFFLINE_RENDERER, "Loopback rendering is not supported");
+            return EXPORT_ERROR_DEVICE;
+        }
+
+        ALCdevice *device = loopbackOpenDevice(nullptr);
+        if (!device || !isRenderFormatSupported(device, EXPORT_SAMPLE_RATE, ALC_STEREO_SOFT, ALC_FLOAT_SOFT)) {
+            logPrint(LogLevel::Error, C_OFFLINE_RENDERER, "Failed to open a float stereo loopback device");
+            if (device) alcCloseDevice(device);
+            return EXPORT_ERROR_DEVICE;
+        }
+
+        ALCint hrtfIndex = findHRTF(device, job.hrtfName.empty() ? nullptr : job.hrtfName.c_str());
+        std::vector<ALCint> attributes = {ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+                                          ALC_FORMAT_TYPE_SOFT, ALC_FLOAT_SOFT,
+                                          ALC_FREQUENCY, EXPORT_SAMPLE_RATE,
+                                          ALC_HRTF_SOFT, ALC_TRUE};
+        if (hrtfIndex >= 0) {
+            attributes.push_back(ALC_HRTF_ID_SOFT);
+            attributes.push_back(hrtfIndex);
+        }
+        attributes.push_back(0);
+
+        ALCcontext *context = alcCreateContext(device, attributes.data());
+        if (!context || !setThreadContext(context)) {
+            logPrint(LogLevel::Error, C_OFFLINE_RENDERER, "Failed to create the loopback context");
+            if (context) alcDestroyContext(context);
+            alcCloseDevice(device);
+            return EXPORT_ERROR_DEVICE;
+        }
+
+        ExportResult result = renderWithContext(exportId, job, device, renderSamples, renderedSeconds);
+
+        setThreadContext(nullptr);
+        alcDestroyContext(context);
+        alcCloseDevice(device);
+        return result;
+    }
+
+    // Runs with the loopback context current on this thread
+    ExportResult renderWithContext(uint64_t exportId, const ExportJob &job, ALCdevice *device,
+                                   LPALCRENDERSAMPLESSOFT renderSamples, float &renderedSeconds) {
+        alListenerfv(AL_POSITION, job.listenerPosition);
+        alListenerfv(AL_ORIENTATION, job.listenerOrientation);
+
+        // Decoded into buffers of the loopback device, the engine's caches belong to another device
+        SoundLoadOptions loadOptions;
+        loadOptions.cancelled = &m_cancelled;
+        ALuint_p buffers = LoadSound(job.source, loadOptions);
+        if (!buffers.first) {
+            return m_cancelled ? EXPORT_CANCELLED : EXPORT_ERROR_LOAD;
+        }
+        ALuint bufferIds[2] = {buffers.first, buffers.second};
+        ALsizei channels = buffers.second != AL_NONE ? 2 : 1;
+        float duration = getDurationSeconds(buffers.first);
+
+        ALuint sources[2] = {AL_NONE, AL_NONE};
+        alGenSources(channels, sources);
+        for (ALsizei i = 0; i < channels; i++) {
+            alSourcei(sources[i], AL_SOURCE_RELATIVE, AL_TRUE);
+            alSourcei(sources[i], AL_BUFFER, (ALint) bufferIds[i]);
+        }
+
+        ExportResult result = EXPORT_OK;
+        SF_INFO outputInfo = {};
+        outputInfo.samplerate = EXPORT_SAMPLE_RATE;
+        outputInfo.channels = 2;
+        outputInfo.format = getSndfileFormat(job.format);
+        SNDFILE *output = sf_format_check(&outputInfo) ? sf_open(job.outputPath.c_str(), SFM_WRITE, &outputInfo)
+                                                        : nullptr;
+        if (!output) {
+            logPrint(LogLevel::Error, C_OFFLINE_RENDERER, "Failed to create %s: %s",
+                     job.outputPath.c_str(), sf_strerror(nullptr));
+            result = EXPORT_ERROR_OUTPUT;
+        } else {
+            // The mix is float, keep peaks from wrapping around in integer formats
+            sf_command(output, SFC_SET_CLIPPING, nullptr, SF_TRUE);
+            result = renderFrames(exportId, job, device, renderSamples, sources, channels, duration, output,
+                                  renderedSeconds);
+            if (sf_close(output) != 0 && result == EXPORT_OK) {
+                result = EXPORT_ERROR_OUTPUT;
+            }
+        }
+
+        alDeleteSources(channels, sources);
+        alDeleteBuffers(channels, bufferIds);
+        return result;
+    }
+
+    ExportResult renderFrames(uint64_t exportId, const ExportJob &job, ALCdevice *device,
+                              LPALCRENDERSAMPLESSOFT renderSamples, const ALuint *sources, ALsizei channels,
+                              float duration, SNDFILE *output, float &renderedSeconds) {
+        std::vector<float> block(EXPORT_BLOCK_FRAMES * 2);
+        int64_t totalFrames = (int64_t) ceil(duration * EXPORT_SAMPLE_RATE);
+        int64_t renderedFrames = 0;
+        float reportedProgress = 0.0f;
+
+        MotionPose pose = job.trajectory.evaluate(0.0);
+        setChannelPositions(sources, channels, pose.angle, pose.radius, pose.height, job.stereoAngle);
+        alSourcePlayv(channels, sources);
+
+        while (renderedFrames < totalFrames) {
+            if (m_cancelled) return EXPORT_CANCELLED;
+
+            pose = job.trajectory.evaluate((double) renderedFrames / EXPORT_SAMPLE_RATE);
+            setChannelPositions(sources, channels, pose.angle, pose.radius, pose.height, job.stereoAngle);
+
+            ALCsizei frames = (ALCsizei) std::min<int64_t>(EXPORT_BLOCK_FRAMES, totalFrames - renderedFrames);
+            renderSamples(device, block.data(), frames);
+            if (sf_writef_float(output, block.data(), frames) != frames) {
+                logPrint(LogLevel::Error, C_OFFLINE_RENDERER, "Failed to write %s: %s",
+                         job.outputPath.c_str(), sf_strerror(output));
+                return EXPORT_ERROR_OUTPUT;
+            }
+            renderedFrames += frames;
+            renderedSeconds = (float) renderedFrames / EXPORT_SAMPLE_RATE;
+
+            float progress = (float) renderedFrames / (float) totalFrames;
+            if (progress - reportedProgress >= EXPORT_PROGRESS_STEP || renderedFrames == totalFrames) {
+                reportedProgress = progress;
+                reportProgress(exportId, progress);
+            }
+        }
+        return EXPORT_OK;
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_OFFLINERENDERER_H
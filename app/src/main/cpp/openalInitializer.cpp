@@ -0,0 +1,77 @@
+//
+// Created by PauMB on 08/09/2024.
+//
+
+#include "openalInitializer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "logSink.h"
+
+#define AL_INITIALIZER "C++ OpenAL Initializer"
+
+void loadHRTF(ALCdevice* device, const char* hrtfname) {
+#define FUNCTION_CAST(T, ptr) reinterpret_cast<T>(ptr)
+#define LOAD_PROC(d, T, x)  T x = FUNCTION_CAST(T, alcGetProcAddress((d), #x))
+    LOAD_PROC(device, LPALCRESETDEVICESOFT, alcResetDeviceSOFT);
+#undef LOAD_PROC
+    /* Look up the requested HRTF, and reset the device using it. */
+    ALint  num_hrtf;
+    alcGetIntegerv(device, ALC_NUM_HRTF_SPECIFIERS_SOFT, 1, &num_hrtf);
+    if(!num_hrtf)
+        logPrint(LogLevel::Verbose, AL_INITIALIZER, "No HRTFs found\n");
+    else
+    {
+        ALCint attr[5];
+        ALCint index = findHRTF(device, hrtfname);
+        ALCint i = 0;
+
+        attr[i++] = ALC_HRTF_SOFT;
+        attr[i++] = ALC_TRUE;
+        if(index == -1)
+        {
+            if(hrtfname)
+                logPrint(LogLevel::Verbose, AL_INITIALIZER, "HRTF \"%s\" not found\n", hrtfname);
+            logPrint(LogLevel::Verbose, AL_INITIALIZER, "Using default HRTF...\n");
+        }
+        else
+        {
+            logPrint(LogLevel::Verbose, AL_INITIALIZER, "Selecting HRTF %d...\n", index);
+            attr[i++] = ALC_HRTF_ID_SOFT;
+            attr[i++] = index;
+        }
+        attr[i] = 0;
+
+        if(!alcResetDeviceSOFT(device, attr))
+            logPrint(LogLevel::Verbose, AL_INITIALIZER, "Failed to reset device: %s\n", alcGetString(device, alcGetError(device)));
+    }
+
+    /* Check if HRTF is enabled, and show which is being used. */
+    ALint hrtf_state;
+    alcGetIntegerv(device, ALC_HRTF_SOFT, 1, &hrtf_state);
+    if(!hrtf_state)
+        logPrint(LogLevel::Verbose, AL_INITIALIZER, "HRTF not enabled!\n");
+    else
+    {
+        const ALchar *name = alcGetString(device, ALC_HRTF_SPECIFIER_SOFT);
+        logPrint(LogLevel::Verbose, AL_INITIALIZER, "HRTF enabled, using %s\n", name);
+    }
+    fflush(stdout);
+}
+
+ALCint findHRTF(ALCdevice* device, const char* hrtfname) {
+    auto getStringi = reinterpret_cast<LPALCGETSTRINGISOFT>(alcGetProcAddress(device, "alcGetStringiSOFT"));
+    if(!getStringi || !hrtfname)
+        return -1;
+
+    ALCint num_hrtf = 0;
+    alcGetIntegerv(device, ALC_NUM_HRTF_SPECIFIERS_SOFT, 1, &num_hrtf);
+    for(ALCint i = 0;i < num_hrtf;i++)
+    {
+        const ALCchar *name = getStringi(device, ALC_HRTF_SPECIFIER_SOFT, i);
+        if(name && strcmp(name, hrtfname) == 0)
+            return i;
+    }
+    return -1;
+}
@@ -1,594 +1,677 @@
 #include <string>
+#include <inttypes.h>
 #include <cmath>
-#include <unistd.h>
-#include <thread>
-#include <atomic>
-#include <map>
-#include <mutex>
 #include <memory>
-#include <random>
 
+#include <dlfcn.h>
 #include <jni.h>
-#include <AL/al.h>
-#include <AL/alc.h>
-#include <AL/alext.h>
 #include <android/log.h>
+#include <android/trace.h>
+
+#include "logSink.h"
+#include "trace.h"
 
 #define LOG_TAG "AudioEngine"
-#define LOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-
-#include "utils.h"
-#include "soundLoader.h"
-#include "openalInitializer.h"
-
-// Constants
-constexpr int SAMPLE_RATE = 44100;
-constexpr float INITIAL_STEREO_ANGLE = M_PI / 6.0f;
-constexpr ALfloat LISTENER_ORIENTATION[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f};
-
-// Type aliases
-using SoundId = std::string;
-using AlSourcePair = std::pair<ALuint, ALuint>;
-using AlBufferPair = std::pair<ALuint, ALuint>;
-
-// Forward declarations
-class AudioEngine;
-
-class SoundInstance;
-
-// Sound instance class
-class SoundInstance {
-private:
-    std::string m_filePath;
-    SoundId m_soundId;
-    AlSourcePair m_sources;
-    AlBufferPair m_buffers;
-    float m_duration;
-    std::atomic<bool> m_isPlaying;
-
-public:
-    SoundInstance(std::string filePath, SoundId soundId)
-            : m_filePath(std::move(filePath)), m_soundId(std::move(soundId)),
-              m_sources({AL_NONE, AL_NONE}), m_buffers({AL_NONE, AL_NONE}),
-              m_duration(0.0f), m_isPlaying(false) {}
-
-    ~SoundInstance() {
-        stop();
-    }
-
-    bool load() {
-        m_buffers = LoadSound(m_filePath.c_str());
-        if (!m_buffers.first) {
-            LOGE("Failed to load sound buffer for: %s", m_filePath.c_str());
-            return false;
-        }
+#define LOGV(...) logPrint(LogLevel::Verbose, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) logPrint(LogLevel::Debug, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) logPrint(LogLevel::Info, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) logPrint(LogLevel::Warn, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) logPrint(LogLevel::Error, LOG_TAG, __VA_ARGS__)
 
-        // Create first source
-        alGenSources(1, &m_sources.first);
-        setupSource(m_sources.first, m_buffers.first);
+#include "audioEngine.h"
+#include "callbackDispatcher.h"
 
-        // Create second source for stereo if we have a second buffer
-        if (m_buffers.second != AL_NONE) {
-            alGenSources(1, &m_sources.second);
-            setupSource(m_sources.second, m_buffers.second);
-        } else {
-            m_sources.second = AL_NONE;
-        }
+// JNI layer over the engine in audioEngine.cpp: converts the arguments, routes the
+// engine's events to the Kotlin callback and its log messages to logcat
 
-        m_duration = getDurationSeconds(m_buffers.first);
-        LOGD("Sound loaded successfully: %s (duration: %.2fs, stereo: %s)",
-             m_soundId.c_str(), m_duration,
-             (m_buffers.second != AL_NONE) ? "yes" : "no");
-        return true;
-    }
+static void logToLogcat(LogLevel level, const char *tag, const char *message) {
+    __android_log_write((int) level, tag, message);
+}
 
-    void play(const std::function<void()> &onFinished) {
-        if (m_isPlaying) return;
+// ATrace_setCounter is API 29, looked up at runtime so older devices still get the sections
+typedef void (*ATraceSetCounterFunc)(const char *counterName, int64_t counterValue);
 
-        m_isPlaying = true;
-        alSourcePlay(m_sources.first);
-        if (hasStereo()) {
-            alSourcePlay(m_sources.second);
-        }
+static ATraceSetCounterFunc getATraceSetCounter() {
+    static ATraceSetCounterFunc setCounter =
+            reinterpret_cast<ATraceSetCounterFunc>(dlsym(RTLD_DEFAULT, "ATrace_setCounter"));
+    return setCounter;
+}
 
-        // Start monitoring thread
-        std::thread monitorThread([this, onFinished]() {
-            ALint state;
-            do {
-                sleep(1);
-                alGetSourcei(m_sources.first, AL_SOURCE_STATE, &state);
-            } while (alGetError() == AL_NO_ERROR && state == AL_PLAYING && m_isPlaying);
+// Sections and counters show up in Perfetto and systrace captures with the app's atrace category
+static const TraceBackend ATRACE_BACKEND = {
+        [](const char *name) { ATrace_beginSection(name); },
+        []() { ATrace_endSection(); },
+        [](const char *name, int64_t value) {
+            ATraceSetCounterFunc setCounter = getATraceSetCounter();
+            if (setCounter) setCounter(name, value);
+        },
+};
 
-            if (m_isPlaying) {
-                onFinished();
-            }
-        });
-        monitorThread.detach();
+#define JNI_TRACE(name) TRACE_SCOPE("JNI " name)
 
-        LOGD("Started playing sound: %s", m_soundId.c_str());
-    }
+// Delivers the engine's events to Kotlin, declared first so it outlives the engine
+CallbackDispatcher g_callbacks;
 
-    void stop() {
-        m_isPlaying = false;
-
-        // Stop and delete sources
-        if (m_sources.first != AL_NONE) {
-            alSourceStop(m_sources.first);
-            alDeleteSources(1, &m_sources.first);
-            m_sources.first = AL_NONE;
-        }
+// Global audio engine instance
+std::unique_ptr<AudioEngine> g_audioEngine;
 
-        if (m_sources.second != AL_NONE) {
-            alSourceStop(m_sources.second);
-            alDeleteSources(1, &m_sources.second);
-            m_sources.second = AL_NONE;
-        }
+// JNI Functions
+extern "C" {
 
-        // Delete buffers
-        if (m_buffers.first != AL_NONE) {
-            alDeleteBuffers(1, &m_buffers.first);
-            m_buffers.first = AL_NONE;
-        }
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+    setLogSink(logToLogcat);
+    g_callbacks.start(vm);
+    g_audioEngine = std::make_unique<AudioEngine>();
+    g_audioEngine->setEventHandler([](CallbackEventType type, uint64_t soundId, int32_t code, float value) {
+        g_callbacks.post(type, soundId, code, value);
+    });
+    return JNI_VERSION_1_6;
+}
 
-        if (m_buffers.second != AL_NONE) {
-            alDeleteBuffers(1, &m_buffers.second);
-            m_buffers.second = AL_NONE;
-        }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setTracingEnabled(JNIEnv *env, jobject thiz,
+                                                                             jboolean enabled) {
+    setTraceBackend(enabled == JNI_TRUE ? &ATRACE_BACKEND : nullptr);
+}
 
-        LOGD("Sound stopped: %s", m_soundId.c_str());
-    }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setCallbackNative(JNIEnv *env, jobject thiz,
+                                                                             jobject callback) {
+    JNI_TRACE("setCallbackNative");
+    g_callbacks.setCallback(env, callback);
+}
 
-    void pause() {
-        if (!m_isPlaying) return;
+JNIEXPORT jboolean JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_initOpenAL(JNIEnv *env, jobject thiz,
+                                                                      jstring jselectedHrtf, jint profile,
+                                                                      jstring jConfigDirectory) {
+    JNI_TRACE("initOpenAL");
+    bool knownProfile = profile >= (jint) DeviceProfile::Default && profile <= (jint) DeviceProfile::BatterySaver;
+    DeviceProfile deviceProfile = knownProfile ? (DeviceProfile) profile : DeviceProfile::Default;
 
-        alSourcePause(m_sources.first);
-        if (hasStereo()) {
-            alSourcePause(m_sources.second);
-        }
-        LOGD("Sound paused: %s", m_soundId.c_str());
+    // The config overrides only take if OpenAL Soft wasn't used by the process yet
+    const char *configDirectory = env->GetStringUTFChars(jConfigDirectory, nullptr);
+    if (deviceProfile != DeviceProfile::Default && configDirectory[0] != '\0') {
+        applyDeviceProfileConfig(deviceProfile, configDirectory);
     }
+    env->ReleaseStringUTFChars(jConfigDirectory, configDirectory);
 
-    void resume() {
-        if (!m_isPlaying) return;
+    const char *selectedHrtf = env->GetStringUTFChars(jselectedHrtf, nullptr);
+    bool result = g_audioEngine->initialize(selectedHrtf, deviceProfile);
+    env->ReleaseStringUTFChars(jselectedHrtf, selectedHrtf);
+    return result ? JNI_TRUE : JNI_FALSE;
+}
 
-        alSourcePlay(m_sources.first);
-        if (hasStereo()) {
-            alSourcePlay(m_sources.second);
-        }
-        LOGD("Sound resumed: %s", m_soundId.c_str());
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_cleanupOpenAL(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("cleanupOpenAL");
+    if (g_audioEngine) {
+        g_audioEngine->cleanup();
+        g_audioEngine.reset();
     }
+    // Delivers what the engine posted until it stopped, then detaches the thread
+    g_callbacks.stop();
+}
 
-    void updatePosition(float angle, float radius, float height, float stereoAngle) const {
-        if (!hasStereo()) {
-            // Mono sound - single source
-            setPosition(m_sources.first, angle, radius, height);
-        } else {
-            // Stereo sound - two sources with stereo separation
-            setPosition(m_sources.first, angle - stereoAngle / 2, radius, height);
-            setPosition(m_sources.second, angle + stereoAngle / 2, radius, height);
-        }
-    }
+JNIEXPORT jlong JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_createSound(JNIEnv *env, jobject thiz,
+                                                                       jstring jFilePath) {
+    JNI_TRACE("createSound");
+    const char *filePath = env->GetStringUTFChars(jFilePath, nullptr);
+    SoundId soundId = g_audioEngine->createSound(SoundSource::fromPath(filePath));
+    env->ReleaseStringUTFChars(jFilePath, filePath);
 
-    void setPlaybackTime(float seconds) const {
-        alSourcef(m_sources.first, AL_SEC_OFFSET, seconds);
-        if (hasStereo()) {
-            alSourcef(m_sources.second, AL_SEC_OFFSET, seconds);
-        }
-    }
+    return (jlong) soundId;
+}
 
-    float getPlaybackTime() const {
-        ALfloat seconds = 0.0f;
-        alGetSourcef(m_sources.first, AL_SEC_OFFSET, &seconds);
-        return (alGetError() == AL_NO_ERROR) ? seconds : -1.0f;
-    }
+JNIEXPORT jlong JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_startExport(JNIEnv *env, jobject thiz, jstring jInputPath,
+                                                                       jstring jOutputPath, jint format,
+                                                                       jlong trajectorySoundId) {
+    JNI_TRACE("startExport");
+    if (!g_audioEngine || format < (jint) ExportFormat::Wav || format > (jint) ExportFormat::Mp3) return 0;
+
+    const char *inputPath = env->GetStringUTFChars(jInputPath, nullptr);
+    const char *outputPath = env->GetStringUTFChars(jOutputPath, nullptr);
+    uint64_t exportId = g_audioEngine->startExport(SoundSource::fromPath(inputPath), outputPath,
+                                                   (ExportFormat) format, (SoundId) trajectorySoundId);
+    env->ReleaseStringUTFChars(jInputPath, inputPath);
+    env->ReleaseStringUTFChars(jOutputPath, outputPath);
+
+    return (jlong) exportId;
+}
 
-    float getDuration() const { return m_duration; }
+JNIEXPORT jboolean JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_cancelExport(JNIEnv *env, jobject thiz, jlong exportId) {
+    JNI_TRACE("cancelExport");
+    return (g_audioEngine && g_audioEngine->cancelExport((uint64_t) exportId)) ? JNI_TRUE : JNI_FALSE;
+}
 
-    const SoundId &getId() const { return m_soundId; }
+JNIEXPORT jfloat JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getExportProgress(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("getExportProgress");
+    return g_audioEngine ? g_audioEngine->getExportProgress() : 0.0f;
+}
 
-    bool isPlaying() const { return m_isPlaying; }
+JNIEXPORT jlong JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_createStreamingSound(JNIEnv *env, jobject thiz,
+                                                                                jstring jFilePath) {
+    JNI_TRACE("createStreamingSound");
+    const char *filePath = env->GetStringUTFChars(jFilePath, nullptr);
+    SoundId soundId = g_audioEngine->createSound(SoundSource::fromPath(filePath), true);
+    env->ReleaseStringUTFChars(jFilePath, filePath);
 
-    bool hasStereo() const { return m_buffers.second != AL_NONE; }
+    return (jlong) soundId;
+}
 
-private:
-    static void setupSource(ALuint source, ALuint buffer) {
-        alSourcei(source, AL_SOURCE_RELATIVE, AL_TRUE);
-        alSource3f(source, AL_POSITION, 0.0f, 0.0f, -1.0f);
-        alSourcei(source, AL_BUFFER, static_cast<ALint>(buffer));
+JNIEXPORT jlong JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_createSoundAsync(JNIEnv *env, jobject thiz,
+                                                                            jstring jFilePath,
+                                                                            jboolean streaming) {
+    JNI_TRACE("createSoundAsync");
+    const char *filePath = env->GetStringUTFChars(jFilePath, nullptr);
+    SoundId soundId = g_audioEngine->createSoundAsync(SoundSource::fromPath(filePath), streaming == JNI_TRUE);
+    env->ReleaseStringUTFChars(jFilePath, filePath);
 
-        ALenum error = alGetError();
-        if (error != AL_NO_ERROR) {
-            LOGE("Error setting up source: %s", alGetString(error));
-        }
-    }
-};
+    return (jlong) soundId;
+}
 
-// Main audio engine class
-class AudioEngine {
-private:
-    ALCdevice *m_device;
-    ALCcontext *m_context;
-    JavaVM *m_javaVM;
-    jobject m_globalCallback;
-    std::atomic<bool> m_stopFlag;
+JNIEXPORT jlong JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_createSoundFromFd(JNIEnv *env, jobject thiz,
+                                                                             jint fd, jlong offset,
+                                                                             jlong length, jstring jName,
+                                                                             jboolean streaming) {
+    JNI_TRACE("createSoundFromFd");
+    const char *name = env->GetStringUTFChars(jName, nullptr);
+    SoundSource source = SoundSource::fromFileDescriptor(fd, offset, length, name);
+    env->ReleaseStringUTFChars(jName, name);
+
+    SoundId soundId = g_audioEngine->createSound(source, streaming == JNI_TRUE);
+    return (jlong) soundId;
+}
 
-    std::map<SoundId, std::unique_ptr<SoundInstance>> m_activeSounds;
-    std::mutex m_soundsMutex;
-    float m_stereoAngle;
+JNIEXPORT jlong JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_createSoundFromMemory(JNIEnv *env, jobject thiz,
+                                                                                 jobject buffer,
+                                                                                 jstring jName,
+                                                                                 jboolean streaming) {
+    JNI_TRACE("createSoundFromMemory");
+    void *data = env->GetDirectBufferAddress(buffer);
+    jlong size = env->GetDirectBufferCapacity(buffer);
+    if (!data || size <= 0) {
+        LOGE("createSoundFromMemory needs a non-empty direct ByteBuffer");
+        return 0;
+    }
+
+    // The global ref keeps the buffer's memory alive for as long as the sound (or its stream) reads it
+    JavaVM *vm = nullptr;
+    env->GetJavaVM(&vm);
+    jobject bufferRef = env->NewGlobalRef(buffer);
+    std::shared_ptr<void> keepAlive(bufferRef, [vm](void *ref) {
+        JNIEnv *releaseEnv;
+        bool attached = false;
+        if (vm->GetEnv((void **) &releaseEnv, JNI_VERSION_1_6) != JNI_OK) {
+            vm->AttachCurrentThread(&releaseEnv, nullptr);
+            attached = true;
+        }
+        releaseEnv->DeleteGlobalRef((jobject) ref);
+        if (attached) vm->DetachCurrentThread();
+    });
 
-    // UUID generation
-    static std::string generateSoundID(std::string filePath) {
-        static std::atomic<int> counter{0};
+    const char *name = env->GetStringUTFChars(jName, nullptr);
+    SoundSource source = SoundSource::fromMemory(data, (size_t) size, keepAlive, name);
+    env->ReleaseStringUTFChars(jName, name);
+    keepAlive.reset();
 
-        size_t lastSlash = filePath.find_last_of("/\\");
-        std::string fileName = (lastSlash != std::string::npos)
-                               ? filePath.substr(lastSlash + 1)
-                               : filePath;
+    SoundId soundId = g_audioEngine->createSound(source, streaming == JNI_TRUE);
+    return (jlong) soundId;
+}
 
-        int idNumber = ++counter;
-        return std::to_string(idNumber) + "_" + fileName;
+JNIEXPORT jboolean JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_cancelSoundLoad(JNIEnv *env, jobject thiz,
+                                                                           jlong soundId) {
+    JNI_TRACE("cancelSoundLoad");
+    bool cancelled = false;
+    if (g_audioEngine) {
+        cancelled = g_audioEngine->cancelSoundLoad(soundId);
     }
+    return cancelled ? JNI_TRUE : JNI_FALSE;
+}
 
-public:
-    AudioEngine() : m_device(nullptr), m_context(nullptr), m_javaVM(nullptr),
-                    m_globalCallback(nullptr), m_stopFlag(false),
-                    m_stereoAngle(INITIAL_STEREO_ANGLE) {}
-
-    ~AudioEngine() {
-        cleanup();
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_playSound(JNIEnv *env, jobject thiz,
+                                                                     jlong soundId) {
+    JNI_TRACE("playSound");
+    if (g_audioEngine) {
+        g_audioEngine->playSound(soundId);
     }
+}
 
-    // Initialization
-    bool initialize(JNIEnv *env, const std::string &selectedHrtf) {
-        LOGI("Initializing OpenAL with HRTF: %s", selectedHrtf.c_str());
-
-        m_device = alcOpenDevice(nullptr);
-        if (!m_device) {
-            LOGE("Failed to open OpenAL device");
-            return false;
-        }
-
-        loadHRTF(m_device, selectedHrtf.c_str());
-
-        m_context = alcCreateContext(m_device, nullptr);
-        if (!m_context) {
-            LOGE("Failed to create OpenAL context");
-            alcCloseDevice(m_device);
-            m_device = nullptr;
-            return false;
-        }
-
-        if (!alcMakeContextCurrent(m_context)) {
-            LOGE("Failed to make context current");
-            cleanup();
-            return false;
-        }
-
-        // Set up listener
-        alListener3f(AL_POSITION, 0.0f, 0.0f, 1.0f);
-        alListener3f(AL_VELOCITY, 0.0f, 0.0f, 0.0f);
-        alListenerfv(AL_ORIENTATION, LISTENER_ORIENTATION);
-
-        LOGI("OpenAL initialized successfully");
-        return true;
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_stopSound(JNIEnv *env, jobject thiz,
+                                                                     jlong soundId) {
+    JNI_TRACE("stopSound");
+    if (g_audioEngine) {
+        g_audioEngine->stopSound(soundId);
     }
+}
 
-    void cleanup() {
-        stopAllSounds();
-
-        if (m_context) {
-            alcMakeContextCurrent(nullptr);
-            alcDestroyContext(m_context);
-            m_context = nullptr;
-        }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_stopAllSounds(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("stopAllSounds");
+    if (g_audioEngine) {
+        g_audioEngine->stopAllSounds();
+    }
+}
 
-        if (m_device) {
-            alcCloseDevice(m_device);
-            m_device = nullptr;
-        }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_pauseSound(JNIEnv *env, jobject thiz,
+                                                                      jlong soundId) {
+    JNI_TRACE("pauseSound");
+    if (g_audioEngine) {
+        g_audioEngine->pauseSound(soundId);
+    }
+}
 
-        if (m_globalCallback) {
-            JNIEnv *env;
-            m_javaVM->AttachCurrentThread(&env, nullptr);
-            env->DeleteGlobalRef(m_globalCallback);
-            m_globalCallback = nullptr;
-            m_javaVM->DetachCurrentThread();
-        }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_resumeSound(JNIEnv *env, jobject thiz,
+                                                                       jlong soundId) {
+    JNI_TRACE("resumeSound");
+    if (g_audioEngine) {
+        g_audioEngine->resumeSound(soundId);
+    }
+}
 
-        LOGI("OpenAL cleanup completed");
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setSoundPosition(JNIEnv *env, jobject thiz,
+                                                                            jlong soundId,
+                                                                            jfloat angle,
+                                                                            jfloat radius,
+                                                                            jfloat height) {
+    JNI_TRACE("setSoundPosition");
+    if (g_audioEngine) {
+        g_audioEngine->setSoundPosition(soundId, angle, radius, height);
     }
+}
 
-    // Sound management
-    SoundId createSound(const std::string &filePath) {
-        SoundId soundId = generateSoundID(filePath);
-        LOGD("Creating sound instance %s for file: %s", soundId.c_str(), filePath.c_str());
+static void setTrajectory(jlong soundId, const Trajectory &trajectory) {
+    if (g_audioEngine) {
+        g_audioEngine->setSoundTrajectory(soundId, trajectory);
+    }
+}
 
-        auto sound = std::make_unique<SoundInstance>(filePath, soundId);
-        if (!sound->load()) {
-            LOGE("Failed to load sound for file: %s", filePath.c_str());
-            return "";
-        }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setSoundOrbit(JNIEnv *env, jobject thiz,
+                                                                         jlong soundId,
+                                                                         jfloat startAngle,
+                                                                         jfloat radius,
+                                                                         jfloat height,
+                                                                         jfloat revolutionsPerSecond) {
+    JNI_TRACE("setSoundOrbit");
+    Trajectory trajectory;
+    trajectory.type = TrajectoryType::Orbit;
+    trajectory.base = {startAngle, radius, height};
+    trajectory.rate = revolutionsPerSecond;
+    setTrajectory(soundId, trajectory);
+}
 
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        m_activeSounds[soundId] = std::move(sound);
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setSoundPingPong(JNIEnv *env, jobject thiz,
+                                                                            jlong soundId,
+                                                                            jfloat centerAngle,
+                                                                            jfloat angleExtent,
+                                                                            jfloat radius,
+                                                                            jfloat height,
+                                                                            jfloat cyclesPerSecond) {
+    JNI_TRACE("setSoundPingPong");
+    Trajectory trajectory;
+    trajectory.type = TrajectoryType::PingPong;
+    trajectory.base = {centerAngle, radius, height};
+    trajectory.extent = angleExtent;
+    trajectory.rate = cyclesPerSecond;
+    setTrajectory(soundId, trajectory);
+}
 
-        return soundId;
-    }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setSoundFigureEight(JNIEnv *env, jobject thiz,
+                                                                               jlong soundId,
+                                                                               jfloat centerAngle,
+                                                                               jfloat angleExtent,
+                                                                               jfloat radius,
+                                                                               jfloat height,
+                                                                               jfloat heightExtent,
+                                                                               jfloat cyclesPerSecond) {
+    JNI_TRACE("setSoundFigureEight");
+    Trajectory trajectory;
+    trajectory.type = TrajectoryType::FigureEight;
+    trajectory.base = {centerAngle, radius, height};
+    trajectory.extent = angleExtent;
+    trajectory.heightExtent = heightExtent;
+    trajectory.rate = cyclesPerSecond;
+    setTrajectory(soundId, trajectory);
+}
 
-    void playSound(const SoundId &soundId) {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        auto it = m_activeSounds.find(soundId);
-        if (it != m_activeSounds.end()) {
-            it->second->play([this, soundId]() { onSoundFinished(soundId); });
-        } else {
-            LOGW("Sound not found for ID: %s", soundId.c_str());
-        }
-    }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setSoundKeyframes(JNIEnv *env, jobject thiz,
+                                                                             jlong soundId,
+                                                                             jfloatArray jTimes,
+                                                                             jfloatArray jAngles,
+                                                                             jfloatArray jRadii,
+                                                                             jfloatArray jHeights,
+                                                                             jintArray jEasings,
+                                                                             jboolean loop) {
+    JNI_TRACE("setSoundKeyframes");
+    jsize count = env->GetArrayLength(jTimes);
+    if (count < 1 || env->GetArrayLength(jAngles) != count || env->GetArrayLength(jRadii) != count
+        || env->GetArrayLength(jHeights) != count || env->GetArrayLength(jEasings) != count) {
+        LOGE("setSoundKeyframes needs arrays of the same, non-zero length");
+        return;
+    }
+
+    std::vector<jfloat> times(count), angles(count), radii(count), heights(count);
+    std::vector<jint> easings(count);
+    env->GetFloatArrayRegion(jTimes, 0, count, times.data());
+    env->GetFloatArrayRegion(jAngles, 0, count, angles.data());
+    env->GetFloatArrayRegion(jRadii, 0, count, radii.data());
+    env->GetFloatArrayRegion(jHeights, 0, count, heights.data());
+    env->GetIntArrayRegion(jEasings, 0, count, easings.data());
+
+    Trajectory trajectory;
+    trajectory.type = TrajectoryType::Keyframes;
+    trajectory.loop = loop == JNI_TRUE;
+    for (jsize i = 0; i < count; i++) {
+        jint easing = std::min(std::max(easings[i], 0), (jint) Easing::Step);
+        trajectory.keyframes.push_back({times[i], {angles[i], radii[i], heights[i]}, (Easing) easing});
+    }
+    std::stable_sort(trajectory.keyframes.begin(), trajectory.keyframes.end(),
+                     [](const MotionKeyframe &a, const MotionKeyframe &b) { return a.time < b.time; });
+    trajectory.base = trajectory.keyframes.front().pose;
+    setTrajectory(soundId, trajectory);
+}
 
-    void stopSound(const SoundId &soundId) {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        auto it = m_activeSounds.find(soundId);
-        if (it != m_activeSounds.end()) {
-            it->second->stop();
-            m_activeSounds.erase(it);
-        }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setSoundWobble(JNIEnv *env, jobject thiz,
+                                                                          jlong soundId,
+                                                                          jfloat depth,
+                                                                          jfloat cyclesPerSecond) {
+    JNI_TRACE("setSoundWobble");
+    if (g_audioEngine) {
+        g_audioEngine->setSoundWobble(soundId, depth, cyclesPerSecond);
     }
+}
 
-    void stopAllSounds() {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        for (auto &[soundId, sound]: m_activeSounds) {
-            sound->stop();
-        }
-        m_activeSounds.clear();
-        LOGI("All sounds stopped");
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_animateSoundPosition(JNIEnv *env, jobject thiz,
+                                                                                jlong soundId,
+                                                                                jfloat targetAngle,
+                                                                                jfloat targetRadius,
+                                                                                jfloat targetHeight,
+                                                                                jlong durationMs) {
+    JNI_TRACE("animateSoundPosition");
+    if (g_audioEngine) {
+        g_audioEngine->animateSoundPosition(soundId, {targetAngle, targetRadius, targetHeight},
+                                            (float) durationMs / 1000.0f);
     }
+}
 
-    void pauseSound(const SoundId &soundId) {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        auto it = m_activeSounds.find(soundId);
-        if (it != m_activeSounds.end()) {
-            it->second->pause();
-        }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_clearSoundMotion(JNIEnv *env, jobject thiz,
+                                                                            jlong soundId) {
+    JNI_TRACE("clearSoundMotion");
+    if (g_audioEngine) {
+        g_audioEngine->clearSoundMotion(soundId);
     }
+}
 
-    void resumeSound(const SoundId &soundId) {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        auto it = m_activeSounds.find(soundId);
-        if (it != m_activeSounds.end()) {
-            it->second->resume();
-        }
-    }
+JNIEXPORT jobject JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getParameterBlockNative(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("getParameterBlockNative");
+    // Never freed, Kotlin may keep the buffer past cleanupOpenAL
+    static ParameterBlock *parameterBlock = new ParameterBlock();
+    if (!parameterBlock->isValid()) return nullptr;
 
-    // Sound control
-    void setSoundPosition(const SoundId &soundId, float angle, float radius, float height) {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        auto it = m_activeSounds.find(soundId);
-        if (it != m_activeSounds.end()) {
-            alcSuspendContext(m_context);
-            it->second->updatePosition(angle, radius, height, m_stereoAngle);
-            alcProcessContext(m_context);
-
-            ALenum error = alGetError();
-            if (error != AL_NO_ERROR) {
-                LOGW("Error updating position for sound %s: %s", soundId.c_str(),
-                     alGetString(error));
-            }
-        }
+    if (g_audioEngine) {
+        g_audioEngine->setParameterBlock(parameterBlock);
     }
+    return env->NewDirectByteBuffer(parameterBlock->getData(), (jlong) ParameterBlock::getSize());
+}
 
-    void setPlaybackTime(const SoundId &soundId, float seconds) {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        auto it = m_activeSounds.find(soundId);
-        if (it != m_activeSounds.end()) {
-            it->second->setPlaybackTime(seconds);
-        }
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_queueNext(JNIEnv *env, jobject thiz, jlong currentSoundId,
+                                                                     jlong nextSoundId, jfloat crossfadeSeconds) {
+    JNI_TRACE("queueNext");
+    if (g_audioEngine) {
+        g_audioEngine->queueNext((SoundId) currentSoundId, (SoundId) nextSoundId, crossfadeSeconds);
     }
+}
 
-    float getPlaybackTime(const SoundId &soundId) {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        auto it = m_activeSounds.find(soundId);
-        return (it != m_activeSounds.end()) ? it->second->getPlaybackTime() : -1.0f;
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_clearQueuedNext(JNIEnv *env, jobject thiz,
+                                                                           jlong currentSoundId) {
+    JNI_TRACE("clearQueuedNext");
+    if (g_audioEngine) {
+        g_audioEngine->clearQueuedNext((SoundId) currentSoundId);
     }
+}
 
-    float getSoundDuration(const SoundId &soundId) {
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        auto it = m_activeSounds.find(soundId);
-        return (it != m_activeSounds.end()) ? it->second->getDuration() : 0.0f;
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setPositionTickInterval(JNIEnv *env, jobject thiz,
+                                                                                  jlong intervalMs) {
+    JNI_TRACE("setPositionTickInterval");
+    if (g_audioEngine) {
+        g_audioEngine->setPositionTickInterval((uint32_t) std::max<jlong>(0, intervalMs));
     }
+}
 
-    // Configuration
-    void setStereoAngle(float angle) {
-        m_stereoAngle = angle;
-        LOGD("Stereo angle set to: %f radians", angle);
+JNIEXPORT jlongArray JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getDriftStatsNative(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("getDriftStatsNative");
+    // Zeroed once the engine is gone, the Kotlin side expects an array
+    SourceGroupDrift drift = {};
+    if (g_audioEngine) {
+        drift = g_audioEngine->getDriftStats();
     }
 
-    void setCallback(JNIEnv *env, jobject callback) {
-        if (m_globalCallback) {
-            env->DeleteGlobalRef(m_globalCallback);
-        }
-        m_globalCallback = env->NewGlobalRef(callback);
+    jlong values[] = {(jlong) drift.checks, (jlong) drift.corrections, (jlong) drift.maxFrames};
+    jsize count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
     }
+    return result;
+}
 
-    void setJavaVM(JavaVM *vm) {
-        m_javaVM = vm;
+JNIEXPORT jlongArray JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getSourcePoolStatsNative(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("getSourcePoolStatsNative");
+    // Zeroed once the engine is gone, the Kotlin side expects an array
+    SourcePoolStats stats = {};
+    if (g_audioEngine) {
+        stats = g_audioEngine->getSourcePoolStats();
     }
 
-private:
-    void onSoundFinished(const SoundId &soundId) {
-        if (!m_javaVM || !m_globalCallback) return;
-
-        JNIEnv *env;
-        m_javaVM->AttachCurrentThread(&env, nullptr);
-
-        jclass callbackClass = env->GetObjectClass(m_globalCallback);
-        jmethodID onSoundFinishedMethod = env->GetMethodID(
-                callbackClass, "onSoundFinished", "(Ljava/lang/String;)V");
-
-        if (onSoundFinishedMethod) {
-            jstring jSoundId = env->NewStringUTF(soundId.c_str());
-            env->CallVoidMethod(m_globalCallback, onSoundFinishedMethod, jSoundId);
-            env->DeleteLocalRef(jSoundId);
-        }
-
-        m_javaVM->DetachCurrentThread();
-
-        // Clean up the sound instance
-        std::lock_guard<std::mutex> lock(m_soundsMutex);
-        m_activeSounds.erase(soundId);
-
-        LOGD("Sound finished and cleaned up: %s", soundId.c_str());
+    jlong values[] = {(jlong) stats.capacity, (jlong) stats.inUse, (jlong) stats.peakInUse,
+                      (jlong) stats.acquires, (jlong) stats.releases, (jlong) stats.exhaustions};
+    jsize count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
     }
-};
-
-// Global audio engine instance
-std::unique_ptr<AudioEngine> g_audioEngine;
+    return result;
+}
 
-// JNI Functions
-extern "C" {
+JNIEXPORT jlongArray JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getPowerStatsNative(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("getPowerStatsNative");
+    if (!g_audioEngine) return nullptr;
+
+    EnginePowerStats stats = g_audioEngine->getPowerStats();
+    jlong values[] = {(jlong) stats.wallNs, (jlong) stats.cpuNs, (jlong) stats.voluntarySwitches,
+                      (jlong) stats.involuntarySwitches, (jlong) stats.frequency, (jlong) stats.refresh};
+    jsize count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (!result) return nullptr;
+    env->SetLongArrayRegion(result, 0, count, values);
+    return result;
+}
 
-JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
-    g_audioEngine = std::make_unique<AudioEngine>();
-    g_audioEngine->setJavaVM(vm);
-    return JNI_VERSION_1_6;
+JNIEXPORT jlongArray JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getCallbackStatsNative(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("getCallbackStatsNative");
+    CallbackStats stats = g_callbacks.getStats();
+    jlong values[] = {(jlong) stats.delivered, (jlong) stats.dropped, (jlong) stats.batches,
+                      (jlong) stats.totalLatencyNs, (jlong) stats.maxLatencyNs,
+                      (jlong) stats.totalCallNs, (jlong) stats.maxCallNs};
+    jsize count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (!result) return nullptr;
+    env->SetLongArrayRegion(result, 0, count, values);
+    return result;
 }
 
 JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setCallbackNative(JNIEnv *env, jobject thiz,
-                                                                             jobject callback) {
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setMotionRate(JNIEnv *env, jobject thiz,
+                                                                         jfloat hz) {
+    JNI_TRACE("setMotionRate");
     if (g_audioEngine) {
-        g_audioEngine->setCallback(env, callback);
+        g_audioEngine->setMotionRate(hz);
     }
 }
 
-JNIEXPORT jboolean JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_initOpenAL(JNIEnv *env, jobject thiz,
-                                                                      jstring jselectedHrtf) {
-    const char *selectedHrtf = env->GetStringUTFChars(jselectedHrtf, nullptr);
-    bool result = g_audioEngine->initialize(env, selectedHrtf);
-    env->ReleaseStringUTFChars(jselectedHrtf, selectedHrtf);
-    return result ? JNI_TRUE : JNI_FALSE;
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setSoundGain(JNIEnv *env, jobject thiz,
+                                                                        jlong soundId, jfloat gain) {
+    JNI_TRACE("setSoundGain");
+    if (g_audioEngine) {
+        g_audioEngine->setSoundGain(soundId, gain);
+    }
 }
 
 JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_cleanupOpenAL(JNIEnv *env, jobject thiz) {
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setPlaybackTime(JNIEnv *env, jobject thiz,
+                                                                           jlong soundId,
+                                                                           jfloat seconds) {
+    JNI_TRACE("setPlaybackTime");
     if (g_audioEngine) {
-        g_audioEngine->cleanup();
-        g_audioEngine.reset();
+        g_audioEngine->setPlaybackTime(soundId, seconds);
     }
 }
 
-JNIEXPORT jstring JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_createSound(JNIEnv *env, jobject thiz,
-                                                                       jstring jFilePath) {
-    const char *filePath = env->GetStringUTFChars(jFilePath, nullptr);
-    SoundId soundId = g_audioEngine->createSound(filePath);
-    env->ReleaseStringUTFChars(jFilePath, filePath);
+JNIEXPORT jfloat JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getPlaybackTime(JNIEnv *env, jobject thiz,
+                                                                           jlong soundId) {
+    JNI_TRACE("getPlaybackTime");
+    float position = -1.0f;
+    if (g_audioEngine) {
+        position = g_audioEngine->getPlaybackTime(soundId);
+    }
+    return position;
+}
 
-    return (soundId.empty()) ? nullptr : env->NewStringUTF(soundId.c_str());
+JNIEXPORT jfloatArray JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getPlaybackClockNative(JNIEnv *env, jobject thiz,
+                                                                                  jlong soundId) {
+    JNI_TRACE("getPlaybackClockNative");
+    float position, latency;
+    if (!g_audioEngine || !g_audioEngine->getPlaybackClock(soundId, position, latency)) return nullptr;
+
+    jfloat values[] = {position, latency};
+    jfloatArray result = env->NewFloatArray(2);
+    env->SetFloatArrayRegion(result, 0, 2, values);
+    return result;
 }
 
-JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_playSound(JNIEnv *env, jobject thiz,
-                                                                     jstring jSoundId) {
-    const char *soundId = env->GetStringUTFChars(jSoundId, nullptr);
-    if (g_audioEngine && soundId) {
-        g_audioEngine->playSound(soundId);
+JNIEXPORT jfloat JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getSoundDuration(JNIEnv *env, jobject thiz,
+                                                                            jlong soundId) {
+    JNI_TRACE("getSoundDuration");
+    float duration = 0.0f;
+    if (g_audioEngine) {
+        duration = g_audioEngine->getSoundDuration(soundId);
     }
-    env->ReleaseStringUTFChars(jSoundId, soundId);
+    return duration;
 }
 
 JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_stopSound(JNIEnv *env, jobject thiz,
-                                                                     jstring jSoundId) {
-    const char *soundId = env->GetStringUTFChars(jSoundId, nullptr);
-    if (g_audioEngine && soundId) {
-        g_audioEngine->stopSound(soundId);
-    }
-    env->ReleaseStringUTFChars(jSoundId, soundId);
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setDecodeCache(JNIEnv *env, jobject thiz,
+                                                                          jstring jDirectory,
+                                                                          jlong budgetBytes) {
+    JNI_TRACE("setDecodeCache");
+    const char *directory = env->GetStringUTFChars(jDirectory, nullptr);
+    if (g_audioEngine && directory) {
+        g_audioEngine->setDecodeCache(directory, budgetBytes > 0 ? (uint64_t) budgetBytes : 0);
+    }
+    env->ReleaseStringUTFChars(jDirectory, directory);
 }
 
 JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_stopAllSounds(JNIEnv *env, jobject thiz) {
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setBufferCacheBudget(JNIEnv *env, jobject thiz,
+                                                                                jlong idleBytes) {
+    JNI_TRACE("setBufferCacheBudget");
     if (g_audioEngine) {
-        g_audioEngine->stopAllSounds();
+        g_audioEngine->setBufferCacheBudget(idleBytes > 0 ? (uint64_t) idleBytes : 0);
     }
 }
 
 JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_pauseSound(JNIEnv *env, jobject thiz,
-                                                                      jstring jSoundId) {
-    const char *soundId = env->GetStringUTFChars(jSoundId, nullptr);
-    if (g_audioEngine && soundId) {
-        g_audioEngine->pauseSound(soundId);
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setScratchCap(JNIEnv *env, jobject thiz,
+                                                                         jlong capBytes) {
+    JNI_TRACE("setScratchCap");
+    if (g_audioEngine) {
+        g_audioEngine->setScratchCap(capBytes > 0 ? (uint64_t) capBytes : 0);
     }
-    env->ReleaseStringUTFChars(jSoundId, soundId);
 }
 
 JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_resumeSound(JNIEnv *env, jobject thiz,
-                                                                       jstring jSoundId) {
-    const char *soundId = env->GetStringUTFChars(jSoundId, nullptr);
-    if (g_audioEngine && soundId) {
-        g_audioEngine->resumeSound(soundId);
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_trimScratch(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("trimScratch");
+    if (g_audioEngine) {
+        g_audioEngine->trimScratch();
     }
-    env->ReleaseStringUTFChars(jSoundId, soundId);
 }
 
-JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setSoundPosition(JNIEnv *env, jobject thiz,
-                                                                            jstring jSoundId,
-                                                                            jfloat angle,
-                                                                            jfloat radius,
-                                                                            jfloat height) {
-    const char *soundId = env->GetStringUTFChars(jSoundId, nullptr);
-    if (g_audioEngine && soundId) {
-        g_audioEngine->setSoundPosition(soundId, angle, radius, height);
+JNIEXPORT jlongArray JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getScratchStatsNative(JNIEnv *env, jobject thiz) {
+    JNI_TRACE("getScratchStatsNative");
+    ScratchArenaStats stats = {};
+    if (g_audioEngine) {
+        stats = g_audioEngine->getScratchStats();
     }
-    env->ReleaseStringUTFChars(jSoundId, soundId);
-}
 
-JNIEXPORT void JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setPlaybackTime(JNIEnv *env, jobject thiz,
-                                                                           jstring jSoundId,
-                                                                           jfloat seconds) {
-    const char *soundId = env->GetStringUTFChars(jSoundId, nullptr);
-    if (g_audioEngine && soundId) {
-        g_audioEngine->setPlaybackTime(soundId, seconds);
+    // Same order as the ScratchStats constructor on the Kotlin side
+    jlong values[] = {(jlong) stats.acquires, (jlong) stats.reuses, (jlong) stats.allocations,
+                      (jlong) stats.frees, (jlong) stats.bytesInUse, (jlong) stats.bytesRetained,
+                      (jlong) stats.peakBytes, (jlong) stats.capBytes};
+    jsize count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
     }
-    env->ReleaseStringUTFChars(jSoundId, soundId);
+    return result;
 }
 
-JNIEXPORT jfloat JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getPlaybackTime(JNIEnv *env, jobject thiz,
-                                                                           jstring jSoundId) {
-    const char *soundId = env->GetStringUTFChars(jSoundId, nullptr);
-    float position = -1.0f;
-    if (g_audioEngine && soundId) {
-        position = g_audioEngine->getPlaybackTime(soundId);
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setLoadResampling(JNIEnv *env, jobject thiz,
+                                                                             jboolean enabled) {
+    JNI_TRACE("setLoadResampling");
+    if (g_audioEngine) {
+        g_audioEngine->setLoadResampling(enabled == JNI_TRUE);
     }
-    env->ReleaseStringUTFChars(jSoundId, soundId);
-    return position;
 }
 
-JNIEXPORT jfloat JNICALL
-Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_getSoundDuration(JNIEnv *env, jobject thiz,
-                                                                            jstring jSoundId) {
-    const char *soundId = env->GetStringUTFChars(jSoundId, nullptr);
-    float duration = 0.0f;
-    if (g_audioEngine && soundId) {
-        duration = g_audioEngine->getSoundDuration(soundId);
+JNIEXPORT void JNICALL
+Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setProgressiveLoading(JNIEnv *env, jobject thiz,
+                                                                                 jboolean enabled) {
+    JNI_TRACE("setProgressiveLoading");
+    if (g_audioEngine) {
+        g_audioEngine->setProgressiveLoading(enabled == JNI_TRUE);
     }
-    env->ReleaseStringUTFChars(jSoundId, soundId);
-    return duration;
 }
 
 JNIEXPORT void JNICALL
 Java_io_github_zyrouge_symphony_services_OpenAlAudioEngine_setStereoAngle(JNIEnv *env, jobject thiz,
                                                                           jfloat angle) {
+    JNI_TRACE("setStereoAngle");
     if (g_audioEngine) {
         g_audioEngine->setStereoAngle(angle);
     }
@@ -0,0 +1,173 @@
+#ifndef INC_8DMUSICPLAYER_PARAMETERBLOCK_H
+#define INC_8DMUSICPLAYER_PARAMETERBLOCK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <vector>
+
+// Layout shared with OpenAlAudioEngine.SoundParameterBlock, bump the version on any change
+constexpr uint32_t PARAMETER_BLOCK_MAGIC = 0x50443353; // "S3DP" in memory order
+constexpr uint32_t PARAMETER_BLOCK_VERSION = 1;
+// Sounds whose slot index is past this have no record, and go through the JNI calls only
+constexpr uint32_t PARAMETER_BLOCK_RECORDS = 256;
+
+enum ParameterState : uint32_t {
+    PARAMETER_STATE_EMPTY = 0,   // no sound, or still loading
+    PARAMETER_STATE_LOADED = 1,  // not started, or stopped
+    PARAMETER_STATE_PLAYING = 2,
+    PARAMETER_STATE_PAUSED = 3,
+};
+
+struct ParameterBlockHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t recordSize;
+    uint32_t headerSize;
+    uint32_t reserved[11];
+};
+
+/* One record per slot of the sound slot map, in two halves with a seqlock
+ * each: the input half is written by Kotlin, the output half by the control
+ * thread. A writer makes the sequence odd, writes the fields, then makes it
+ * even again; a reader retries if the sequence was odd or changed meanwhile.
+ * The serials tell the control thread which inputs are new since it last looked.
+ */
+struct ParameterRecord {
+    // Input, written by Kotlin
+    std::atomic<uint32_t> inputSequence;    // 0
+    std::atomic<uint32_t> positionSerial;   // 4, bumped on every position write
+    std::atomic<uint32_t> gainSerial;       // 8, bumped on every gain write
+    uint32_t inputReserved;                 // 12
+    std::atomic<int64_t> inputSoundId;      // 16, sound the inputs are meant for
+    std::atomic<float> angle;               // 24
+    std::atomic<float> radius;              // 28
+    std::atomic<float> height;              // 32
+    std::atomic<float> gain;                // 36
+
+    // Output, written by the control thread
+    std::atomic<uint32_t> outputSequence;   // 40
+    std::atomic<uint32_t> state;            // 44, ParameterState
+    std::atomic<int64_t> soundId;           // 48, sound in the slot, 0 if none
+    std::atomic<float> position;            // 56, playback position in seconds
+    std::atomic<float> duration;            // 60
+};
+
+static_assert(sizeof(ParameterBlockHeader) == 64, "Parameter block header layout changed");
+static_assert(sizeof(ParameterRecord) == 64, "Parameter record layout changed");
+
+struct ParameterInput {
+    int64_t soundId;
+    bool hasPosition;
+    bool hasGain;
+    float angle;
+    float radius;
+    float height;
+    float gain;
+};
+
+/* Fixed-layout memory shared with Kotlin through a direct ByteBuffer, so the
+ * UI can move sounds and poll their progress without any JNI call. Lives for
+ * the whole process once created, since Kotlin may hold the buffer across
+ * engine restarts.
+ */
+class ParameterBlock {
+private:
+    void *m_memory;
+    ParameterRecord *m_records;
+    std::vector<uint32_t> m_appliedPositionSerials;
+    std::vector<uint32_t> m_appliedGainSerials;
+
+public:
+    ParameterBlock() : m_memory(nullptr), m_records(nullptr),
+                       m_appliedPositionSerials(PARAMETER_BLOCK_RECORDS, 0),
+                       m_appliedGainSerials(PARAMETER_BLOCK_RECORDS, 0) {
+        if (posix_memalign(&m_memory, 64, getSize()) != 0) {
+            m_memory = nullptr;
+            return;
+        }
+        memset(m_memory, 0, getSize());
+
+        auto *header = static_cast<ParameterBlockHeader *>(m_memory);
+        header->magic = PARAMETER_BLOCK_MAGIC;
+        header->version = PARAMETER_BLOCK_VERSION;
+        header->recordCount = PARAMETER_BLOCK_RECORDS;
+        header->recordSize = sizeof(ParameterRecord);
+        header->headerSize = sizeof(ParameterBlockHeader);
+        m_records = reinterpret_cast<ParameterRecord *>(header + 1);
+    }
+
+    ~ParameterBlock() {
+        free(m_memory);
+    }
+
+    ParameterBlock(const ParameterBlock &) = delete;
+    ParameterBlock &operator=(const ParameterBlock &) = delete;
+
+    void *getData() const { return m_memory; }
+
+    static size_t getSize() {
+        return sizeof(ParameterBlockHeader) + PARAMETER_BLOCK_RECORDS * sizeof(ParameterRecord);
+    }
+
+    bool isValid() const { return m_memory != nullptr; }
+
+    /* Reads the inputs of a record that changed since the last call, returns
+     * false if nothing changed or Kotlin is in the middle of a write (the next
+     * tick picks it up). Control thread only.
+     */
+    bool readInput(uint32_t index, ParameterInput &input) {
+        ParameterRecord &record = m_records[index];
+        uint32_t sequence = record.inputSequence.load(std::memory_order_acquire);
+        if (sequence & 1) return false;
+
+        uint32_t positionSerial = record.positionSerial.load(std::memory_order_relaxed);
+        uint32_t gainSerial = record.gainSerial.load(std::memory_order_relaxed);
+        if (positionSerial == m_appliedPositionSerials[index] && gainSerial == m_appliedGainSerials[index])
+            return false;
+
+        input.soundId = record.inputSoundId.load(std::memory_order_relaxed);
+        input.angle = record.angle.load(std::memory_order_relaxed);
+        input.radius = record.radius.load(std::memory_order_relaxed);
+        input.height = record.height.load(std::memory_order_relaxed);
+        input.gain = record.gain.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.inputSequence.load(std::memory_order_relaxed) != sequence) return false;
+
+        input.hasPosition = positionSerial != m_appliedPositionSerials[index];
+        input.hasGain = gainSerial != m_appliedGainSerials[index];
+        m_appliedPositionSerials[index] = positionSerial;
+        m_appliedGainSerials[index] = gainSerial;
+        return true;
+    }
+
+    // Control thread only
+    void publish(uint32_t index, int64_t soundId, ParameterState state, float position, float duration) {
+        ParameterRecord &record = m_records[index];
+        uint32_t sequence = record.outputSequence.load(std::memory_order_relaxed);
+        record.outputSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        record.state.store(state, std::memory_order_relaxed);
+        record.soundId.store(soundId, std::memory_order_relaxed);
+        record.position.store(position, std::memory_order_relaxed);
+        record.duration.store(duration, std::memory_order_relaxed);
+
+        record.outputSequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Marks a record as empty, without touching it if it already is
+    void clear(uint32_t index) {
+        ParameterRecord &record = m_records[index];
+        if (record.soundId.load(std::memory_order_relaxed) == 0
+            && record.state.load(std::memory_order_relaxed) == PARAMETER_STATE_EMPTY)
+            return;
+        publish(index, 0, PARAMETER_STATE_EMPTY, 0.0f, 0.0f);
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_PARAMETERBLOCK_H
@@ -0,0 +1,310 @@
+#ifndef INC_8DMUSICPLAYER_PCMCACHE_H
+#define INC_8DMUSICPLAYER_PCMCACHE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AL/al.h"
+#include "AL/alext.h"
+
+#include "logSink.h"
+#define C_PCM_CACHE "C++ PCM Cache"
+
+constexpr char PCM_CACHE_MAGIC[8] = {'S', '3', 'D', 'P', 'C', 'M', '\0', '\0'};
+constexpr uint32_t PCM_CACHE_VERSION = 1;
+constexpr char PCM_CACHE_EXTENSION[] = ".pcm";
+// Sample data starts at this offset, so every plane can be mapped page-aligned
+constexpr uint64_t PCM_CACHE_DATA_OFFSET = 4096;
+
+/* On-disk layout of a cache entry: this header, the key right after it, then
+ * one plane of samples per channel starting at dataOffset (already split, so
+ * every plane can be handed to alBufferData as is).
+ */
+struct PcmCacheHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t format;      // AL_FORMAT_MONO16 or AL_FORMAT_MONO_FLOAT32
+    int32_t channels;
+    int32_t samplerate;
+    uint64_t frames;
+    uint64_t planeBytes;
+    uint64_t dataOffset;
+    uint32_t keyLength;
+    uint32_t reserved;
+};
+
+/* Persistent cache of decoded, deinterleaved PCM keyed by file identity
+ * (see SoundSource::getIdentity), so replaying a track skips the codec entirely.
+ * Entries are evicted least-recently-used first (by file mtime, which is
+ * refreshed on every hit) once the directory grows over the size budget.
+ */
+class PcmCache {
+private:
+    std::mutex m_mutex;
+    std::string m_directory;
+    uint64_t m_budgetBytes;
+
+public:
+    PcmCache() : m_budgetBytes(0) {}
+
+    // A budget of 0 disables the cache
+    void configure(const std::string &directory, uint64_t budgetBytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_directory = directory;
+        m_budgetBytes = directory.empty() ? 0 : budgetBytes;
+        if (!isEnabledLocked()) return;
+
+        if (mkdir(m_directory.c_str(), 0700) != 0 && errno != EEXIST) {
+            logPrint(LogLevel::Error, C_PCM_CACHE, "Could not create cache directory %s: %s",
+                     m_directory.c_str(), strerror(errno));
+            m_budgetBytes = 0;
+            return;
+        }
+        evictLocked(0);
+        logPrint(LogLevel::Info, C_PCM_CACHE, "PCM cache in %s, budget %" PRIu64 " bytes",
+                 m_directory.c_str(), m_budgetBytes);
+    }
+
+    bool isEnabled() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return isEnabledLocked();
+    }
+
+    // Only checks for an entry file, load() still validates it
+    bool contains(const std::string &key) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return isEnabledLocked() && access(entryPath(key).c_str(), R_OK) == 0;
+    }
+
+    /* Maps the cached entry for the key and uploads its planes to new buffers.
+     * Returns false on a miss (or an unusable entry), leaving buffers untouched.
+     */
+    bool load(const std::string &key, std::pair<ALuint, ALuint> &buffers) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!isEnabledLocked()) return false;
+
+        std::string path = entryPath(key);
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (uint64_t) st.st_size >= PCM_CACHE_DATA_OFFSET)
+            map = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return false;
+
+        bool loaded = false;
+        const auto *header = (const PcmCacheHeader *) map;
+        if (isValidEntry(header, key, (uint64_t) st.st_size)) {
+            madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+            const char *data = (const char *) map + header->dataOffset;
+
+            ALuint ids[2] = {AL_NONE, AL_NONE};
+            alGenBuffers(header->channels, ids);
+            for (int c = 0; c < header->channels; c++) {
+                alBufferData(ids[c], header->format, data + c * header->planeBytes,
+                             (ALsizei) header->planeBytes, header->samplerate);
+            }
+
+            ALenum err = alGetError();
+            if (err == AL_NO_ERROR) {
+                buffers = {ids[0], ids[1]};
+                loaded = true;
+            } else {
+                logPrint(LogLevel::Error, C_PCM_CACHE, "OpenAL Error loading cached PCM: %s",
+                         alGetString(err));
+                alDeleteBuffers(header->channels, ids);
+            }
+        }
+        munmap(map, (size_t) st.st_size);
+
+        if (loaded) {
+            // Refresh the mtime, it is what the LRU eviction goes by
+            utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+        } else {
+            unlink(path.c_str());
+        }
+        return loaded;
+    }
+
+    /* Writes the planes (one per channel, planeBytes each) as the entry for the
+     * key. The file is written under a temporary name and renamed, so a
+     * partially written entry is never loaded.
+     */
+    void store(const std::string &key, ALenum format, int channels, int samplerate, uint64_t frames,
+               const void *const *planes, uint64_t planeBytes) {
+        // The entry is written to a temporary file without the lock, so loads don't wait for the write
+        std::string directory;
+        uint64_t entryBytes = PCM_CACHE_DATA_OFFSET + planeBytes * channels;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!isEnabledLocked()) return;
+            if (sizeof(PcmCacheHeader) + key.size() > PCM_CACHE_DATA_OFFSET || entryBytes > m_budgetBytes / 2) {
+                logPrint(LogLevel::Debug, C_PCM_CACHE, "Not caching %s (%" PRIu64 " bytes)",
+                         key.c_str(), entryBytes);
+                return;
+            }
+            directory = m_directory;
+        }
+
+        PcmCacheHeader header = {};
+        memcpy(header.magic, PCM_CACHE_MAGIC, sizeof(header.magic));
+        header.version = PCM_CACHE_VERSION;
+        header.format = format;
+        header.channels = channels;
+        header.samplerate = samplerate;
+        header.frames = frames;
+        header.planeBytes = planeBytes;
+        header.dataOffset = PCM_CACHE_DATA_OFFSET;
+        header.keyLength = (uint32_t) key.size();
+
+        std::vector<char> prefix(PCM_CACHE_DATA_OFFSET, 0);
+        memcpy(prefix.data(), &header, sizeof(header));
+        memcpy(prefix.data() + sizeof(header), key.data(), key.size());
+
+        // Unique per store, two loads of the same track may write it at once
+        static std::atomic<uint64_t> s_tempCounter(0);
+        std::string path = entryPath(directory, key);
+        std::string tempPath = path + "." + std::to_string(s_tempCounter.fetch_add(1)) + ".tmp";
+        int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            logPrint(LogLevel::Error, C_PCM_CACHE, "Could not create %s: %s",
+                     tempPath.c_str(), strerror(errno));
+            return;
+        }
+
+        bool ok = writeAll(fd, prefix.data(), prefix.size());
+        for (int c = 0; ok && c < channels; c++)
+            ok = writeAll(fd, planes[c], planeBytes);
+        ok = (close(fd) == 0) && ok;
+
+        // Makes room and publishes the entry, unless the cache was reconfigured meanwhile
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bool current = isEnabledLocked() && m_directory == directory;
+        if (ok && current) {
+            evictLocked(entryBytes);
+            ok = rename(tempPath.c_str(), path.c_str()) == 0;
+        }
+        if (!ok || !current) {
+            if (!ok) {
+                logPrint(LogLevel::Error, C_PCM_CACHE, "Failed to write cache entry %s: %s",
+                         path.c_str(), strerror(errno));
+            }
+            unlink(tempPath.c_str());
+            return;
+        }
+        logPrint(LogLevel::Debug, C_PCM_CACHE, "Cached %s (%" PRIu64 " bytes)",
+                 key.c_str(), entryBytes);
+    }
+
+private:
+    bool isEnabledLocked() const { return m_budgetBytes > 0; }
+
+    std::string entryPath(const std::string &key) const {
+        return entryPath(m_directory, key);
+    }
+
+    static std::string entryPath(const std::string &directory, const std::string &key) {
+        // FNV-1a, the full key is also stored in the entry to rule out collisions
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (unsigned char c: key) {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016" PRIx64, hash);
+        return directory + "/" + name + PCM_CACHE_EXTENSION;
+    }
+
+    static bool isValidEntry(const PcmCacheHeader *header, const std::string &key, uint64_t fileSize) {
+        if (memcmp(header->magic, PCM_CACHE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != PCM_CACHE_VERSION
+            || header->channels < 1 || header->channels > 2
+            || header->dataOffset != PCM_CACHE_DATA_OFFSET
+            || header->planeBytes > (uint64_t) INT32_MAX
+            || header->dataOffset + header->planeBytes * header->channels != fileSize)
+            return false;
+        if (header->format == AL_FORMAT_MONO_FLOAT32 && !alIsExtensionPresent("AL_EXT_FLOAT32"))
+            return false;
+        if (header->format != AL_FORMAT_MONO16 && header->format != AL_FORMAT_MONO_FLOAT32)
+            return false;
+
+        const char *storedKey = (const char *) (header + 1);
+        return header->keyLength == key.size()
+               && sizeof(PcmCacheHeader) + header->keyLength <= PCM_CACHE_DATA_OFFSET
+               && memcmp(storedKey, key.data(), key.size()) == 0;
+    }
+
+    static bool writeAll(int fd, const void *data, uint64_t bytes) {
+        const char *ptr = (const char *) data;
+        while (bytes > 0) {
+            ssize_t written = write(fd, ptr, (size_t) std::min<uint64_t>(bytes, 1 << 20));
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            ptr += written;
+            bytes -= (uint64_t) written;
+        }
+        return true;
+    }
+
+    // Deletes the least recently used entries until incomingBytes more fit in the budget
+    void evictLocked(uint64_t incomingBytes) {
+        DIR *dir = opendir(m_directory.c_str());
+        if (!dir) return;
+
+        struct Entry {
+            std::string path;
+            uint64_t size;
+            struct timespec mtime;
+        };
+        std::vector<Entry> entries;
+        uint64_t totalBytes = 0;
+
+        size_t extensionLength = strlen(PCM_CACHE_EXTENSION);
+        while (struct dirent *item = readdir(dir)) {
+            size_t nameLength = strlen(item->d_name);
+            if (nameLength <= extensionLength
+                || strcmp(item->d_name + nameLength - extensionLength, PCM_CACHE_EXTENSION) != 0)
+                continue;
+
+            std::string path = m_directory + "/" + item->d_name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) continue;
+            entries.push_back({path, (uint64_t) st.st_size, st.st_mtim});
+            totalBytes += (uint64_t) st.st_size;
+        }
+        closedir(dir);
+
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+            if (a.mtime.tv_sec != b.mtime.tv_sec) return a.mtime.tv_sec < b.mtime.tv_sec;
+            return a.mtime.tv_nsec < b.mtime.tv_nsec;
+        });
+
+        for (const Entry &entry: entries) {
+            if (totalBytes + incomingBytes <= m_budgetBytes) break;
+            if (unlink(entry.path.c_str()) == 0) {
+                totalBytes -= entry.size;
+                logPrint(LogLevel::Debug, C_PCM_CACHE, "Evicted %s", entry.path.c_str());
+            }
+        }
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_PCMCACHE_H
@@ -0,0 +1,182 @@
+#ifndef INC_8DMUSICPLAYER_PLAYBACKEVENTS_H
+#define INC_8DMUSICPLAYER_PLAYBACKEVENTS_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AL/al.h"
+#include "AL/alext.h"
+
+#include "logSink.h"
+#define C_PLAYBACK_EVENTS "C++ Playback Events"
+
+// Poll interval without AL_SOFT_events, below the mixer period (1024 frames at 48kHz is 21ms)
+constexpr std::chrono::milliseconds EVENT_POLL_INTERVAL(10);
+// With AL_SOFT_events the sources are still polled this often, in case an event got dropped
+constexpr std::chrono::milliseconds EVENT_SAFETY_POLL_INTERVAL(500);
+
+/* One engine-owned thread that reports sources that stopped playing, instead
+ * of a polling thread per playing sound. With AL_SOFT_events the mixer pushes
+ * source state changes, so a finished sound is reported within a mixer
+ * period; otherwise every watched source is polled.
+ * The handlers run on the loop thread and get the watched sound ID, they
+ * must check the sound really finished (a stream can stop on an underrun, and
+ * source IDs get reused). Needs the AL context to be current.
+ */
+class PlaybackEventLoop {
+public:
+    typedef std::function<void(uint64_t soundId)> StoppedHandler;
+    typedef std::function<void()> BufferCompletedHandler;
+
+private:
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::map<ALuint, uint64_t> m_watched; // source -> sound ID
+    std::vector<ALuint> m_stoppedSources;    // reported by the event callback
+    bool m_bufferCompleted;
+    bool m_running;
+
+    bool m_usesEvents;
+    LPALEVENTCONTROLSOFT m_alEventControlSOFT;
+    LPALEVENTCALLBACKSOFT m_alEventCallbackSOFT;
+
+    StoppedHandler m_onStopped;
+    BufferCompletedHandler m_onBufferCompleted;
+
+public:
+    PlaybackEventLoop() : m_bufferCompleted(false), m_running(false), m_usesEvents(false),
+                          m_alEventControlSOFT(nullptr), m_alEventCallbackSOFT(nullptr) {}
+
+    ~PlaybackEventLoop() {
+        stop();
+    }
+
+    PlaybackEventLoop(const PlaybackEventLoop &) = delete;
+    PlaybackEventLoop &operator=(const PlaybackEventLoop &) = delete;
+
+    void start(StoppedHandler onStopped, BufferCompletedHandler onBufferCompleted) {
+        if (m_running) return;
+        m_onStopped = std::move(onStopped);
+        m_onBufferCompleted = std::move(onBufferCompleted);
+
+        if (alIsExtensionPresent("AL_SOFT_events")) {
+            m_alEventControlSOFT = reinterpret_cast<LPALEVENTCONTROLSOFT>(alGetProcAddress("alEventControlSOFT"));
+            m_alEventCallbackSOFT = reinterpret_cast<LPALEVENTCALLBACKSOFT>(alGetProcAddress("alEventCallbackSOFT"));
+        }
+        m_usesEvents = m_alEventControlSOFT && m_alEventCallbackSOFT;
+        if (m_usesEvents) {
+            const ALenum types[] = {AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT, AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT};
+            m_alEventCallbackSOFT(onAlEvent, this);
+            m_alEventControlSOFT(2, types, AL_TRUE);
+        }
+        logPrint(LogLevel::Info, C_PLAYBACK_EVENTS, "Playback events: %s",
+                 m_usesEvents ? "AL_SOFT_events" : "polling");
+
+        m_running = true;
+        m_thread = std::thread(&PlaybackEventLoop::run, this);
+    }
+
+    // Must be called while the context is still alive
+    void stop() {
+        if (!m_running) return;
+        if (m_usesEvents) {
+            const ALenum types[] = {AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT, AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT};
+            m_alEventControlSOFT(2, types, AL_FALSE);
+            m_alEventCallbackSOFT(nullptr, nullptr);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+            m_watched.clear();
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    void watch(ALuint source, uint64_t soundId) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_watched[source] = soundId;
+        }
+        m_cv.notify_all();
+    }
+
+    void unwatch(ALuint source) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_watched.erase(source);
+    }
+
+    bool usesEvents() const { return m_usesEvents; }
+
+private:
+    // Called on OpenAL's event thread, only queues the event for the loop thread
+    static void AL_APIENTRY onAlEvent(ALenum eventType, ALuint object, ALuint param, ALsizei /*length*/,
+                                      const ALchar * /*message*/, void *userParam) noexcept {
+        auto *loop = static_cast<PlaybackEventLoop *>(userParam);
+        {
+            std::lock_guard<std::mutex> lock(loop->m_mutex);
+            if (eventType == AL_EVENT_TYPE_SOURCE_STATE_CHANGED_SOFT) {
+                if (param != AL_STOPPED || loop->m_watched.find(object) == loop->m_watched.end()) return;
+                loop->m_stoppedSources.push_back(object);
+            } else if (eventType == AL_EVENT_TYPE_BUFFER_COMPLETED_SOFT) {
+                loop->m_bufferCompleted = true;
+            } else {
+                return;
+            }
+        }
+        loop->m_cv.notify_all();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto interval = m_usesEvents ? EVENT_SAFETY_POLL_INTERVAL : EVENT_POLL_INTERVAL;
+        auto nextPoll = std::chrono::steady_clock::now() + interval;
+
+        while (m_running) {
+            m_cv.wait_until(lock, nextPoll, [this] {
+                return !m_running || !m_stoppedSources.empty() || m_bufferCompleted;
+            });
+            if (!m_running) break;
+
+            std::vector<uint64_t> stopped;
+            for (ALuint source: m_stoppedSources) {
+                auto it = m_watched.find(source);
+                if (it != m_watched.end())
+                    stopped.push_back(it->second);
+            }
+            m_stoppedSources.clear();
+
+            bool bufferCompleted = m_bufferCompleted;
+            m_bufferCompleted = false;
+
+            if (std::chrono::steady_clock::now() >= nextPoll) {
+                for (const auto &watched: m_watched) {
+                    ALint state = AL_STOPPED;
+                    alGetSourcei(watched.first, AL_SOURCE_STATE, &state);
+                    if (state == AL_STOPPED)
+                        stopped.push_back(watched.second);
+                }
+                nextPoll = std::chrono::steady_clock::now() + interval;
+            }
+
+            // The handlers take the engine's locks and may unwatch, so they run unlocked
+            lock.unlock();
+            if (bufferCompleted && m_onBufferCompleted)
+                m_onBufferCompleted();
+            for (uint64_t soundId: stopped)
+                m_onStopped(soundId);
+            lock.lock();
+        }
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_PLAYBACKEVENTS_H
@@ -0,0 +1,128 @@
+#ifndef INC_8DMUSICPLAYER_PLAYBACKQUEUE_H
+#define INC_8DMUSICPLAYER_PLAYBACKQUEUE_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "AL/al.h"
+#include "AL/alc.h"
+#include "AL/alext.h"
+
+#include "logSink.h"
+#define C_PLAYBACK_QUEUE "C++ Playback Queue"
+
+// A transition is scheduled on the device clock once its start is this close, later
+// changes to the current sound (pause, seek) unschedule it while the start is still ahead
+constexpr std::chrono::milliseconds TRANSITION_SCHEDULE_LEAD(250);
+// Longest crossfade accepted, longer ones are clamped
+constexpr float TRANSITION_MAX_CROSSFADE = 30.0f;
+
+/* The device's sample clock, and sources started on it. With
+ * AL_SOFT_source_start_delay a source can be told to start at an exact device
+ * clock time, and with AL_SOFT_source_latency the clock time of a source's
+ * current sample offset can be read atomically, which together let one sound
+ * start on the exact sample another one ends. Needs the AL context to be current.
+ */
+class DeviceClock {
+private:
+    ALCdevice *m_device;
+    LPALCGETINTEGER64VSOFT m_alcGetInteger64vSOFT;
+    LPALGETSOURCEI64VSOFT m_alGetSourcei64vSOFT;
+    LPALSOURCEPLAYATTIMEVSOFT m_alSourcePlayAtTimevSOFT;
+
+public:
+    DeviceClock() : m_device(nullptr), m_alcGetInteger64vSOFT(nullptr), m_alGetSourcei64vSOFT(nullptr),
+                    m_alSourcePlayAtTimevSOFT(nullptr) {}
+
+    void load(ALCdevice *device) {
+        m_device = device;
+        m_alcGetInteger64vSOFT = nullptr;
+        m_alGetSourcei64vSOFT = nullptr;
+        m_alSourcePlayAtTimevSOFT = nullptr;
+
+        if (alcIsExtensionPresent(device, "ALC_SOFT_device_clock")) {
+            m_alcGetInteger64vSOFT = reinterpret_cast<LPALCGETINTEGER64VSOFT>(
+                    alcGetProcAddress(device, "alcGetInteger64vSOFT"));
+        }
+        if (alIsExtensionPresent("AL_SOFT_source_latency")) {
+            m_alGetSourcei64vSOFT = reinterpret_cast<LPALGETSOURCEI64VSOFT>(alGetProcAddress("alGetSourcei64vSOFT"));
+        }
+        if (alIsExtensionPresent("AL_SOFT_source_start_delay")) {
+            m_alSourcePlayAtTimevSOFT = reinterpret_cast<LPALSOURCEPLAYATTIMEVSOFT>(
+                    alGetProcAddress("alSourcePlayAtTimevSOFT"));
+        }
+        logPrint(LogLevel::Info, C_PLAYBACK_QUEUE, "Transitions: %s",
+                 canSchedule() ? "sample-accurate" : "on the control tick");
+    }
+
+    void unload() {
+        m_device = nullptr;
+        m_alcGetInteger64vSOFT = nullptr;
+        m_alGetSourcei64vSOFT = nullptr;
+        m_alSourcePlayAtTimevSOFT = nullptr;
+    }
+
+    bool canSchedule() const {
+        return m_device && m_alcGetInteger64vSOFT && m_alGetSourcei64vSOFT && m_alSourcePlayAtTimevSOFT;
+    }
+
+    // Device clock in nanoseconds, only meaningful if canSchedule()
+    int64_t now() const {
+        ALCint64SOFT clock = 0;
+        m_alcGetInteger64vSOFT(m_device, ALC_DEVICE_CLOCK_SOFT, 1, &clock);
+        return clock;
+    }
+
+    // Sample offset of the source, and the device clock time it was at that offset
+    bool getSourceClock(ALuint source, int64_t &frame, int64_t &clockNs) const {
+        if (!canSchedule()) return false;
+        ALint64SOFT values[2] = {0, 0};
+        m_alGetSourcei64vSOFT(source, AL_SAMPLE_OFFSET_CLOCK_SOFT, values);
+        if (alGetError() != AL_NO_ERROR) return false;
+        frame = values[0] >> 32; // 32.32 fixed point
+        clockNs = values[1];
+        return true;
+    }
+
+    /* Sample offset of the source and the output latency behind it, read
+     * atomically with AL_SOFT_source_latency: the sample at the offset is
+     * heard latencyNs from now. Without the extension the device's latency is
+     * used instead (ALC_SOFT_device_clock), and the offset is left as it was.
+     * Returns false if neither is available.
+     */
+    bool getSourceLatency(ALuint source, int64_t &frame, int64_t &latencyNs) const {
+        if (m_alGetSourcei64vSOFT) {
+            ALint64SOFT values[2] = {0, 0};
+            m_alGetSourcei64vSOFT(source, AL_SAMPLE_OFFSET_LATENCY_SOFT, values);
+            if (alGetError() == AL_NO_ERROR) {
+                frame = values[0] >> 32; // 32.32 fixed point
+                latencyNs = values[1];
+                return true;
+            }
+        }
+        if (m_device && m_alcGetInteger64vSOFT) {
+            ALCint64SOFT latency = 0;
+            m_alcGetInteger64vSOFT(m_device, ALC_DEVICE_LATENCY_SOFT, 1, &latency);
+            latencyNs = latency;
+            return true;
+        }
+        return false;
+    }
+
+    // The sources start together at the device clock time, right away if it already passed
+    void playAt(ALsizei count, const ALuint *sources, int64_t clockNs) const {
+        m_alSourcePlayAtTimevSOFT(count, sources, std::max<int64_t>(clockNs, now()));
+    }
+};
+
+// Equal-power crossfade, the summed power of both sounds stays constant over the fade
+inline void getCrossfadeGains(float progress, float &outgoing, float &incoming) {
+    float angle = std::min(1.0f, std::max(0.0f, progress)) * (float) M_PI_2;
+    outgoing = std::cos(angle);
+    incoming = std::sin(angle);
+}
+
+#endif //INC_8DMUSICPLAYER_PLAYBACKQUEUE_H
@@ -0,0 +1,128 @@
+#ifndef INC_8DMUSICPLAYER_RESAMPLER_H
+#define INC_8DMUSICPLAYER_RESAMPLER_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+// Taps per output sample, and filter phases stored per input sample period
+constexpr int RESAMPLER_TAPS = 64;
+constexpr int RESAMPLER_PHASES = 512;
+// Passband edge as a fraction of the lower of the two Nyquist frequencies
+constexpr double RESAMPLER_CUTOFF = 0.91;
+constexpr double RESAMPLER_KAISER_BETA = 7.5;
+
+/* Windowed-sinc (Kaiser) sample rate converter for whole interleaved buffers,
+ * used to convert tracks to the device's mixing rate once at load time so the
+ * mixer doesn't have to resample them on every period. The filter is stored
+ * as a table of RESAMPLER_PHASES sub-sample phases, interpolated linearly.
+ */
+class Resampler {
+private:
+    uint32_t m_srcRate;
+    uint32_t m_dstRate;
+    std::vector<float> m_table; // (RESAMPLER_PHASES + 1) rows of RESAMPLER_TAPS coefficients
+
+public:
+    Resampler(uint32_t srcRate, uint32_t dstRate) : m_srcRate(srcRate), m_dstRate(dstRate) {
+        // Downsampling lowers the cutoff to the output Nyquist frequency, to avoid aliasing
+        double cutoff = RESAMPLER_CUTOFF * std::min(1.0, (double) dstRate / srcRate);
+        const int half = RESAMPLER_TAPS / 2;
+        double besselBeta = besselI0(RESAMPLER_KAISER_BETA);
+
+        m_table.resize((RESAMPLER_PHASES + 1) * RESAMPLER_TAPS);
+        for (int p = 0; p <= RESAMPLER_PHASES; p++) {
+            double frac = (double) p / RESAMPLER_PHASES;
+            float *row = &m_table[p * RESAMPLER_TAPS];
+            for (int t = 0; t < RESAMPLER_TAPS; t++) {
+                double x = (t - half + 1) - frac;
+                double r = x / half;
+                double window = (r * r < 1.0) ? besselI0(RESAMPLER_KAISER_BETA * sqrt(1.0 - r * r)) / besselBeta : 0.0;
+                row[t] = (float) (cutoff * sinc(cutoff * x) * window);
+            }
+        }
+    }
+
+    uint32_t getSourceRate() const { return m_srcRate; }
+
+    uint32_t getTargetRate() const { return m_dstRate; }
+
+    size_t getOutputFrames(size_t inFrames) const {
+        return (size_t) (((uint64_t) inFrames * m_dstRate + m_srcRate - 1) / m_srcRate);
+    }
+
+    /* Converts inFrames interleaved frames of `channels` channels into
+     * getOutputFrames(inFrames) frames at out. Samples before and after the
+     * input are taken as silence.
+     */
+    template<typename T>
+    void process(const T *in, size_t inFrames, T *out, int channels) const {
+        const int half = RESAMPLER_TAPS / 2;
+        size_t outFrames = getOutputFrames(inFrames);
+        float coefficients[RESAMPLER_TAPS];
+
+        for (size_t j = 0; j < outFrames; j++) {
+            // Exact rational position, so long tracks don't drift
+            uint64_t position = (uint64_t) j * m_srcRate;
+            size_t index = (size_t) (position / m_dstRate);
+            uint64_t remainder = position % m_dstRate;
+
+            double phase = (double) remainder * RESAMPLER_PHASES / m_dstRate;
+            int p = (int) phase;
+            float mix = (float) (phase - p);
+            const float *row0 = &m_table[p * RESAMPLER_TAPS];
+            const float *row1 = row0 + RESAMPLER_TAPS;
+            for (int t = 0; t < RESAMPLER_TAPS; t++)
+                coefficients[t] = row0[t] + (row1[t] - row0[t]) * mix;
+
+            // First input frame under the filter, taps outside the input are skipped
+            ptrdiff_t first = (ptrdiff_t) index - half + 1;
+            int tapBegin = (int) std::max<ptrdiff_t>(0, -first);
+            int tapEnd = (int) std::min<ptrdiff_t>(RESAMPLER_TAPS, (ptrdiff_t) inFrames - first);
+
+            for (int c = 0; c < channels; c++) {
+                float sum = 0.0f;
+                for (int t = tapBegin; t < tapEnd; t++)
+                    sum += coefficients[t] * toFloat(in[(first + t) * channels + c]);
+                out[j * channels + c] = fromFloat<T>(sum);
+            }
+        }
+    }
+
+private:
+    static double sinc(double x) {
+        if (fabs(x) < 1e-9) return 1.0;
+        return sin(M_PI * x) / (M_PI * x);
+    }
+
+    static double besselI0(double x) {
+        double sum = 1.0, term = 1.0, halfX = x / 2.0;
+        for (int k = 1; k < 32; k++) {
+            term *= (halfX / k) * (halfX / k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    static float toFloat(short sample) { return sample; }
+
+    static float toFloat(float sample) { return sample; }
+
+    template<typename T>
+    static T fromFloat(float sample);
+};
+
+template<>
+inline short Resampler::fromFloat<short>(float sample) {
+    return (short) lrintf(std::min(32767.0f, std::max(-32768.0f, sample)));
+}
+
+template<>
+inline float Resampler::fromFloat<float>(float sample) {
+    return sample;
+}
+
+#endif //INC_8DMUSICPLAYER_RESAMPLER_H
@@ -0,0 +1,234 @@
+#ifndef INC_8DMUSICPLAYER_SCRATCHARENA_H
+#define INC_8DMUSICPLAYER_SCRATCHARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+// Block sizes are rounded up to these, so tracks of similar length share blocks
+constexpr size_t SCRATCH_SMALL_GRANULARITY = 64 * 1024;
+constexpr size_t SCRATCH_LARGE_GRANULARITY = 1024 * 1024;
+// Idle memory kept for reuse unless setCap() says otherwise
+constexpr uint64_t SCRATCH_DEFAULT_CAP = 8 * 1024 * 1024;
+/* Larger blocks go back to the heap as soon as they are released: the
+ * allocator maps them on their own, so they don't fragment it, and pooling a
+ * whole-track buffer would keep it resident between loads.
+ */
+constexpr size_t SCRATCH_MAX_IDLE_BLOCK = 4 * 1024 * 1024;
+
+struct ScratchArenaStats {
+    uint64_t acquires;       // buffers handed out
+    uint64_t reuses;         // ... of which came from a retained block
+    uint64_t allocations;    // blocks allocated from the heap
+    uint64_t frees;          // blocks given back to the heap
+    uint64_t bytesInUse;     // capacity of the buffers currently handed out
+    uint64_t bytesRetained;  // capacity of the idle blocks kept for reuse
+    uint64_t peakBytes;      // high-water mark of bytesInUse + bytesRetained
+    uint64_t capBytes;       // limit on bytesRetained, 0 if unlimited
+};
+
+class ScratchArena;
+
+/* Scratch memory borrowed from a ScratchArena (or from the heap if there is
+ * none), given back when destroyed or reset.
+ */
+class ScratchBuffer {
+private:
+    ScratchArena *m_arena;
+    void *m_data;
+    size_t m_capacity;
+
+public:
+    ScratchBuffer() : m_arena(nullptr), m_data(nullptr), m_capacity(0) {}
+
+    ScratchBuffer(ScratchArena *arena, void *data, size_t capacity)
+            : m_arena(arena), m_data(data), m_capacity(capacity) {}
+
+    ScratchBuffer(ScratchBuffer &&other) noexcept
+            : m_arena(other.m_arena), m_data(other.m_data), m_capacity(other.m_capacity) {
+        other.m_data = nullptr;
+        other.m_capacity = 0;
+    }
+
+    ScratchBuffer &operator=(ScratchBuffer &&other) noexcept {
+        if (this != &other) {
+            reset();
+            std::swap(m_arena, other.m_arena);
+            std::swap(m_data, other.m_data);
+            std::swap(m_capacity, other.m_capacity);
+        }
+        return *this;
+    }
+
+    ScratchBuffer(const ScratchBuffer &) = delete;
+    ScratchBuffer &operator=(const ScratchBuffer &) = delete;
+
+    ~ScratchBuffer() {
+        reset();
+    }
+
+    void *data() const { return m_data; }
+
+    template<typename T>
+    T *as() const { return (T *) m_data; }
+
+    size_t capacity() const { return m_capacity; }
+
+    explicit operator bool() const { return m_data != nullptr; }
+
+    inline void reset();
+};
+
+/* Pool of large scratch blocks for decoding and splitting tracks, reused
+ * across loads instead of a malloc/free pair per buffer, which fragments the
+ * native heap after a few hundred tracks. Idle blocks up to
+ * SCRATCH_MAX_IDLE_BLOCK are kept up to the cap, trim() returns them all.
+ * Thread-safe, the load workers share one arena.
+ */
+class ScratchArena {
+private:
+    struct Block {
+        void *data;
+        size_t capacity;
+    };
+
+    std::mutex m_mutex;
+    std::vector<Block> m_idle;
+    ScratchArenaStats m_stats;
+
+public:
+    ScratchArena() : m_stats() {
+        m_stats.capBytes = SCRATCH_DEFAULT_CAP;
+    }
+
+    ~ScratchArena() {
+        trim();
+    }
+
+    ScratchArena(const ScratchArena &) = delete;
+    ScratchArena &operator=(const ScratchArena &) = delete;
+
+    // Returns an empty buffer if the memory can't be allocated
+    static ScratchBuffer acquire(ScratchArena *arena, size_t bytes) {
+        if (arena)
+            return arena->acquire(bytes);
+        void *data = malloc(bytes);
+        return data ? ScratchBuffer(nullptr, data, bytes) : ScratchBuffer();
+    }
+
+    ScratchBuffer acquire(size_t bytes) {
+        size_t capacity = roundCapacity(bytes);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.acquires++;
+
+        // Smallest idle block that fits, without wasting more than its own size
+        auto best = m_idle.end();
+        for (auto it = m_idle.begin(); it != m_idle.end(); ++it) {
+            if (it->capacity >= capacity && it->capacity <= capacity * 2
+                && (best == m_idle.end() || it->capacity < best->capacity))
+                best = it;
+        }
+        if (best != m_idle.end()) {
+            Block block = *best;
+            m_idle.erase(best);
+            m_stats.reuses++;
+            m_stats.bytesRetained -= block.capacity;
+            m_stats.bytesInUse += block.capacity;
+            return ScratchBuffer(this, block.data, block.capacity);
+        }
+
+        void *data = malloc(capacity);
+        if (!data) {
+            // Give the idle blocks back and retry, they may be what keeps the heap full
+            trimLocked();
+            data = malloc(capacity);
+            if (!data) return ScratchBuffer();
+        }
+        m_stats.allocations++;
+        m_stats.bytesInUse += capacity;
+        updatePeakLocked();
+        return ScratchBuffer(this, data, capacity);
+    }
+
+    // Limits the idle memory kept for reuse (SCRATCH_DEFAULT_CAP by default), 0 for no limit
+    void setCap(uint64_t capBytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.capBytes = capBytes;
+        enforceCapLocked();
+    }
+
+    // Frees every idle block
+    void trim() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        trimLocked();
+    }
+
+    ScratchArenaStats getStats() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    friend class ScratchBuffer;
+
+    void release(void *data, size_t capacity) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.bytesInUse -= capacity;
+        if (capacity > SCRATCH_MAX_IDLE_BLOCK) {
+            free(data);
+            m_stats.frees++;
+            return;
+        }
+        m_idle.push_back({data, capacity});
+        m_stats.bytesRetained += capacity;
+        enforceCapLocked();
+    }
+
+    // Frees the largest idle blocks first until the idle memory fits in the cap
+    void enforceCapLocked() {
+        if (m_stats.capBytes == 0) return;
+        std::sort(m_idle.begin(), m_idle.end(), [](const Block &a, const Block &b) {
+            return a.capacity < b.capacity;
+        });
+        while (!m_idle.empty() && m_stats.bytesRetained > m_stats.capBytes) {
+            freeBlockLocked(m_idle.back());
+            m_idle.pop_back();
+        }
+    }
+
+    void trimLocked() {
+        for (const Block &block: m_idle)
+            freeBlockLocked(block);
+        m_idle.clear();
+    }
+
+    void freeBlockLocked(const Block &block) {
+        free(block.data);
+        m_stats.frees++;
+        m_stats.bytesRetained -= block.capacity;
+    }
+
+    void updatePeakLocked() {
+        m_stats.peakBytes = std::max(m_stats.peakBytes, m_stats.bytesInUse + m_stats.bytesRetained);
+    }
+
+    static size_t roundCapacity(size_t bytes) {
+        size_t granularity = bytes >= SCRATCH_LARGE_GRANULARITY ? SCRATCH_LARGE_GRANULARITY : SCRATCH_SMALL_GRANULARITY;
+        return std::max<size_t>(1, (bytes + granularity - 1) / granularity) * granularity;
+    }
+};
+
+inline void ScratchBuffer::reset() {
+    if (!m_data) return;
+    if (m_arena)
+        m_arena->release(m_data, m_capacity);
+    else
+        free(m_data);
+    m_data = nullptr;
+    m_capacity = 0;
+}
+
+#endif //INC_8DMUSICPLAYER_SCRATCHARENA_H
@@ -0,0 +1,110 @@
+#ifndef INC_8DMUSICPLAYER_SLOTMAP_H
+#define INC_8DMUSICPLAYER_SLOTMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+/* Stores values in reusable slots addressed by 64-bit handles: the slot index
+ * in the low 32 bits and the slot's generation in the high 32 bits. Erasing a
+ * value bumps its slot's generation, so a stale handle never reaches the value
+ * that reuses the slot. Lookups are an index and a compare, with no hashing
+ * and no allocation. Not thread-safe, the owner locks around it.
+ */
+template<typename T>
+class SlotMap {
+public:
+    typedef uint64_t Handle;
+    // Never returned by insert(), generations start at 1
+    static constexpr Handle INVALID_HANDLE = 0;
+
+private:
+    struct Slot {
+        T value;
+        uint32_t generation;
+        bool occupied;
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+    size_t m_size;
+
+public:
+    SlotMap() : m_size(0) {}
+
+    Handle insert(T value) {
+        uint32_t index;
+        if (!m_freeSlots.empty()) {
+            index = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        } else {
+            index = (uint32_t) m_slots.size();
+            m_slots.push_back({T(), 1, false});
+        }
+
+        Slot &slot = m_slots[index];
+        slot.value = std::move(value);
+        slot.occupied = true;
+        m_size++;
+        return makeHandle(index, slot.generation);
+    }
+
+    // Returns nullptr for stale and invalid handles
+    T *get(Handle handle) {
+        uint32_t index = (uint32_t) handle;
+        if (index >= m_slots.size()) return nullptr;
+        Slot &slot = m_slots[index];
+        if (!slot.occupied || slot.generation != (uint32_t) (handle >> 32)) return nullptr;
+        return &slot.value;
+    }
+
+    // Handle of the value in a slot, INVALID_HANDLE if the slot is free or out of range
+    Handle handleAt(uint32_t index) const {
+        if (index >= m_slots.size() || !m_slots[index].occupied) return INVALID_HANDLE;
+        return makeHandle(index, m_slots[index].generation);
+    }
+
+    // Moves the value out into removed, returns false for stale and invalid handles
+    bool erase(Handle handle, T *removed = nullptr) {
+        T *value = get(handle);
+        if (!value) return false;
+
+        Slot &slot = m_slots[(uint32_t) handle];
+        if (removed) *removed = std::move(slot.value);
+        slot.value = T();
+        slot.occupied = false;
+        // Skip 0 on wrap-around, so INVALID_HANDLE stays invalid
+        if (++slot.generation == 0) slot.generation = 1;
+        m_freeSlots.push_back((uint32_t) handle);
+        m_size--;
+        return true;
+    }
+
+    // Calls function(handle, value) for every stored value
+    template<typename Function>
+    void forEach(Function function) {
+        for (uint32_t index = 0; index < m_slots.size(); index++) {
+            Slot &slot = m_slots[index];
+            if (slot.occupied)
+                function(makeHandle(index, slot.generation), slot.value);
+        }
+    }
+
+    void clear() {
+        for (uint32_t index = 0; index < m_slots.size(); index++) {
+            if (m_slots[index].occupied)
+                erase(makeHandle(index, m_slots[index].generation));
+        }
+    }
+
+    size_t size() const { return m_size; }
+
+private:
+    static Handle makeHandle(uint32_t index, uint32_t generation) {
+        return ((Handle) generation << 32) | index;
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_SLOTMAP_H
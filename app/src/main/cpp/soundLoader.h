@@ -1,21 +1,55 @@
+#ifndef INC_8DMUSICPLAYER_SOUNDLOADER_H
+#define INC_8DMUSICPLAYER_SOUNDLOADER_H
+
 #include <assert.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <vector>
 #include "AL/al.h"
 #include "AL/alext.h"
 #include "sndfile.h"
 
-#include <android/log.h>
+#include "bufferMapping.h"
+#include "deinterleave.h"
+#include "pcmCache.h"
+#include "resampler.h"
+#include "scratchArena.h"
+#include "soundSource.h"
+#include "trace.h"
+
+#include "logSink.h"
 #define C_SOUND_LOADER "C++ Sound Loader"
 
 // Debug logging helper
-#define LOG_DEBUG(...) __android_log_print(ANDROID_LOG_DEBUG, C_SOUND_LOADER, __VA_ARGS__)
-#define LOG_ERROR(...) __android_log_print(ANDROID_LOG_ERROR, C_SOUND_LOADER, __VA_ARGS__)
+#define LOG_DEBUG(...) logPrint(LogLevel::Debug, C_SOUND_LOADER, __VA_ARGS__)
+#define LOG_ERROR(...) logPrint(LogLevel::Error, C_SOUND_LOADER, __VA_ARGS__)
 
 typedef std::pair<ALuint, ALuint> ALuint_p;
 
+// Optional services used by LoadSound, all of them may be left unset
+struct SoundLoadOptions {
+    PcmCache *cache = nullptr;
+    const std::atomic<bool> *cancelled = nullptr;
+    // Decode and split buffers come from here, instead of the heap
+    ScratchArena *scratch = nullptr;
+    // Sample rate to convert to at load time (the device's mixing rate), 0 keeps the file's rate
+    int targetRate = 0;
+    /* Lets uncached tracks over PROGRESSIVE_MIN_SECONDS start playing from a
+     * progressive stream, which decodes the rest in the background
+     */
+    bool progressive = false;
+};
+
+// Frames decoded per step, a cancelled load stops within one step
+constexpr sf_count_t LOAD_CHUNK_FRAMES = 65536;
+
 enum FormatType {
     Int16,
     Float,
@@ -23,7 +57,7 @@ enum FormatType {
     MSADPCM
 };
 
-ALenum getALFormat(FormatType sample_format) {
+inline ALenum getALFormat(FormatType sample_format) {
     if (sample_format == Int16)
         return AL_FORMAT_MONO16;
     else if (sample_format == Float)
@@ -35,34 +69,65 @@ ALenum getALFormat(FormatType sample_format) {
     return AL_NONE;
 }
 
+// Subformats that should be decoded as float when AL_EXT_FLOAT32 is available
+inline bool prefersFloatSamples(int sfformat) {
+    switch(sfformat&SF_FORMAT_SUBMASK)
+    {
+        case SF_FORMAT_PCM_24:
+        case SF_FORMAT_PCM_32:
+        case SF_FORMAT_FLOAT:
+        case SF_FORMAT_DOUBLE:
+        case SF_FORMAT_VORBIS:
+        case SF_FORMAT_OPUS:
+        case SF_FORMAT_ALAC_20:
+        case SF_FORMAT_ALAC_24:
+        case SF_FORMAT_ALAC_32:
+        case 0x0080/*SF_FORMAT_MPEG_LAYER_I*/:
+        case 0x0081/*SF_FORMAT_MPEG_LAYER_II*/:
+        case 0x0082/*SF_FORMAT_MPEG_LAYER_III*/:
+            return true;
+    }
+    return false;
+}
+
+// Stores the decoded planes in the PCM cache, if this load has a cache key
+inline void cachePlanes(PcmCache *cache, const std::string &cacheKey, ALenum format, const SF_INFO &sfinfo,
+                        const void *const *planes, uint64_t planeBytes, uint64_t frames) {
+    if(cache && !cacheKey.empty())
+        cache->store(cacheKey, format, sfinfo.channels, sfinfo.samplerate, frames, planes, planeBytes);
+}
+
 //I need to load stereo sounds separately in 2 different buffers to have a custom stereo angles, since the one from the extension disables distance
 template <typename T>
-static ALuint_p processStereoSound(T* tempBuffer, SF_INFO sfinfo, ALenum format, ALsizei num_bytes) {
+inline ALuint_p processStereoSound(ScratchBuffer &tempBuffer, SF_INFO sfinfo, ALenum format, ALsizei num_bytes,
+                                   const SoundLoadOptions &options, PcmCache *cache, const std::string &cacheKey) {
+    static_assert(std::is_same<T, short>::value || std::is_same<T, float>::value,
+                  "Only PCM frames can be split by sample, block formats are decoded first");
     ALuint_p buffers = {AL_NONE, AL_NONE};
 
-    LOG_DEBUG("Allocating left and right buffers for stereo processing: frames = %lld, bytes allocated = %lld", sfinfo.frames, sfinfo.frames * sizeof(T));
-    void *leftMembuf = malloc(sfinfo.frames * sizeof(T));
-    void *rightMembuf = malloc(sfinfo.frames * sizeof(T));
+    // Split by the bytes actually read, in case the decode stopped short
+    size_t frames = (size_t)num_bytes / (2 * sizeof(T));
+
+    LOG_DEBUG("Allocating split buffer for stereo processing: frames = %zu, bytes allocated = %zu", frames, frames * 2 * sizeof(T));
+    ScratchBuffer splitMembuf = ScratchArena::acquire(options.scratch, frames * 2 * sizeof(T));
 
     // Check for memory allocation failure
-    if (!leftMembuf || !rightMembuf) {
-        LOG_ERROR("Failed to allocate memory for left or right buffers");
-        free(leftMembuf);
-        free(rightMembuf);
-        free(tempBuffer);
+    if (!splitMembuf) {
+        LOG_ERROR("Failed to allocate memory for the split buffer");
         return {AL_NONE, AL_NONE};
     }
 
-    T *leftChannel = (T *)leftMembuf;
-    T *rightChannel = (T *)rightMembuf;
+    // Left channel goes in the first half, right channel in the second one
+    T *leftChannel = splitMembuf.as<T>();
+    T *rightChannel = leftChannel + frames;
 
-    LOG_DEBUG("Processing stereo channels for %lld frames", sfinfo.frames);
-    for (sf_count_t i = 0; i < sfinfo.frames; i++) {
-        leftChannel[i] = tempBuffer[2 * i];      // left channel sample
-        rightChannel[i] = tempBuffer[2 * i + 1]; // right channel sample
+    LOG_DEBUG("Processing stereo channels for %zu frames (%s)", frames, getDeinterleaveKernels().name);
+    {
+        TRACE_SCOPE("LoadSound deinterleave");
+        deinterleaveStereo(tempBuffer.as<T>(), leftChannel, rightChannel, frames);
     }
 
-    free(tempBuffer); // Free original tempBuffer after copying data to left/right buffers
+    tempBuffer.reset(); // Give the interleaved buffer back before uploading, it's no longer needed
 
     /* Generate OpenAL buffers for left and right channels */
     alGenBuffers(1, &buffers.first);
@@ -70,21 +135,21 @@ static ALuint_p processStereoSound(T* tempBuffer, SF_INFO sfinfo, ALenum format,
 
     if (buffers.first == AL_NONE || buffers.second == AL_NONE) {
         LOG_ERROR("Failed to generate OpenAL buffers");
-        free(leftMembuf);
-        free(rightMembuf);
         return {AL_NONE, AL_NONE};
     }
 
-    // Ensure correct data size
-    LOG_DEBUG("Buffering left channel: num_bytes = %d", num_bytes);
-    alBufferData(buffers.first, format, leftMembuf, num_bytes/2, sfinfo.samplerate);
+    ALsizei channel_bytes = (ALsizei)(frames * sizeof(T));
+    TraceScope upload("LoadSound alBufferData");
+    LOG_DEBUG("Buffering left channel: num_bytes = %d", channel_bytes);
+    alBufferData(buffers.first, format, leftChannel, channel_bytes, sfinfo.samplerate);
 
-    LOG_DEBUG("Buffering right channel: num_bytes = %d", num_bytes);
-    alBufferData(buffers.second, format, rightMembuf, num_bytes/2, sfinfo.samplerate);
+    LOG_DEBUG("Buffering right channel: num_bytes = %d", channel_bytes);
+    alBufferData(buffers.second, format, rightChannel, channel_bytes, sfinfo.samplerate);
+    upload.end();
 
-    // Clean up memory buffers
-    free(leftMembuf);
-    free(rightMembuf);
+    const void *planes[2] = {leftChannel, rightChannel};
+    cachePlanes(cache, cacheKey, format, sfinfo, planes, (uint64_t)channel_bytes, frames);
+    splitMembuf.reset();
 
     /* Check for OpenAL errors */
     ALenum err = alGetError();
@@ -101,53 +166,387 @@ static ALuint_p processStereoSound(T* tempBuffer, SF_INFO sfinfo, ALenum format,
     return buffers;
 }
 
-static ALuint_p LoadSound(const char *filename) {
+/* Converts the decoded interleaved frames to targetRate, replacing membuf.
+ * Returns the new frame count, or 0 if the conversion buffer can't be allocated.
+ */
+template <typename T>
+inline sf_count_t resampleFrames(ScratchBuffer &membuf, sf_count_t frames, int channels, int samplerate, int targetRate,
+                                 ScratchArena *scratch) {
+    Resampler resampler((uint32_t)samplerate, (uint32_t)targetRate);
+    size_t outFrames = resampler.getOutputFrames((size_t)frames);
+    if(outFrames > (size_t)(INT_MAX / (channels * sizeof(T))))
+        return 0;
+
+    ScratchBuffer resampled = ScratchArena::acquire(scratch, outFrames * channels * sizeof(T));
+    if(!resampled)
+        return 0;
+    resampler.process(membuf.as<const T>(), (size_t)frames, resampled.as<T>(), channels);
+
+    membuf = std::move(resampled);
+    return (sf_count_t)outFrames;
+}
+
+/* Buffers of a track split in chunks, one list per channel, deleted once the
+ * last owner lets go. Kept readable (persistent read mapping) when shared.
+ */
+struct ChunkBuffers {
+    std::vector<ALuint> ids[2];
+
+    ChunkBuffers() = default;
+    ChunkBuffers(const ChunkBuffers &) = delete;
+    ChunkBuffers &operator=(const ChunkBuffers &) = delete;
+
+    ~ChunkBuffers() {
+        for(std::vector<ALuint> &channel : ids)
+        {
+            if(!channel.empty())
+                alDeleteBuffers((ALsizei)channel.size(), channel.data());
+        }
+    }
+};
+
+// Whole track decoded by a progressive stream, still in the stream's chunk buffers
+struct DecodedTrack {
+    SF_INFO sfinfo;
+    FormatType sampleFormat; // Int16 or Float
+    sf_count_t frames;
+    std::shared_ptr<const ChunkBuffers> chunks;
+};
+
+// Copies the chunks of one channel back to back into out, returns the bytes copied
+inline size_t readChunks(const std::vector<ALuint> &chunks, char *out, size_t capacity) {
+    const ALbitfieldSOFT access = AL_MAP_READ_BIT_SOFT | AL_MAP_PERSISTENT_BIT_SOFT;
+    size_t total = 0;
+    for(ALuint chunk : chunks)
+    {
+        ALint size = 0;
+        alGetBufferi(chunk, AL_SIZE, &size);
+        if(size <= 0 || (size_t)size > capacity - total)
+            return 0;
+        const void *data = alMapBufferSOFT(chunk, 0, size, access);
+        if(!data)
+            return 0;
+        memcpy(out + total, data, (size_t)size);
+        alUnmapBufferSOFT(chunk);
+        total += (size_t)size;
+    }
+    return total;
+}
+
+/* Uploads a decoded track to new buffers the way LoadSound would have loaded
+ * it, converted to targetRate (0 keeps the file's rate), and stores it in the
+ * PCM cache. The chunks are copied straight into the mapped new buffers, only
+ * a conversion needs a contiguous input plane, one channel at a time.
+ * Needs AL_SOFT_map_buffer, returns {AL_NONE, AL_NONE} on failure.
+ */
+inline ALuint_p uploadDecodedTrack(const DecodedTrack &track, int targetRate, PcmCache *cache,
+                                   const std::string &cacheKey, ScratchArena *scratch) {
+    TRACE_SCOPE("Upload decoded track");
+    SF_INFO sfinfo = track.sfinfo;
+    size_t sampleSize = (track.sampleFormat == Float) ? sizeof(float) : sizeof(short);
+    sf_count_t frames = track.frames;
+    size_t inBytes = (size_t)track.frames * sampleSize;
+    if(!track.chunks || !loadBufferMapping())
+        return {AL_NONE, AL_NONE};
+
+    bool resample = targetRate > 0 && targetRate != sfinfo.samplerate;
+    Resampler resampler((uint32_t)sfinfo.samplerate, (uint32_t)(resample ? targetRate : sfinfo.samplerate));
+    if(resample)
+        frames = (sf_count_t)resampler.getOutputFrames((size_t)track.frames);
+    if(frames < 1 || frames > (sf_count_t)(INT_MAX / sampleSize))
+        return {AL_NONE, AL_NONE};
+    if(resample)
+        sfinfo.samplerate = targetRate;
+
+    // The planes are read back from the mapping to fill the PCM cache
+    ALenum format = getALFormat(track.sampleFormat);
+    ALsizei planeBytes = (ALsizei)((size_t)frames * sampleSize);
+    ALbitfieldSOFT access = AL_MAP_WRITE_BIT_SOFT;
+    if(cache && !cacheKey.empty())
+        access |= AL_MAP_READ_BIT_SOFT;
+
+    ALuint generated[2] = {AL_NONE, AL_NONE};
+    char *planes[2] = {nullptr, nullptr};
+    alGenBuffers(sfinfo.channels, generated);
+    for(int c = 0; c < sfinfo.channels; c++)
+    {
+        alBufferStorageSOFT(generated[c], format, nullptr, planeBytes, sfinfo.samplerate, access);
+        planes[c] = (char *)alMapBufferSOFT(generated[c], 0, planeBytes, access);
+    }
+
+    bool filled = alGetError() == AL_NO_ERROR;
+    for(int c = 0; c < sfinfo.channels && filled; c++)
+    {
+        if(!planes[c])
+        {
+            filled = false;
+            break;
+        }
+        if(!resample)
+        {
+            filled = readChunks(track.chunks->ids[c], planes[c], (size_t)planeBytes) == inBytes;
+            continue;
+        }
+
+        // Every plane is converted on its own, like the interleaved channels of a load
+        ScratchBuffer input = ScratchArena::acquire(scratch, inBytes);
+        filled = input && readChunks(track.chunks->ids[c], input.as<char>(), inBytes) == inBytes;
+        if(!filled)
+            break;
+        if(track.sampleFormat == Float)
+            resampler.process(input.as<const float>(), (size_t)track.frames, (float *)planes[c], 1);
+        else
+            resampler.process(input.as<const short>(), (size_t)track.frames, (short *)planes[c], 1);
+    }
+
+    if(filled)
+    {
+        const void *cached[2] = {planes[0], planes[1]};
+        cachePlanes(cache, cacheKey, format, sfinfo, cached, (uint64_t)planeBytes, (uint64_t)frames);
+    }
+    for(int c = 0; c < sfinfo.channels; c++)
+    {
+        if(planes[c])
+            alUnmapBufferSOFT(generated[c]);
+    }
+
+    ALenum err = alGetError();
+    if(!filled || err != AL_NO_ERROR)
+    {
+        LOG_ERROR("Could not upload a decoded track: %s", filled ? alGetString(err) : "reading the chunks failed");
+        alDeleteBuffers(sfinfo.channels, generated);
+        alGetError();
+        return {AL_NONE, AL_NONE};
+    }
+    return {generated[0], generated[1]};
+}
+
+/* Identifies what LoadSound would produce for a source with these options,
+ * returns false for sources without a stable identity (memory regions).
+ */
+inline bool getLoadKey(const SoundSource &source, const SoundLoadOptions &options, std::string &key) {
+    if(!source.getIdentity(key))
+        return false;
+    // Loads converted to a mixing rate are kept apart from the native rate ones
+    if(options.targetRate > 0)
+        key += "|@" + std::to_string(options.targetRate);
+    return true;
+}
+
+// Builds the PCM cache key of a source, returns false if the load can't use the cache
+inline bool getCacheKey(const SoundSource &source, const SoundLoadOptions &options, std::string &key) {
+    return options.cache && options.cache->isEnabled() && getLoadKey(source, options, key);
+}
+
+// True if LoadSound would be served from the PCM cache
+inline bool isSoundCached(const SoundSource &source, const SoundLoadOptions &options) {
+    std::string key;
+    return getCacheKey(source, options, key) && options.cache->contains(key);
+}
+
+inline sf_count_t readFrames(SNDFILE *sndfile, short *ptr, sf_count_t frames) {
+    return sf_readf_short(sndfile, ptr, frames);
+}
+
+inline sf_count_t readFrames(SNDFILE *sndfile, float *ptr, sf_count_t frames) {
+    return sf_readf_float(sndfile, ptr, frames);
+}
+
+inline bool isLoadCancelled(const SoundLoadOptions &options) {
+    return options.cancelled && options.cancelled->load(std::memory_order_relaxed);
+}
+
+// Reports the decode throughput from a start taken with traceNowNs(), 0 if tracing was off then
+inline void traceDecodeThroughput(int64_t startNs, uint64_t bytes) {
+    int64_t elapsedNs = traceNowNs() - startNs;
+    if(startNs > 0 && elapsedNs > 0)
+        traceCounter(TraceCounter::DecodeBytesPerSecond, (int64_t)((double)bytes * 1e9 / (double)elapsedNs));
+}
+
+// Reads interleaved frames one chunk at a time, stopping early if the load gets cancelled
+template <typename T>
+inline sf_count_t readFramesChunked(SNDFILE *sndfile, T *ptr, sf_count_t frames, int channels,
+                                    const SoundLoadOptions &options) {
+    sf_count_t total = 0;
+    while(total < frames && !isLoadCancelled(options))
+    {
+        sf_count_t read = readFrames(sndfile, ptr + total * channels, std::min(LOAD_CHUNK_FRAMES, frames - total));
+        if(read < 1)
+            break;
+        total += read;
+    }
+    return total;
+}
+
+/* Decodes straight into OpenAL-owned memory with AL_SOFT_map_buffer, so the
+ * only full-size copy of the track is the one in the AL buffers. Returns false
+ * (leaving the file untouched) if the storage couldn't be mapped or the stereo
+ * split chunk allocated, in which case the regular decode + alBufferData path
+ * has to be used instead.
+ */
+template <typename T>
+inline bool loadMappedSound(SNDFILE *sndfile, const SF_INFO &sfinfo, ALenum format, ALuint_p &buffers,
+                            const SoundLoadOptions &options, const std::string &cacheKey) {
+    PcmCache *cache = options.cache;
+    if(sfinfo.channels != 1 && sfinfo.channels != 2)
+        return false;
+
+    // Stereo is read interleaved a chunk at a time, then split into the mapped planes
+    ScratchBuffer chunk;
+    if(sfinfo.channels == 2)
+    {
+        chunk = ScratchArena::acquire(options.scratch, LOAD_CHUNK_FRAMES * 2 * sizeof(T));
+        if(!chunk)
+        {
+            LOG_DEBUG("Could not allocate the split chunk, using the copying path");
+            return false;
+        }
+    }
+
+    ALuint ids[2] = {AL_NONE, AL_NONE};
+    T *planes[2] = {nullptr, nullptr};
+    ALsizei channel_bytes = (ALsizei)(sfinfo.frames * sizeof(T));
+    // The planes are read back from the mapping to fill the PCM cache
+    ALbitfieldSOFT access = AL_MAP_WRITE_BIT_SOFT;
+    if(cache && !cacheKey.empty())
+        access |= AL_MAP_READ_BIT_SOFT;
+
+    alGenBuffers(sfinfo.channels, ids);
+    for(int c = 0; c < sfinfo.channels; c++)
+    {
+        alBufferStorageSOFT(ids[c], format, nullptr, channel_bytes, sfinfo.samplerate, access);
+        planes[c] = (T *)alMapBufferSOFT(ids[c], 0, channel_bytes, access);
+    }
+
+    if(alGetError() != AL_NO_ERROR || !planes[0] || (sfinfo.channels == 2 && !planes[1]))
+    {
+        LOG_DEBUG("Could not map buffer storage, using the copying path");
+        for(int c = 0; c < sfinfo.channels; c++)
+        {
+            if(planes[c])
+                alUnmapBufferSOFT(ids[c]);
+        }
+        alDeleteBuffers(sfinfo.channels, ids);
+        alGetError();
+        return false;
+    }
+
+    // Decoding and deinterleaving go chunk by chunk here, they are traced as one phase
+    TraceScope decode("LoadSound decode mapped");
+    int64_t decodeStart = isTracing() ? traceNowNs() : 0;
+    sf_count_t num_frames = 0;
+    if(sfinfo.channels == 1)
+        num_frames = readFramesChunked(sndfile, planes[0], sfinfo.frames, 1, options);
+    else
+    {
+        while(num_frames < sfinfo.frames && !isLoadCancelled(options))
+        {
+            sf_count_t count = std::min(LOAD_CHUNK_FRAMES, sfinfo.frames - num_frames);
+            sf_count_t read = readFrames(sndfile, chunk.as<T>(), count);
+            if(read < 1)
+                break;
+            deinterleaveStereo(chunk.as<T>(), planes[0] + num_frames, planes[1] + num_frames, (size_t)read);
+            num_frames += read;
+        }
+    }
+    if(num_frames < 0 || isLoadCancelled(options))
+        num_frames = 0;
+    decode.end();
+    if(decodeStart)
+        traceDecodeThroughput(decodeStart, (uint64_t)num_frames * sfinfo.channels * sizeof(T));
+
+    // The frame count is only an estimate for some formats (MP3), pad any missing tail with silence
+    if(num_frames > 0 && num_frames < sfinfo.frames)
+    {
+        LOG_DEBUG("Decoded %" PRId64 " of %" PRId64 " frames, padding with silence", (int64_t)num_frames, (int64_t)sfinfo.frames);
+        for(int c = 0; c < sfinfo.channels; c++)
+            memset(planes[c] + num_frames, 0, (size_t)(sfinfo.frames - num_frames) * sizeof(T));
+    }
+
+    if(num_frames > 0)
+    {
+        const void *cached[2] = {planes[0], planes[1]};
+        cachePlanes(cache, cacheKey, format, sfinfo, cached, (uint64_t)channel_bytes, (uint64_t)sfinfo.frames);
+    }
+
+    for(int c = 0; c < sfinfo.channels; c++)
+        alUnmapBufferSOFT(ids[c]);
+
+    ALenum err = alGetError();
+    if(isLoadCancelled(options))
+    {
+        LOG_DEBUG("Load cancelled while decoding into mapped buffers");
+        alDeleteBuffers(sfinfo.channels, ids);
+        buffers = {AL_NONE, AL_NONE};
+        return true;
+    }
+    if(num_frames < 1 || err != AL_NO_ERROR)
+    {
+        LOG_ERROR("Failed to decode into mapped buffers (frames: %" PRId64 ", error: %s)", (int64_t)num_frames, alGetString(err));
+        alDeleteBuffers(sfinfo.channels, ids);
+        buffers = {AL_NONE, AL_NONE};
+        return true;
+    }
+
+    buffers = {ids[0], ids[1]};
+    return true;
+}
+
+inline ALuint_p LoadSound(const SoundSource &source, const SoundLoadOptions &options = {}) {
+    TRACE_SCOPE("LoadSound");
+    const char *filename = source.describe().c_str();
     enum FormatType sample_format = Int16;
     ALint byteblockalign = 0;
     ALint splblockalign = 0;
     sf_count_t num_frames;
     ALenum err, format;
     ALsizei num_bytes;
+    SoundSourceFile file;
     SNDFILE *sndfile;
     SF_INFO sfinfo;
     ALuint_p buffers = {AL_NONE, AL_NONE};
-    void *membuf;
+    ScratchBuffer membuf;
+
+    /* A cache hit maps the already decoded and split planes, without touching
+     * the codec at all.
+     */
+    std::string cacheKey;
+    if(getCacheKey(source, options, cacheKey))
+    {
+        if(options.cache->load(cacheKey, buffers))
+        {
+            LOG_DEBUG("Loaded %s from the PCM cache", filename);
+            return buffers;
+        }
+    }
 
     /* Open the audio file and check that it's usable. */
-    sndfile = sf_open(filename, SFM_READ, &sfinfo);
+    TraceScope phase("LoadSound open");
+    sfinfo.format = 0;
+    sndfile = file.open(source, &sfinfo);
+    phase.end();
     if(!sndfile)
     {
-        __android_log_print(ANDROID_LOG_VERBOSE, C_SOUND_LOADER, "Could not open audio in %s: %s\n", filename, sf_strerror(sndfile));
+        logPrint(LogLevel::Verbose, C_SOUND_LOADER, "Could not open audio in %s: %s\n", filename, sf_strerror(sndfile));
         return buffers;
     }
     if(sfinfo.frames < 1)
     {
-        __android_log_print(ANDROID_LOG_VERBOSE, C_SOUND_LOADER, "Bad sample count in %s (%" PRId64 ")\n", filename, sfinfo.frames);
+        logPrint(LogLevel::Verbose, C_SOUND_LOADER, "Bad sample count in %s (%" PRId64 ")\n", filename, sfinfo.frames);
         sf_close(sndfile);
         return buffers;
     }
 
+    TraceScope sniff("LoadSound format sniff");
     /* Detect a suitable format to load. Formats like Vorbis and Opus use float
      * natively, so load as float to avoid clipping when possible. Formats
      * larger than 16-bit can also use float to preserve a bit more precision.
      */
+    if(prefersFloatSamples(sfinfo.format) && alIsExtensionPresent("AL_EXT_FLOAT32"))
+        sample_format = Float;
+
     switch((sfinfo.format&SF_FORMAT_SUBMASK))
     {
-        case SF_FORMAT_PCM_24:
-        case SF_FORMAT_PCM_32:
-        case SF_FORMAT_FLOAT:
-        case SF_FORMAT_DOUBLE:
-        case SF_FORMAT_VORBIS:
-        case SF_FORMAT_OPUS:
-        case SF_FORMAT_ALAC_20:
-        case SF_FORMAT_ALAC_24:
-        case SF_FORMAT_ALAC_32:
-        case 0x0080/*SF_FORMAT_MPEG_LAYER_I*/:
-        case 0x0081/*SF_FORMAT_MPEG_LAYER_II*/:
-        case 0x0082/*SF_FORMAT_MPEG_LAYER_III*/:
-            if(alIsExtensionPresent("AL_EXT_FLOAT32"))
-                sample_format = Float;
-            break;
         case SF_FORMAT_IMA_ADPCM:
             /* ADPCM formats require setting a block alignment as specified in the
              * file, which needs to be read from the wave 'fmt ' chunk manually
@@ -166,6 +565,13 @@ static ALuint_p LoadSound(const char *filename) {
             break;
     }
 
+    /* Stereo files get split into a buffer per channel, which can't be done
+     * on ADPCM blocks (they interleave the channels per block, not per
+     * sample), so have libsndfile decode those to 16-bit.
+     */
+    if(sfinfo.channels == 2 && (sample_format == IMA4 || sample_format == MSADPCM))
+        sample_format = Int16;
+
     if(sample_format == IMA4 || sample_format == MSADPCM)
     {
         /* For ADPCM, lookup the wave file's "fmt " chunk, which is a
@@ -181,9 +587,12 @@ static ALuint_p LoadSound(const char *filename) {
             sample_format = Int16;
         else
         {
-            ALubyte *fmtbuf = (ALubyte *)calloc(inf.datalen, 1);
+            ScratchBuffer fmtchunk = ScratchArena::acquire(options.scratch, inf.datalen);
+            ALubyte *fmtbuf = fmtchunk.as<ALubyte>();
+            if(fmtbuf)
+                memset(fmtbuf, 0, inf.datalen);
             inf.data = fmtbuf;
-            if(sf_get_chunk_data(iter, &inf) != SF_ERR_NO_ERROR)
+            if(!fmtbuf || sf_get_chunk_data(iter, &inf) != SF_ERR_NO_ERROR)
                 sample_format = Int16;
             else
             {
@@ -207,7 +616,6 @@ static ALuint_p LoadSound(const char *filename) {
                         sample_format = Int16;
                 }
             }
-            free(fmtbuf);
         }
     }
 
@@ -224,74 +632,129 @@ static ALuint_p LoadSound(const char *filename) {
 
     /* Figure out the OpenAL format from the file and desired sample type. */
     format = getALFormat(sample_format);
+    sniff.end();
     if(!format)
     {
-        __android_log_print(ANDROID_LOG_VERBOSE, C_SOUND_LOADER, "Unsupported channel count: %d\n", sfinfo.channels);
+        logPrint(LogLevel::Verbose, C_SOUND_LOADER, "Unsupported channel count: %d\n", sfinfo.channels);
         sf_close(sndfile);
         return buffers;
     }
 
     if(sfinfo.frames/splblockalign > (sf_count_t)(INT_MAX/byteblockalign))
     {
-        __android_log_print(ANDROID_LOG_VERBOSE, C_SOUND_LOADER, "Too many samples in %s (%" PRId64 ")\n", filename, sfinfo.frames);
+        logPrint(LogLevel::Verbose, C_SOUND_LOADER, "Too many samples in %s (%" PRId64 ")\n", filename, sfinfo.frames);
         sf_close(sndfile);
         return buffers;
     }
 
+    /* Converting to the mixing rate here means the mixer plays the buffers
+     * without resampling them on every period.
+     */
+    bool resample = options.targetRate > 0 && options.targetRate != sfinfo.samplerate
+                    && (sample_format == Int16 || sample_format == Float);
+
+    /* Decode directly into the AL buffers if they can be mapped, otherwise
+     * decode to a temporary buffer that gets copied by alBufferData.
+     */
+    if(!resample && (sample_format == Int16 || sample_format == Float) && loadBufferMapping())
+    {
+        bool mapped = (sample_format == Int16)
+                      ? loadMappedSound<short>(sndfile, sfinfo, format, buffers, options, cacheKey)
+                      : loadMappedSound<float>(sndfile, sfinfo, format, buffers, options, cacheKey);
+        if(mapped)
+        {
+            sf_close(sndfile);
+            return buffers;
+        }
+    }
+
     /* Decode the whole audio file to a buffer. */
-    membuf = malloc((size_t)(sfinfo.frames / splblockalign * byteblockalign));
+    membuf = ScratchArena::acquire(options.scratch, (size_t)(sfinfo.frames / splblockalign * byteblockalign));
+    if(!membuf)
+    {
+        LOG_ERROR("Failed to allocate the decode buffer for %s", filename);
+        sf_close(sndfile);
+        return buffers;
+    }
 
+    TraceScope decode("LoadSound decode");
+    int64_t decodeStart = isTracing() ? traceNowNs() : 0;
     if(sample_format == Int16)
-        num_frames = sf_readf_short(sndfile, (short *)membuf, sfinfo.frames);
+        num_frames = readFramesChunked(sndfile, membuf.as<short>(), sfinfo.frames, sfinfo.channels, options);
     else if(sample_format == Float)
-        num_frames = sf_readf_float(sndfile, (float *)membuf, sfinfo.frames);
+        num_frames = readFramesChunked(sndfile, membuf.as<float>(), sfinfo.frames, sfinfo.channels, options);
     else {
         sf_count_t count = sfinfo.frames / splblockalign * byteblockalign;
-        num_frames = sf_read_raw(sndfile, membuf, count);
+        num_frames = sf_read_raw(sndfile, membuf.data(), count);
         if(num_frames > 0)
             num_frames = num_frames / byteblockalign * splblockalign;
     }
 
     sf_close(sndfile);
+    decode.end();
+    if(decodeStart && num_frames > 0)
+        traceDecodeThroughput(decodeStart, (uint64_t)(num_frames / splblockalign * byteblockalign));
 
+    if(isLoadCancelled(options))
+    {
+        LOG_DEBUG("Load of %s cancelled", filename);
+        return buffers;
+    }
     if(num_frames < 1)
     {
-        free(membuf);
-        __android_log_print(ANDROID_LOG_VERBOSE, C_SOUND_LOADER, "Failed to read samples in %s (%" PRId64 ")\n", filename, num_frames);
+        logPrint(LogLevel::Verbose, C_SOUND_LOADER, "Failed to read samples in %s (%" PRId64 ")\n", filename, num_frames);
         return buffers;
     }
+    if(resample)
+    {
+        TRACE_SCOPE("LoadSound resample");
+        LOG_DEBUG("Resampling %s from %d to %d Hz", filename, sfinfo.samplerate, options.targetRate);
+        num_frames = (sample_format == Int16)
+                     ? resampleFrames<short>(membuf, num_frames, sfinfo.channels, sfinfo.samplerate, options.targetRate, options.scratch)
+                     : resampleFrames<float>(membuf, num_frames, sfinfo.channels, sfinfo.samplerate, options.targetRate, options.scratch);
+        if(num_frames < 1)
+        {
+            LOG_ERROR("Failed to resample %s", filename);
+            return buffers;
+        }
+        sfinfo.samplerate = options.targetRate;
+    }
     num_bytes = (ALsizei)(num_frames / splblockalign * byteblockalign);
 
     /* Buffer the audio data into a new buffer object, then free the data and
      * close the file.
      */
     if (sfinfo.channels > 2 || sfinfo.channels < 1) {
-        free(membuf);
-        __android_log_print(ANDROID_LOG_ERROR, C_SOUND_LOADER, "More than 2 channels (or 0) detected, can't play this file\n");
+        logPrint(LogLevel::Error, C_SOUND_LOADER, "More than 2 channels (or 0) detected, can't play this file\n");
         return buffers;
     }
     else if (sfinfo.channels == 2) {
         if (sample_format == Int16)
-            buffers = processStereoSound((short *)membuf, sfinfo, format, num_bytes);
-        else if (sample_format == Float)
-            buffers = processStereoSound((float *)membuf, sfinfo, format, num_bytes);
+            buffers = processStereoSound<short>(membuf, sfinfo, format, num_bytes, options, options.cache, cacheKey);
         else
-            buffers = processStereoSound((char *)membuf, sfinfo, format, num_bytes); //is char correct here?
-        //membuf gets free'd in processStereoSound function
+            buffers = processStereoSound<float>(membuf, sfinfo, format, num_bytes, options, options.cache, cacheKey);
+        //membuf is given back in processStereoSound function
     }
     else {
+        TraceScope upload("LoadSound alBufferData");
         alGenBuffers(1, &buffers.first);
         if(splblockalign > 1)
             alBufferi(buffers.first, AL_UNPACK_BLOCK_ALIGNMENT_SOFT, splblockalign);
-        alBufferData(buffers.first, format, membuf, num_bytes, sfinfo.samplerate);
-        free(membuf);
+        alBufferData(buffers.first, format, membuf.data(), num_bytes, sfinfo.samplerate);
+        upload.end();
+        if(sample_format == Int16 || sample_format == Float)
+        {
+            const void *planes[2] = {membuf.data(), nullptr};
+            cachePlanes(options.cache, cacheKey, format, sfinfo, planes, (uint64_t)num_bytes, (uint64_t)num_frames);
+        }
+        membuf.reset();
     }
 
     /* Check if an error occurred, and clean up if so. */
     err = alGetError();
     if(err != AL_NO_ERROR)
     {
-        __android_log_print(ANDROID_LOG_VERBOSE, C_SOUND_LOADER, "OpenAL Error: %s\n", alGetString(err));
+        logPrint(LogLevel::Verbose, C_SOUND_LOADER, "OpenAL Error: %s\n", alGetString(err));
         if(buffers.first && alIsBuffer(buffers.first))
             alDeleteBuffers(1, &buffers.first);
         if(buffers.second && alIsBuffer(buffers.second))
@@ -301,3 +764,5 @@ static ALuint_p LoadSound(const char *filename) {
 
     return buffers;
 }
+
+#endif //INC_8DMUSICPLAYER_SOUNDLOADER_H
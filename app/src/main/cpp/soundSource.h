@@ -0,0 +1,183 @@
+#ifndef INC_8DMUSICPLAYER_SOUNDSOURCE_H
+#define INC_8DMUSICPLAYER_SOUNDSOURCE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "sndfile.h"
+
+/* Where a sound is read from: a file path, a range of a file descriptor (as
+ * given by an AssetFileDescriptor), or a memory region. The descriptor or
+ * memory is kept alive by keepAlive for as long as any copy of the source
+ * exists, so streams can keep reading from it.
+ */
+struct SoundSource {
+    std::string path;
+    std::string name;   // used for logs and IDs when there is no path
+    int fd = -1;
+    sf_count_t offset = 0;
+    sf_count_t length = 0;
+    const void *data = nullptr;
+    std::shared_ptr<void> keepAlive;
+
+    static SoundSource fromPath(const std::string &path) {
+        SoundSource source;
+        source.path = path;
+        source.name = path;
+        return source;
+    }
+
+    /* The descriptor is duplicated, so the caller keeps ownership of its own.
+     * A negative length means up to the end of the file.
+     */
+    static SoundSource fromFileDescriptor(int fd, sf_count_t offset, sf_count_t length, const std::string &name) {
+        SoundSource source;
+        source.name = name;
+        source.offset = offset;
+
+        int ownFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (ownFd < 0) return source;
+
+        struct stat st;
+        if (length < 0 && fstat(ownFd, &st) == 0)
+            length = (sf_count_t) st.st_size - offset;
+
+        source.fd = ownFd;
+        source.length = length < 0 ? 0 : length;
+        source.keepAlive = std::shared_ptr<void>(nullptr, [ownFd](void *) { close(ownFd); });
+        return source;
+    }
+
+    // keepAlive must own the memory (or keep its owner alive)
+    static SoundSource fromMemory(const void *data, size_t size, std::shared_ptr<void> keepAlive,
+                                  const std::string &name) {
+        SoundSource source;
+        source.name = name;
+        source.data = data;
+        source.length = (sf_count_t) size;
+        source.keepAlive = std::move(keepAlive);
+        return source;
+    }
+
+    bool isPath() const { return fd < 0 && data == nullptr; }
+
+    bool isValid() const { return isPath() ? !path.empty() : (fd >= 0 || data != nullptr); }
+
+    const std::string &describe() const { return name.empty() ? path : name; }
+
+    /* Identity of the underlying file for caching: path + size + mtime, or
+     * device + inode + mtime + range for descriptors. Memory regions have none.
+     */
+    bool getIdentity(std::string &key) const {
+        struct stat st;
+        char identity[160];
+        if (isPath()) {
+            if (stat(path.c_str(), &st) != 0) return false;
+            snprintf(identity, sizeof(identity), "|%" PRId64 "|%" PRId64 ".%09ld",
+                     (int64_t) st.st_size, (int64_t) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec);
+            key = path + identity;
+            return true;
+        }
+        if (fd >= 0) {
+            if (fstat(fd, &st) != 0) return false;
+            snprintf(identity, sizeof(identity), "fd:%" PRIu64 ":%" PRIu64 "|%" PRId64 "|%" PRId64 ".%09ld|%" PRId64 "+%" PRId64,
+                     (uint64_t) st.st_dev, (uint64_t) st.st_ino, (int64_t) st.st_size,
+                     (int64_t) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec, (int64_t) offset, (int64_t) length);
+            key = identity;
+            return true;
+        }
+        return false;
+    }
+};
+
+/* Read cursor over a SoundSource, descriptors and memory go through
+ * sf_open_virtual so nothing has to be copied to a temporary file first.
+ * Must outlive the SNDFILE it opened.
+ */
+class SoundSourceFile {
+private:
+    SoundSource m_source;
+    sf_count_t m_position;
+
+public:
+    SoundSourceFile() : m_position(0) {}
+
+    SoundSourceFile(const SoundSourceFile &) = delete;
+    SoundSourceFile &operator=(const SoundSourceFile &) = delete;
+
+    SNDFILE *open(const SoundSource &source, SF_INFO *sfinfo) {
+        m_source = source;
+        m_position = 0;
+        if (m_source.isPath())
+            return sf_open(m_source.path.c_str(), SFM_READ, sfinfo);
+        if (!m_source.isValid())
+            return nullptr;
+
+        static SF_VIRTUAL_IO virtualIo = {getLength, seek, read, nullptr, tell};
+        return sf_open_virtual(&virtualIo, SFM_READ, sfinfo, this);
+    }
+
+private:
+    static sf_count_t getLength(void *userData) {
+        return ((SoundSourceFile *) userData)->m_source.length;
+    }
+
+    static sf_count_t seek(sf_count_t offset, int whence, void *userData) {
+        auto *file = (SoundSourceFile *) userData;
+        sf_count_t position;
+        if (whence == SEEK_SET)
+            position = offset;
+        else if (whence == SEEK_CUR)
+            position = file->m_position + offset;
+        else if (whence == SEEK_END)
+            position = file->m_source.length + offset;
+        else
+            return -1;
+
+        if (position < 0 || position > file->m_source.length)
+            return -1;
+        file->m_position = position;
+        return position;
+    }
+
+    static sf_count_t read(void *ptr, sf_count_t count, void *userData) {
+        auto *file = (SoundSourceFile *) userData;
+        const SoundSource &source = file->m_source;
+        if (count > source.length - file->m_position)
+            count = source.length - file->m_position;
+        if (count <= 0)
+            return 0;
+
+        if (source.data) {
+            memcpy(ptr, (const char *) source.data + file->m_position, (size_t) count);
+            file->m_position += count;
+            return count;
+        }
+
+        // pread leaves the descriptor's own offset alone, so several sounds can share a file
+        sf_count_t total = 0;
+        while (total < count) {
+            ssize_t got = pread(source.fd, (char *) ptr + total, (size_t) (count - total),
+                                (off_t) (source.offset + file->m_position + total));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+            total += got;
+        }
+        file->m_position += total;
+        return total;
+    }
+
+    static sf_count_t tell(void *userData) {
+        return ((SoundSourceFile *) userData)->m_position;
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_SOUNDSOURCE_H
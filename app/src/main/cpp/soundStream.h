@@ -0,0 +1,571 @@
+#ifndef INC_8DMUSICPLAYER_SOUNDSTREAM_H
+#define INC_8DMUSICPLAYER_SOUNDSTREAM_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AL/al.h"
+#include "AL/alext.h"
+#include "sndfile.h"
+
+#include "playbackQueue.h"
+#include "sourceGroup.h"
+#include "soundLoader.h"
+#include "trace.h"
+
+// Frames decoded per chunk, this bounds the time until the first sound is heard
+constexpr sf_count_t STREAM_CHUNK_FRAMES = 16384;
+// Buffers queued per source, so about 1.5s of audio is kept ahead of the mixer at 44.1kHz
+constexpr int STREAM_NUM_BUFFERS = 4;
+// How often the feeder thread checks for processed buffers
+constexpr std::chrono::milliseconds STREAM_FEED_INTERVAL(20);
+// Progressive streams double their chunk size up to this, to keep the buffer count low
+constexpr sf_count_t PROGRESSIVE_MAX_CHUNK_FRAMES = 262144;
+// Decode time a progressive stream may take per feeder update, so other streams keep being fed
+constexpr std::chrono::milliseconds PROGRESSIVE_DECODE_BUDGET(10);
+
+enum class StreamEvent {
+    Underrun,      // the queue ran dry and the sources were restarted
+    DecodeError,   // a chunk couldn't be decoded or queued, or a seek failed
+};
+
+/* Decodes a sound file in fixed-size chunks into a small ring of OpenAL buffers
+ * queued on one (mono) or two (stereo, split left/right) sources, so memory
+ * stays constant regardless of the track length.
+ * In progressive mode the buffers are kept queued instead of being recycled:
+ * playback starts after the first chunk while the rest of the file keeps
+ * decoding, and once done the sources hold the whole track like a static sound.
+ * With a decoded handler set, the chunks are kept readable and handed over
+ * once the track is complete, so it can be cached like a static load.
+ * All methods are thread-safe, update() is called periodically by StreamFeeder.
+ */
+class SoundStream {
+private:
+    mutable std::mutex m_mutex;
+    SoundSourceFile m_file;
+    SNDFILE *m_sndfile;
+    SF_INFO m_sfinfo;
+    FormatType m_sampleFormat;
+    ALenum m_format;
+    size_t m_sampleSize;
+
+    SourceGroup m_sources;
+    ALuint m_buffers[2][STREAM_NUM_BUFFERS];
+    std::vector<ALuint> m_freeBuffers[2];
+    std::deque<ALsizei> m_queuedFrames;
+    std::shared_ptr<ChunkBuffers> m_retainedBuffers; // progressive mode, every chunk decoded so far
+
+    std::vector<char> m_decodeBuffer;
+    std::vector<char> m_splitBuffer;
+
+    sf_count_t m_baseFrame;      // file position of the first frame queued after the last seek
+    sf_count_t m_processedFrames; // frames already played and unqueued since the last seek
+    bool m_eof;
+    bool m_playing;
+
+    bool m_progressive;
+    sf_count_t m_chunkFrames;
+    sf_count_t m_decodedFrames;
+    sf_count_t m_pendingFrame;   // progressive mode, frame to resume from once it has been decoded
+    sf_count_t m_stoppedFrame;   // progressive mode, position of the stopped sources
+    std::function<void(StreamEvent)> m_eventHandler;
+    std::function<void(DecodedTrack)> m_decodedHandler;
+
+public:
+    SoundStream() : m_sndfile(nullptr), m_sfinfo(), m_sampleFormat(Int16), m_format(AL_NONE),
+                    m_sampleSize(0), m_buffers(),
+                    m_baseFrame(0), m_processedFrames(0), m_eof(false), m_playing(false),
+                    m_progressive(false), m_chunkFrames(STREAM_CHUNK_FRAMES), m_decodedFrames(0),
+                    m_pendingFrame(-1), m_stoppedFrame(0) {}
+
+    ~SoundStream() {
+        close();
+    }
+
+    SoundStream(const SoundStream &) = delete;
+    SoundStream &operator=(const SoundStream &) = delete;
+
+    // Called with the stream locked, mostly on the feeder thread, so it must return quickly
+    void setEventHandler(std::function<void(StreamEvent)> handler) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_eventHandler = std::move(handler);
+    }
+
+    /* Progressive mode, called once the whole file decoded without errors,
+     * with the stream locked on the feeder thread, so it must only pass the
+     * track on. The track shares the chunk buffers, they stay alive as long as
+     * it does. Set before start(), ignored without AL_SOFT_map_buffer.
+     */
+    void setDecodedHandler(std::function<void(DecodedTrack)> handler) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!loadBufferMapping()) {
+            LOG_DEBUG("Buffer mapping not supported, the progressive load won't be shared");
+            return;
+        }
+        m_decodedHandler = std::move(handler);
+    }
+
+    bool open(const SoundSource &source, bool progressive = false) {
+        TRACE_SCOPE("SoundStream open");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const char *filename = source.describe().c_str();
+        m_progressive = progressive;
+
+        m_sndfile = m_file.open(source, &m_sfinfo);
+        if (!m_sndfile) {
+            LOG_ERROR("Could not open audio stream in %s: %s", filename, sf_strerror(nullptr));
+            return false;
+        }
+        if (m_sfinfo.frames < 1 || m_sfinfo.channels < 1 || m_sfinfo.channels > 2) {
+            LOG_ERROR("Unsupported stream in %s (frames: %" PRId64 ", channels: %d)",
+                      filename, (int64_t) m_sfinfo.frames, m_sfinfo.channels);
+            sf_close(m_sndfile);
+            m_sndfile = nullptr;
+            return false;
+        }
+
+        // Block formats (ADPCM) are decoded to 16-bit by libsndfile when streaming
+        m_sampleFormat = (prefersFloatSamples(m_sfinfo.format) && alIsExtensionPresent("AL_EXT_FLOAT32"))
+                         ? Float : Int16;
+        m_sampleSize = (m_sampleFormat == Float) ? sizeof(float) : sizeof(short);
+        m_format = getALFormat(m_sampleFormat);
+
+        sf_count_t maxChunkFrames = m_progressive ? PROGRESSIVE_MAX_CHUNK_FRAMES : STREAM_CHUNK_FRAMES;
+        m_decodeBuffer.resize(maxChunkFrames * m_sfinfo.channels * m_sampleSize);
+        if (m_sfinfo.channels == 2)
+            m_splitBuffer.resize(maxChunkFrames * 2 * m_sampleSize);
+        if (m_progressive) {
+            m_retainedBuffers = std::make_shared<ChunkBuffers>();
+            return true;
+        }
+
+        for (int c = 0; c < m_sfinfo.channels; c++) {
+            alGenBuffers(STREAM_NUM_BUFFERS, m_buffers[c]);
+            m_freeBuffers[c].assign(m_buffers[c], m_buffers[c] + STREAM_NUM_BUFFERS);
+        }
+
+        ALenum err = alGetError();
+        if (err != AL_NO_ERROR) {
+            LOG_ERROR("OpenAL Error creating stream buffers: %s", alGetString(err));
+            closeLocked();
+            return false;
+        }
+        return true;
+    }
+
+    /* Attaches the sources, one per channel, and queues the first chunk, the
+     * remaining buffers are filled by the feeder thread.
+     */
+    bool start(const SourceGroup &sources) {
+        TRACE_SCOPE("SoundStream first chunk");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_sndfile || sources.size() != m_sfinfo.channels) return false;
+
+        m_sources = sources;
+        return queueChunk();
+    }
+
+    void update() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_sndfile || m_sources.empty()) return;
+        if (m_progressive) {
+            updateProgressive();
+            return;
+        }
+
+        // The sources stop by themselves when the queue runs dry, so they need a restart after an underrun
+        bool underrun = m_playing && m_sources.getState() == AL_STOPPED;
+
+        recycleProcessedBuffers();
+        while (!m_eof && !m_freeBuffers[0].empty()) {
+            if (!queueChunk()) break;
+        }
+
+        if (underrun && !m_queuedFrames.empty()) {
+            LOG_DEBUG("Stream underrun, restarting sources");
+            m_sources.play();
+            notify(StreamEvent::Underrun);
+        }
+    }
+
+    // Plays or pauses the sources, a progressive stream waiting for data starts once it arrives
+    void setPlaying(bool playing) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_playing = playing;
+        if (m_sources.empty()) return;
+
+        if (!playing) {
+            m_sources.pause();
+        } else if (m_progressive ? m_pendingFrame < 0 : !m_queuedFrames.empty()) {
+            m_sources.play();
+        }
+    }
+
+    /* Like setPlaying(true), with the sources starting at a device clock time.
+     * A progressive stream waiting for data starts once it arrives instead.
+     */
+    void playAt(const DeviceClock &clock, int64_t clockNs) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_playing = true;
+        if (m_sources.empty()) return;
+
+        if (m_progressive ? m_pendingFrame < 0 : !m_queuedFrames.empty()) {
+            clock.playAt(m_sources.size(), m_sources.data(), clockNs);
+        }
+    }
+
+    // Device clock time at which the last frame of the file will have played, false unless playing
+    bool getEndClock(const DeviceClock &clock, int64_t &endClockNs) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_sndfile || m_sources.empty() || m_sfinfo.samplerate <= 0) return false;
+        if (m_sources.getState() != AL_PLAYING) return false;
+
+        int64_t offset, clockNs;
+        if (!clock.getSourceClock(m_sources.leader(), offset, clockNs)) return false;
+        // A progressive queue starts at the start of the file, a ring at the last seek
+        int64_t frame = m_progressive ? offset : m_baseFrame + m_processedFrames + offset;
+        int64_t remaining = std::max<int64_t>(0, m_sfinfo.frames - frame);
+        endClockNs = clockNs + remaining * 1000000000 / m_sfinfo.samplerate;
+        return true;
+    }
+
+    void seek(float seconds) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_sndfile) return;
+
+        sf_count_t frame = (sf_count_t) (seconds * (float) m_sfinfo.samplerate);
+        if (frame < 0) frame = 0;
+        if (frame > m_sfinfo.frames) frame = m_sfinfo.frames;
+
+        if (m_progressive) {
+            m_sources.stop();
+            if (frame < m_decodedFrames) {
+                resumeAt(frame);
+            } else {
+                m_pendingFrame = frame;
+            }
+            return;
+        }
+
+        // Stopping marks every queued buffer as processed, detaching clears the queue
+        m_sources.stop();
+        for (int c = 0; c < m_sfinfo.channels; c++) {
+            alSourcei(m_sources[c], AL_BUFFER, 0);
+            m_freeBuffers[c].assign(m_buffers[c], m_buffers[c] + STREAM_NUM_BUFFERS);
+        }
+        m_queuedFrames.clear();
+
+        m_baseFrame = sf_seek(m_sndfile, frame, SEEK_SET);
+        if (m_baseFrame < 0) {
+            LOG_ERROR("Failed to seek stream to frame %" PRId64, (int64_t) frame);
+            notify(StreamEvent::DecodeError);
+            m_baseFrame = 0;
+            sf_seek(m_sndfile, 0, SEEK_SET);
+        }
+        m_processedFrames = 0;
+        m_eof = false;
+
+        if (queueChunk() && m_playing)
+            m_sources.play();
+    }
+
+    float getPlaybackTime() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_sources.empty()) return -1.0f;
+
+        if (m_progressive) {
+            // The queue is never unqueued, so the offset is relative to the start of the file
+            ALint state = m_sources.getState();
+            sf_count_t frame = m_pendingFrame >= 0 ? m_pendingFrame : m_stoppedFrame;
+            if (m_pendingFrame < 0 && (state == AL_PLAYING || state == AL_PAUSED)) {
+                ALint offset = 0;
+                alGetSourcei(m_sources.leader(), AL_SAMPLE_OFFSET, &offset);
+                frame = offset;
+            }
+            return (float) frame / (float) m_sfinfo.samplerate;
+        }
+
+        ALint offset = 0;
+        alGetSourcei(m_sources.leader(), AL_SAMPLE_OFFSET, &offset);
+        sf_count_t frame = m_baseFrame + m_processedFrames + offset;
+        return (float) frame / (float) m_sfinfo.samplerate;
+    }
+
+    float getDuration() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_sfinfo.samplerate > 0 ? (float) m_sfinfo.frames / (float) m_sfinfo.samplerate : 0.0f;
+    }
+
+    // True once the whole file has been decoded and every queued buffer was played
+    bool isFinished() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_sndfile || m_sources.empty()) return false;
+        if (m_progressive) {
+            return m_eof && m_pendingFrame < 0 && m_playing && m_sources.getState() == AL_STOPPED;
+        }
+
+        ALint processed = 0;
+        alGetSourcei(m_sources.leader(), AL_BUFFERS_PROCESSED, &processed);
+        return m_eof && (size_t) processed == m_queuedFrames.size()
+               && m_sources.getState() != AL_PLAYING;
+    }
+
+    bool isStereo() const { return m_sfinfo.channels == 2; }
+
+    /* Realigns the channels if they drifted apart, returns the drift in
+     * frames. Only progressive streams are measured: their queues are never
+     * unqueued, so the offsets of every channel count from the same start.
+     */
+    ALint correctDrift() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_progressive || m_pendingFrame >= 0) return 0;
+        return m_sources.correctDrift();
+    }
+
+    // The sources must already be stopped or deleted, since the queued buffers get deleted here
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        closeLocked();
+    }
+
+private:
+    void closeLocked() {
+        for (int c = 0; c < 2; c++) {
+            for (ALuint &buffer: m_buffers[c]) {
+                if (buffer != AL_NONE && alIsBuffer(buffer))
+                    alDeleteBuffers(1, &buffer);
+                buffer = AL_NONE;
+            }
+            m_freeBuffers[c].clear();
+        }
+        // A handed over track may still be reading the chunks, the last owner deletes them
+        m_retainedBuffers.reset();
+        m_sources.clear();
+        m_queuedFrames.clear();
+        dropDecodedTrack();
+
+        if (m_sndfile) {
+            sf_close(m_sndfile);
+            m_sndfile = nullptr;
+        }
+    }
+
+    void updateProgressive() {
+        ALint state = m_sources.getState();
+        if (m_playing && m_pendingFrame < 0 && state == AL_STOPPED) {
+            if (!m_eof) {
+                // The queue ran dry before the decode caught up, continue from its end once there is more
+                LOG_DEBUG("Progressive decode behind playback, waiting at frame %" PRId64, (int64_t) m_decodedFrames);
+                m_pendingFrame = m_decodedFrames;
+            } else {
+                m_stoppedFrame = m_decodedFrames;
+            }
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + PROGRESSIVE_DECODE_BUDGET;
+        while (!m_eof && queueChunk()) {
+            if (std::chrono::steady_clock::now() >= deadline) break;
+        }
+
+        if (m_pendingFrame >= 0 && (m_pendingFrame < m_decodedFrames || m_eof))
+            resumeAt(m_pendingFrame);
+        if (m_eof && m_decodedHandler)
+            handOverDecodedTrack();
+    }
+
+    void handOverDecodedTrack() {
+        std::function<void(DecodedTrack)> handler = std::move(m_decodedHandler);
+        dropDecodedTrack();
+        handler({m_sfinfo, m_sampleFormat, m_decodedFrames, m_retainedBuffers});
+    }
+
+    // The track won't be handed over, after an error or once it was
+    void dropDecodedTrack() {
+        m_decodedHandler = nullptr;
+    }
+
+    // Starts the stopped sources from a frame of the queue (or leaves them stopped at its end)
+    void resumeAt(sf_count_t frame) {
+        m_pendingFrame = -1;
+        m_stoppedFrame = std::min(frame, m_decodedFrames);
+        if (frame >= m_decodedFrames) return;
+
+        m_sources.setSampleOffset((ALint) frame);
+        if (m_playing)
+            m_sources.play();
+    }
+
+    void recycleProcessedBuffers() {
+        for (int c = 0; c < m_sfinfo.channels; c++) {
+            ALint processed = 0;
+            alGetSourcei(m_sources[c], AL_BUFFERS_PROCESSED, &processed);
+            while (processed-- > 0) {
+                ALuint buffer;
+                alSourceUnqueueBuffers(m_sources[c], 1, &buffer);
+                m_freeBuffers[c].push_back(buffer);
+
+                // The left source is the reference for the playback position
+                if (c == 0 && !m_queuedFrames.empty()) {
+                    m_processedFrames += m_queuedFrames.front();
+                    m_queuedFrames.pop_front();
+                }
+            }
+        }
+    }
+
+    void notify(StreamEvent event) const {
+        if (m_eventHandler) m_eventHandler(event);
+    }
+
+    // Decodes the next chunk and queues it on every source, returns false at the end of the file
+    bool queueChunk() {
+        if (m_eof) return false;
+        for (int c = 0; c < m_sfinfo.channels && !m_progressive; c++) {
+            if (m_freeBuffers[c].empty()) return false;
+        }
+
+        sf_count_t chunkFrames = m_chunkFrames;
+        sf_count_t frames;
+        if (m_sampleFormat == Float)
+            frames = sf_readf_float(m_sndfile, (float *) m_decodeBuffer.data(), chunkFrames);
+        else
+            frames = sf_readf_short(m_sndfile, (short *) m_decodeBuffer.data(), chunkFrames);
+
+        if (frames < chunkFrames) {
+            m_eof = true;
+            if (sf_error(m_sndfile) != SF_ERR_NO_ERROR) {
+                LOG_ERROR("Stream decode error: %s", sf_strerror(m_sndfile));
+                notify(StreamEvent::DecodeError);
+                dropDecodedTrack();
+            }
+        }
+        if (frames < 1)
+            return false;
+        if (m_progressive)
+            m_chunkFrames = std::min(m_chunkFrames * 2, PROGRESSIVE_MAX_CHUNK_FRAMES);
+
+        ALsizei channelBytes = (ALsizei) (frames * m_sampleSize);
+        if (isStereo()) {
+            char *left = m_splitBuffer.data();
+            char *right = left + frames * m_sampleSize;
+            if (m_sampleFormat == Float)
+                deinterleaveStereo((const float *) m_decodeBuffer.data(), (float *) left, (float *) right, frames);
+            else
+                deinterleaveStereo((const short *) m_decodeBuffer.data(), (short *) left, (short *) right, frames);
+
+            bufferAndQueue(0, left, channelBytes);
+            bufferAndQueue(1, right, channelBytes);
+        } else {
+            bufferAndQueue(0, m_decodeBuffer.data(), channelBytes);
+        }
+        if (!m_progressive)
+            m_queuedFrames.push_back((ALsizei) frames);
+        m_decodedFrames += frames;
+
+        ALenum err = alGetError();
+        if (err != AL_NO_ERROR) {
+            LOG_ERROR("OpenAL Error queueing stream chunk: %s", alGetString(err));
+            notify(StreamEvent::DecodeError);
+            dropDecodedTrack();
+            return false;
+        }
+        return true;
+    }
+
+    void bufferAndQueue(int channel, const void *data, ALsizei bytes) {
+        ALuint buffer;
+        if (m_progressive) {
+            alGenBuffers(1, &buffer);
+            m_retainedBuffers->ids[channel].push_back(buffer);
+        } else {
+            buffer = m_freeBuffers[channel].back();
+            m_freeBuffers[channel].pop_back();
+        }
+        // A shared track is read back while queued, which needs a persistent mapping
+        if (m_decodedHandler)
+            alBufferStorageSOFT(buffer, m_format, data, bytes, m_sfinfo.samplerate,
+                                AL_MAP_READ_BIT_SOFT | AL_MAP_PERSISTENT_BIT_SOFT);
+        else
+            alBufferData(buffer, m_format, data, bytes, m_sfinfo.samplerate);
+        alSourceQueueBuffers(m_sources[channel], 1, &buffer);
+    }
+};
+
+/* Single thread that keeps the buffer queues of every registered stream full.
+ * Once remove() returns the feeder no longer touches that stream.
+ */
+class StreamFeeder {
+private:
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<SoundStream *> m_streams;
+    bool m_running;
+    bool m_wakeRequested;
+
+public:
+    StreamFeeder() : m_running(false), m_wakeRequested(false) {}
+
+    ~StreamFeeder() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+            m_streams.clear();
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    void add(SoundStream *stream) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_streams.push_back(stream);
+            if (!m_running) {
+                m_running = true;
+                m_thread = std::thread(&StreamFeeder::run, this);
+            }
+        }
+        m_cv.notify_all();
+    }
+
+    // Feeds the streams right away, e.g. when a queued buffer just finished playing
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_wakeRequested = true;
+        }
+        m_cv.notify_all();
+    }
+
+    void remove(SoundStream *stream) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_streams.erase(std::remove(m_streams.begin(), m_streams.end(), stream), m_streams.end());
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_running) {
+            if (m_streams.empty()) {
+                m_cv.wait(lock, [this] { return !m_running || !m_streams.empty(); });
+                continue;
+            }
+
+            for (SoundStream *stream: m_streams)
+                stream->update();
+
+            m_cv.wait_for(lock, STREAM_FEED_INTERVAL, [this] { return !m_running || m_wakeRequested; });
+            m_wakeRequested = false;
+        }
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_SOUNDSTREAM_H
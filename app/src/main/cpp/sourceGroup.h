@@ -0,0 +1,193 @@
+#ifndef INC_8DMUSICPLAYER_SOURCEGROUP_H
+#define INC_8DMUSICPLAYER_SOURCEGROUP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "AL/al.h"
+#include "AL/alext.h"
+
+#include "logSink.h"
+#define C_SOURCE_GROUP "C++ Source Group"
+
+// Sources per group, one per channel
+constexpr ALsizei SOURCE_GROUP_MAX_SOURCES = 8;
+// How often playing groups are checked for drift
+constexpr std::chrono::milliseconds SOURCE_GROUP_DRIFT_INTERVAL(1000);
+// Offsets further apart than this are realigned, in frames (about 0.1ms at 48kHz)
+constexpr ALint SOURCE_GROUP_DRIFT_TOLERANCE = 4;
+// Attempts at reading every offset within one mixer update
+constexpr int SOURCE_GROUP_DRIFT_READS = 3;
+
+/* AL_SOFT_deferred_updates for the context: while at least one UpdateBatch
+ * is alive, source changes are held back and then applied by the mixer all
+ * at once, in the same period. Batches nest per thread, only a thread's
+ * outermost one applies the updates, so a batch on another thread can't end
+ * it early (though its own end may apply this thread's changes so far).
+ * Without the extension the changes apply one by one.
+ */
+class UpdateBatch {
+private:
+    struct Extension {
+        LPALDEFERUPDATESSOFT defer = nullptr;
+        LPALPROCESSUPDATESSOFT process = nullptr;
+    };
+
+    static Extension &getExtension() {
+        static Extension extension;
+        return extension;
+    }
+
+    static int &getDepth() {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+public:
+    // Needs the AL context to be current, call again for every new context
+    static bool load() {
+        Extension &extension = getExtension();
+        extension.defer = nullptr;
+        extension.process = nullptr;
+        if (alIsExtensionPresent("AL_SOFT_deferred_updates")) {
+            extension.defer = reinterpret_cast<LPALDEFERUPDATESSOFT>(alGetProcAddress("alDeferUpdatesSOFT"));
+            extension.process = reinterpret_cast<LPALPROCESSUPDATESSOFT>(alGetProcAddress("alProcessUpdatesSOFT"));
+        }
+        bool loaded = extension.defer && extension.process;
+        logPrint(LogLevel::Info, C_SOURCE_GROUP, "Deferred updates: %s",
+                 loaded ? "AL_SOFT_deferred_updates" : "unsupported");
+        return loaded;
+    }
+
+    UpdateBatch() {
+        Extension &extension = getExtension();
+        if (getDepth()++ == 0 && extension.defer)
+            extension.defer();
+    }
+
+    ~UpdateBatch() {
+        Extension &extension = getExtension();
+        if (--getDepth() == 0 && extension.process)
+            extension.process();
+    }
+
+    UpdateBatch(const UpdateBatch &) = delete;
+    UpdateBatch &operator=(const UpdateBatch &) = delete;
+};
+
+struct SourceGroupDrift {
+    uint64_t checks;       // groups measured
+    uint64_t corrections;  // groups realigned
+    int64_t maxFrames;     // worst drift seen, in frames
+};
+
+/* The sources playing the channels of one sound, started, paused, stopped
+ * and seeked together so every channel changes in the same mixer period.
+ * The first source leads: its state and offset stand for the whole group.
+ * Doesn't own the sources.
+ */
+class SourceGroup {
+private:
+    ALuint m_sources[SOURCE_GROUP_MAX_SOURCES];
+    ALsizei m_count;
+
+public:
+    SourceGroup() : m_sources(), m_count(0) {}
+
+    void assign(const ALuint *sources, ALsizei count) {
+        m_count = std::min(count, SOURCE_GROUP_MAX_SOURCES);
+        std::copy(sources, sources + m_count, m_sources);
+    }
+
+    void clear() { m_count = 0; }
+
+    bool empty() const { return m_count == 0; }
+
+    ALsizei size() const { return m_count; }
+
+    const ALuint *data() const { return m_sources; }
+
+    ALuint operator[](ALsizei index) const { return m_sources[index]; }
+
+    ALuint leader() const { return m_count > 0 ? m_sources[0] : AL_NONE; }
+
+    void play() const {
+        if (m_count > 0) alSourcePlayv(m_count, m_sources);
+    }
+
+    void pause() const {
+        if (m_count > 0) alSourcePausev(m_count, m_sources);
+    }
+
+    void stop() const {
+        if (m_count > 0) alSourceStopv(m_count, m_sources);
+    }
+
+    void rewind() const {
+        if (m_count > 0) alSourceRewindv(m_count, m_sources);
+    }
+
+    ALint getState() const {
+        ALint state = AL_STOPPED;
+        if (m_count > 0) alGetSourcei(m_sources[0], AL_SOURCE_STATE, &state);
+        return state;
+    }
+
+    void setf(ALenum param, ALfloat value) const {
+        UpdateBatch batch;
+        for (ALsizei i = 0; i < m_count; i++)
+            alSourcef(m_sources[i], param, value);
+    }
+
+    // Every channel jumps to the frame in the same mixer period, playing or not
+    void setSampleOffset(ALint frame) const {
+        UpdateBatch batch;
+        for (ALsizei i = 0; i < m_count; i++)
+            alSourcei(m_sources[i], AL_SAMPLE_OFFSET, frame);
+    }
+
+    void setSecondsOffset(ALfloat seconds) const {
+        setf(AL_SEC_OFFSET, seconds);
+    }
+
+    /* Measures how far the channels drifted from the leader and realigns
+     * them on it past the tolerance. Only meaningful for sources whose
+     * offsets count from the same start (a static buffer, or a queue that is
+     * never unqueued). Returns the drift in frames, 0 if it couldn't be read.
+     */
+    ALint correctDrift() const {
+        if (m_count < 2 || getState() != AL_PLAYING) return 0;
+
+        ALint offsets[SOURCE_GROUP_MAX_SOURCES];
+        if (!readOffsets(offsets)) return 0;
+
+        ALint drift = 0;
+        for (ALsizei i = 1; i < m_count; i++)
+            drift = std::max(drift, abs(offsets[i] - offsets[0]));
+        if (drift > SOURCE_GROUP_DRIFT_TOLERANCE) {
+            logPrint(LogLevel::Warn, C_SOURCE_GROUP, "Channels of source %u drifted %d frames, realigning",
+                     m_sources[0], drift);
+            setSampleOffset(offsets[0]);
+        }
+        return drift;
+    }
+
+private:
+    // The mixer may advance between two reads, so the leader is read again until it didn't move
+    bool readOffsets(ALint *offsets) const {
+        for (int attempt = 0; attempt < SOURCE_GROUP_DRIFT_READS; attempt++) {
+            for (ALsizei i = 0; i < m_count; i++)
+                alGetSourcei(m_sources[i], AL_SAMPLE_OFFSET, &offsets[i]);
+
+            ALint leader = 0;
+            alGetSourcei(m_sources[0], AL_SAMPLE_OFFSET, &leader);
+            if (leader == offsets[0]) return alGetError() == AL_NO_ERROR;
+        }
+        return false;
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_SOURCEGROUP_H
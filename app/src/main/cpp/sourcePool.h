@@ -0,0 +1,161 @@
+#ifndef INC_8DMUSICPLAYER_SOURCEPOOL_H
+#define INC_8DMUSICPLAYER_SOURCEPOOL_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "AL/al.h"
+#include "AL/alc.h"
+
+#include "logSink.h"
+#include "trace.h"
+#define C_SOURCE_POOL "C++ Source Pool"
+
+// Used when the device doesn't report how many mono sources it can mix
+constexpr ALCint SOURCE_POOL_DEFAULT_SIZE = 64;
+
+struct SourcePoolStats {
+    uint64_t capacity;      // sources generated up front
+    uint64_t inUse;
+    uint64_t peakInUse;
+    uint64_t acquires;      // sources handed out
+    uint64_t releases;      // sources given back
+    uint64_t exhaustions;   // acquires that failed because the pool was empty
+};
+
+/* Engine-wide pool of AL sources, all generated when the context is created
+ * and deleted with it, so loading and stopping sounds never generates or
+ * deletes a source. Sized to the device's mono source limit, which is all
+ * the mixer can play anyway. Released sources are stopped, detached from
+ * their buffers and reset to the default properties before reuse.
+ * Needs the AL context to be current.
+ */
+class SourcePool {
+private:
+    std::mutex m_mutex;
+    std::vector<ALuint> m_sources;
+    std::vector<ALuint> m_freeSources; // last released first, so recently used sources stay warm
+    SourcePoolStats m_stats;
+
+public:
+    SourcePool() : m_stats() {}
+
+    ~SourcePool() {
+        destroy();
+    }
+
+    SourcePool(const SourcePool &) = delete;
+    SourcePool &operator=(const SourcePool &) = delete;
+
+    // Generates as many sources as the device can mix, returns false if none could be generated
+    bool create(ALCdevice *device) {
+        TRACE_SCOPE("SourcePool create");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        destroyLocked();
+
+        ALCint monoSources = 0;
+        alcGetIntegerv(device, ALC_MONO_SOURCES, 1, &monoSources);
+        if (monoSources <= 0) monoSources = SOURCE_POOL_DEFAULT_SIZE;
+
+        // Generated one at a time, the device may run out before the reported limit
+        m_sources.reserve(monoSources);
+        for (ALCint i = 0; i < monoSources; i++) {
+            ALuint source = AL_NONE;
+            alGenSources(1, &source);
+            if (alGetError() != AL_NO_ERROR) break;
+            m_sources.push_back(source);
+        }
+        m_freeSources.assign(m_sources.rbegin(), m_sources.rend());
+
+        m_stats = SourcePoolStats();
+        m_stats.capacity = m_sources.size();
+        logPrint(LogLevel::Info, C_SOURCE_POOL, "Generated %zu of %d sources",
+                 m_sources.size(), monoSources);
+        return !m_sources.empty();
+    }
+
+    // Deletes every source, sounds must have released theirs first
+    void destroy() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        destroyLocked();
+    }
+
+    /* Takes count sources (1 for mono, 2 for split stereo), all or none.
+     * Returns false if the pool doesn't have enough left.
+     */
+    bool acquire(ALuint *sources, size_t count) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_freeSources.size() < count) {
+            m_stats.exhaustions++;
+            logPrint(LogLevel::Warn, C_SOURCE_POOL, "Out of sources: %zu wanted, %zu free of %zu",
+                     count, m_freeSources.size(), m_sources.size());
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            sources[i] = m_freeSources.back();
+            m_freeSources.pop_back();
+        }
+        m_stats.acquires += count;
+        m_stats.inUse += count;
+        m_stats.peakInUse = std::max(m_stats.peakInUse, m_stats.inUse);
+        traceCounter(TraceCounter::ActiveSources, (int64_t) m_stats.inUse);
+        return true;
+    }
+
+    // Resets the source and gives it back, AL_NONE is ignored
+    void release(ALuint source) {
+        if (source == AL_NONE) return;
+        reset(source);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_freeSources.push_back(source);
+        m_stats.releases++;
+        m_stats.inUse--;
+        traceCounter(TraceCounter::ActiveSources, (int64_t) m_stats.inUse);
+    }
+
+    SourcePoolStats getStats() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    void destroyLocked() {
+        if (m_sources.empty()) return;
+        if (m_freeSources.size() != m_sources.size()) {
+            logPrint(LogLevel::Warn, C_SOURCE_POOL, "Deleting %zu sources still in use",
+                     m_sources.size() - m_freeSources.size());
+        }
+        alDeleteSources((ALsizei) m_sources.size(), m_sources.data());
+        m_sources.clear();
+        m_freeSources.clear();
+        traceCounter(TraceCounter::ActiveSources, 0);
+    }
+
+    // Back to the state of a freshly generated source, detaching the buffer also clears a stream's queue
+    static void reset(ALuint source) {
+        alSourceStop(source);
+        alSourcei(source, AL_BUFFER, 0);
+        alSourceRewind(source);
+
+        alSourcef(source, AL_GAIN, 1.0f);
+        alSourcef(source, AL_PITCH, 1.0f);
+        alSourcei(source, AL_LOOPING, AL_FALSE);
+        alSourcei(source, AL_SOURCE_RELATIVE, AL_FALSE);
+        alSource3f(source, AL_POSITION, 0.0f, 0.0f, 0.0f);
+        alSource3f(source, AL_VELOCITY, 0.0f, 0.0f, 0.0f);
+        alSource3f(source, AL_DIRECTION, 0.0f, 0.0f, 0.0f);
+
+        ALenum error = alGetError();
+        if (error != AL_NO_ERROR) {
+            logPrint(LogLevel::Error, C_SOURCE_POOL, "Error resetting source %u: %s",
+                     source, alGetString(error));
+        }
+    }
+};
+
+#endif //INC_8DMUSICPLAYER_SOURCEPOOL_H
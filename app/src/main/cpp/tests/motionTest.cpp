@@ -0,0 +1,62 @@
+// Checks that changing a sound's wobble keeps its trajectory going from where
+// it is: the orbit angle must not jump back to its start across setWobble().
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <cstdio>
+#include <memory>
+
+#include "motion.h"
+
+constexpr float ORBIT_RATE = 0.25f;
+constexpr float BASE_ANGLE = 0.5f;
+constexpr double SET_TIME = 2.0;
+constexpr double WOBBLE_TIME = 5.3;
+// One tick at the default motion rate
+constexpr double TICK_SECONDS = 1.0 / MOTION_DEFAULT_RATE_HZ;
+// Largest angle change over one tick, with some room for rounding
+constexpr float MAX_TICK_ANGLE = (float) (2.0 * M_PI * ORBIT_RATE * TICK_SECONDS) + 1e-4f;
+
+static int g_failures = 0;
+
+static void check(bool condition, const char *what) {
+    printf("%s: %s\n", condition ? "ok" : "FAILED", what);
+    if (!condition) g_failures++;
+}
+
+// Difference between two angles, wrapped to [-pi, pi]
+static float angleDistance(float a, float b) {
+    return fabsf(remainderf(a - b, (float) (2.0 * M_PI)));
+}
+
+int main() {
+    SoundMotion motion;
+    auto orbit = std::make_unique<Trajectory>();
+    orbit->type = TrajectoryType::Orbit;
+    orbit->base = {BASE_ANGLE, 1.5f, 0.0f};
+    orbit->rate = ORBIT_RATE;
+    motion.set(std::move(orbit), SET_TIME);
+
+    MotionPose before = motion.evaluate(WOBBLE_TIME);
+    motion.setWobble(0.3f, 2.0f, before, WOBBLE_TIME);
+    MotionPose after = motion.evaluate(WOBBLE_TIME);
+    MotionPose nextTick = motion.evaluate(WOBBLE_TIME + TICK_SECONDS);
+
+    check(angleDistance(before.angle, after.angle) < 1e-5f, "orbit angle unchanged by setWobble");
+    check(before.radius == after.radius, "orbit radius unchanged by setWobble");
+    check(angleDistance(after.angle, nextTick.angle) <= MAX_TICK_ANGLE, "orbit continues one tick later");
+    check(angleDistance(after.angle, BASE_ANGLE) > MAX_TICK_ANGLE, "orbit did not restart at its base angle");
+    check(motion.get()->wobbleDepth == 0.3f && motion.get()->wobbleRate == 2.0f, "wobble applied");
+
+    // Without a trajectory, the wobble holds the current pose
+    SoundMotion still;
+    MotionPose pose = {1.0f, 2.0f, 0.1f};
+    still.setWobble(0.2f, 1.0f, pose, WOBBLE_TIME);
+    MotionPose wobbled = still.evaluate(WOBBLE_TIME + 0.25);
+    check(wobbled.angle == pose.angle && wobbled.radius == pose.radius, "static wobble keeps the pose");
+    check(fabsf(wobbled.height - (pose.height + 0.2f)) < 1e-5f, "static wobble moves the height");
+    check(still.isMoving(WOBBLE_TIME + 0.25), "static wobble keeps ticking");
+
+    return g_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,92 @@
+// Plays an uncached track longer than PROGRESSIVE_MIN_SECONDS once, then checks
+// that its decode was written to the PCM cache, so the next load is a cache hit.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audioEngine.h"
+
+constexpr int TRACK_RATE = 8000;
+constexpr float TRACK_SECONDS = PROGRESSIVE_MIN_SECONDS + 5.0f;
+constexpr uint64_t CACHE_BUDGET_BYTES = 64ULL * 1024 * 1024;
+
+static void putLe(std::vector<char> &out, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out.push_back((char) ((value >> (8 * i)) & 0xff));
+}
+
+// Mono 16-bit PCM WAV of a quiet tone
+static bool writeWav(const std::string &path, int rate, float seconds) {
+    uint32_t frames = (uint32_t) (rate * seconds);
+    uint32_t dataBytes = frames * 2;
+    std::vector<char> wav;
+    wav.insert(wav.end(), {'R', 'I', 'F', 'F'});
+    putLe(wav, 36 + dataBytes, 4);
+    wav.insert(wav.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    putLe(wav, 16, 4);
+    putLe(wav, 1, 2);                 // PCM
+    putLe(wav, 1, 2);                 // channels
+    putLe(wav, (uint32_t) rate, 4);
+    putLe(wav, (uint32_t) rate * 2, 4);
+    putLe(wav, 2, 2);                 // block align
+    putLe(wav, 16, 2);                // bits per sample
+    wav.insert(wav.end(), {'d', 'a', 't', 'a'});
+    putLe(wav, dataBytes, 4);
+    for (uint32_t i = 0; i < frames; i++)
+        putLe(wav, (uint32_t) (uint16_t) (int16_t) (1000.0 * sin(2.0 * M_PI * 440.0 * i / rate)), 2);
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool written = fwrite(wav.data(), 1, wav.size(), file) == wav.size();
+    return fclose(file) == 0 && written;
+}
+
+int main() {
+    char directory[] = "/tmp/symphony-test-XXXXXX";
+    if (!mkdtemp(directory)) {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        return EXIT_FAILURE;
+    }
+    std::string trackPath = std::string(directory) + "/long.wav";
+    std::string cacheDirectory = std::string(directory) + "/pcm";
+    if (!writeWav(trackPath, TRACK_RATE, TRACK_SECONDS)) {
+        fprintf(stderr, "Could not write %s\n", trackPath.c_str());
+        return EXIT_FAILURE;
+    }
+
+    bool cached;
+    {
+        AudioEngine engine;
+        if (!engine.initialize("")) {
+            fprintf(stderr, "Could not initialize the engine\n");
+            return EXIT_FAILURE;
+        }
+        engine.setDecodeCache(cacheDirectory, CACHE_BUDGET_BYTES);
+
+        SoundId soundId = engine.createSound(SoundSource::fromPath(trackPath));
+        if (soundId == SlotMap<SoundSlot>::INVALID_HANDLE) {
+            fprintf(stderr, "Could not load %s\n", trackPath.c_str());
+            return EXIT_FAILURE;
+        }
+        engine.playSound(soundId);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        engine.stopSound(soundId);
+
+        // Checked through a cache of its own, the way the next process would find it
+        PcmCache pcmCache;
+        pcmCache.configure(cacheDirectory, CACHE_BUDGET_BYTES);
+        SoundLoadOptions loadOptions;
+        loadOptions.cache = &pcmCache;
+        cached = isSoundCached(SoundSource::fromPath(trackPath), loadOptions);
+        engine.cleanup();
+    }
+
+    printf("%.0f s track %s after its first play\n", TRACK_SECONDS, cached ? "cached" : "not cached");
+    return cached ? EXIT_SUCCESS : EXIT_FAILURE;
+}
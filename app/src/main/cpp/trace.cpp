@@ -0,0 +1,105 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mutex>
+
+#include "logSink.h"
+#define C_TRACE "C++ Trace"
+
+std::atomic<const TraceBackend *> g_traceBackend(nullptr);
+
+static const char *const TRACE_COUNTER_NAMES[(int) TraceCounter::Count] = {
+        "ActiveSources",
+        "AlBufferBytes",
+        "DecodeBytesPerSecond",
+};
+
+static std::atomic<int64_t> g_traceCounters[(int) TraceCounter::Count];
+
+void setTraceBackend(const TraceBackend *backend) {
+    g_traceBackend.store(backend);
+    // Counters changed while disabled start from their current value
+    if (!backend) return;
+    for (int i = 0; i < (int) TraceCounter::Count; i++)
+        backend->setCounter(TRACE_COUNTER_NAMES[i], g_traceCounters[i].load(std::memory_order_relaxed));
+}
+
+int64_t traceNowNs() {
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void traceCounter(TraceCounter counter, int64_t value) {
+    g_traceCounters[(int) counter].store(value, std::memory_order_relaxed);
+    const TraceBackend *backend = getTraceBackend();
+    if (backend) backend->setCounter(TRACE_COUNTER_NAMES[(int) counter], value);
+}
+
+void traceCounterAdd(TraceCounter counter, int64_t delta) {
+    int64_t value = g_traceCounters[(int) counter].fetch_add(delta, std::memory_order_relaxed) + delta;
+    const TraceBackend *backend = getTraceBackend();
+    if (backend) backend->setCounter(TRACE_COUNTER_NAMES[(int) counter], value);
+}
+
+// Chrome trace JSON, one object per event in a top-level array
+static std::mutex g_chromeTraceMutex;
+static FILE *g_chromeTraceFile = nullptr;
+static bool g_chromeTraceFirst = true;
+
+static long getThreadId() {
+    static thread_local long threadId = syscall(SYS_gettid);
+    return threadId;
+}
+
+static void writeChromeEvent(const char *name, char phase, const int64_t *value) {
+    double timestampUs = traceNowNs() / 1000.0;
+    long threadId = getThreadId();
+
+    std::lock_guard<std::mutex> lock(g_chromeTraceMutex);
+    if (!g_chromeTraceFile) return;
+    fprintf(g_chromeTraceFile, "%s\n{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld",
+            g_chromeTraceFirst ? "" : ",", phase, timestampUs, (int) getpid(), threadId);
+    if (name) fprintf(g_chromeTraceFile, ",\"name\":\"%s\"", name);
+    if (value) fprintf(g_chromeTraceFile, ",\"args\":{\"value\":%lld}", (long long) *value);
+    fputc('}', g_chromeTraceFile);
+    g_chromeTraceFirst = false;
+}
+
+static const TraceBackend CHROME_TRACE_BACKEND = {
+        [](const char *name) { writeChromeEvent(name, 'B', nullptr); },
+        []() { writeChromeEvent(nullptr, 'E', nullptr); },
+        [](const char *name, int64_t value) { writeChromeEvent(name, 'C', &value); },
+};
+
+bool startChromeTrace(const char *path) {
+    stopChromeTrace();
+    {
+        std::lock_guard<std::mutex> lock(g_chromeTraceMutex);
+        g_chromeTraceFile = fopen(path, "w");
+        if (!g_chromeTraceFile) {
+            logPrint(LogLevel::Error, C_TRACE, "Could not create the trace file %s", path);
+            return false;
+        }
+        g_chromeTraceFirst = true;
+        fputc('[', g_chromeTraceFile);
+    }
+    setTraceBackend(&CHROME_TRACE_BACKEND);
+    return true;
+}
+
+void stopChromeTrace() {
+    // Sections still open end on the closed file, and are dropped
+    const TraceBackend *chromeBackend = &CHROME_TRACE_BACKEND;
+    g_traceBackend.compare_exchange_strong(chromeBackend, nullptr);
+
+    std::lock_guard<std::mutex> lock(g_chromeTraceMutex);
+    if (!g_chromeTraceFile) return;
+    fputs("\n]\n", g_chromeTraceFile);
+    fclose(g_chromeTraceFile);
+    g_chromeTraceFile = nullptr;
+}
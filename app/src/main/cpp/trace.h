@@ -0,0 +1,89 @@
+#ifndef INC_8DMUSICPLAYER_TRACE_H
+#define INC_8DMUSICPLAYER_TRACE_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+/* Where trace events go: ATrace on device (read by Perfetto and systrace),
+ * a Chrome trace JSON file on a desktop host. Sections nest per thread and
+ * names are string literals, backends keep the pointers as they are.
+ */
+struct TraceBackend {
+    void (*beginSection)(const char *name);
+    void (*endSection)();
+    void (*setCounter)(const char *name, int64_t value);
+};
+
+enum class TraceCounter : int {
+    ActiveSources,        // AL sources handed out by the pool
+    AlBufferBytes,        // bytes held by the loaded AL buffers of static sounds, shared ones counted once
+    DecodeBytesPerSecond, // PCM produced per second by the last decode
+    Count,
+};
+
+// nullptr while tracing is disabled, checked by every trace point
+extern std::atomic<const TraceBackend *> g_traceBackend;
+
+/* Enables tracing into the backend, nullptr disables it. The backend must stay
+ * valid for the life of the process, a section may still end on it after it
+ * was replaced. Safe to call from any thread.
+ */
+void setTraceBackend(const TraceBackend *backend);
+
+inline const TraceBackend *getTraceBackend() {
+    return g_traceBackend.load(std::memory_order_relaxed);
+}
+
+inline bool isTracing() {
+    return getTraceBackend() != nullptr;
+}
+
+// Monotonic clock for trace timings, in nanoseconds
+int64_t traceNowNs();
+
+// Sets a counter, only reported while tracing
+void traceCounter(TraceCounter counter, int64_t value);
+
+// Adjusts a counter tracked at all times, so its value is right as soon as tracing starts
+void traceCounterAdd(TraceCounter counter, int64_t delta);
+
+/* A section from construction to destruction (or end()), on the backend that
+ * was set when it began. Costs one relaxed load while tracing is disabled.
+ */
+class TraceScope {
+private:
+    const TraceBackend *m_backend;
+
+public:
+    explicit TraceScope(const char *name) : m_backend(getTraceBackend()) {
+        if (m_backend) m_backend->beginSection(name);
+    }
+
+    ~TraceScope() {
+        end();
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    // Ends the section early, for phases of a longer function
+    void end() {
+        if (m_backend) m_backend->endSection();
+        m_backend = nullptr;
+    }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Traces the rest of the enclosing block
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+/* Writes the trace events as Chrome trace JSON, which chrome://tracing and
+ * ui.perfetto.dev open. For desktop builds and benchmarks, returns false if
+ * the file can't be created. Stopping closes the file and disables tracing.
+ */
+bool startChromeTrace(const char *path);
+void stopChromeTrace();
+
+#endif //INC_8DMUSICPLAYER_TRACE_H
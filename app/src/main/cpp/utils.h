@@ -5,22 +5,17 @@
 #ifndef INC_8DMUSICPLAYER_UTILS_H
 #define INC_8DMUSICPLAYER_UTILS_H
 
-#include <AL/al.h>
+#include <math.h>
 
-std::string jstringToString(JNIEnv* env, jstring js) {
-    const char *filePathChars = env->GetStringUTFChars(js, 0);
-    std::string filePathStr(filePathChars);
-    env->ReleaseStringUTFChars(js, filePathChars);
-    return filePathChars;
-}
+#include <AL/al.h>
 
-bool isSourcePlaying(ALuint source) {
+inline bool isSourcePlaying(ALuint source) {
     ALint state;
     alGetSourcei(source, AL_SOURCE_STATE, &state);
     return (state == AL_PLAYING);
 }
 
-float getDurationSeconds(ALuint buffer) {
+inline float getDurationSeconds(ALuint buffer) {
     ALint sizeInBytes;
     ALint channels;
     ALint bits;
@@ -36,10 +31,23 @@ float getDurationSeconds(ALuint buffer) {
     return (float)lengthInSamples / (float)frequency;
 }
 
-void setPosition(ALuint source, float angle, float radius, float height) {
+inline void setPosition(ALuint source, float angle, float radius, float height) {
     while (angle > M_PI) angle -= M_PI*2.0;
     while (angle < M_PI) angle += M_PI*2.0;
     alSource3f(source, AL_POSITION, radius * cos(angle), height, radius * sin(angle));
 }
 
+// Places the sources of a sound's channels, spread evenly over the stereo angle from left to right
+inline void setChannelPositions(const ALuint *sources, ALsizei channels, float angle, float radius, float height,
+                                float stereoAngle) {
+    if (channels == 1) {
+        setPosition(sources[0], angle, radius, height);
+        return;
+    }
+    for (ALsizei i = 0; i < channels; i++) {
+        float spread = stereoAngle * ((float) i / (float) (channels - 1) - 0.5f);
+        setPosition(sources[i], angle + spread, radius, height);
+    }
+}
+
 #endif //INC_8DMUSICPLAYER_UTILS_H
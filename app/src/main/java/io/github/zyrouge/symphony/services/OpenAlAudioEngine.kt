@@ -1,7 +1,16 @@
 package io.github.zyrouge.symphony.services
 
 import android.content.Context
+import android.content.res.AssetFileDescriptor
+import android.net.Uri
+import android.os.Build
 import java.io.File
+import java.io.InputStream
+import java.lang.invoke.MethodHandle
+import java.lang.invoke.MethodHandles
+import java.lang.invoke.VarHandle
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
 import kotlin.math.atan2
 import kotlin.math.sqrt
 
@@ -20,6 +29,9 @@ object tOpenAlAudioEngine {
 
     /**
      * Callback interface for receiving audio playback events.
+     *
+     * All methods are called in order from one native thread, so they should return quickly
+     * and hand longer work to another thread. Methods left out of an implementation are skipped.
      */
     interface AudioCallback {
         /**
@@ -27,21 +39,124 @@ object tOpenAlAudioEngine {
          *
          * @param soundId The unique identifier of the sound that finished playing
          */
-        fun onSoundFinished(soundId: String)
+        fun onSoundFinished(soundId: Long)
+
+        /**
+         * Called when a sound created with [createSoundAsync] finished loading.
+         * Not called for cancelled loads.
+         *
+         * @param soundId The unique identifier returned by [createSoundAsync]
+         * @param success `true` if the sound is ready to play, `false` if it could not be loaded
+         */
+        fun onSoundLoaded(soundId: Long, success: Boolean) {}
+
+        /**
+         * Called when a sound hits an error while playing.
+         *
+         * @param soundId The unique identifier of the sound
+         * @param error The error, e.g. [ERROR_DECODE_FAILED]
+         */
+        fun onSoundError(soundId: Long, error: Int) {}
+
+        /**
+         * Called periodically for every playing sound, see [setPositionTickInterval].
+         *
+         * @param soundId The unique identifier of the sound
+         * @param seconds The playback position in seconds
+         */
+        fun onPositionTick(soundId: Long, seconds: Float) {}
+
+        /**
+         * Called when a streaming sound ran out of decoded audio and was restarted, which is
+         * heard as a gap.
+         *
+         * @param soundId The unique identifier of the sound
+         */
+        fun onUnderrun(soundId: Long) {}
+
+        /**
+         * Called as an export started with [startExport] progresses, about every percent.
+         *
+         * @param exportId The identifier returned by [startExport]
+         * @param progress The progress, from 0 to 1
+         */
+        fun onExportProgress(exportId: Long, progress: Float) {}
+
+        /**
+         * Called once an export started with [startExport] ended, successfully or not.
+         *
+         * @param exportId The identifier returned by [startExport]
+         * @param result [EXPORT_OK], or why the export stopped, e.g. [EXPORT_CANCELLED]
+         */
+        fun onExportFinished(exportId: Long, result: Int) {}
     }
 
+    /**
+     * Error passed to [AudioCallback.onSoundError] when a stream failed to read or seek.
+     * Playback may stop early.
+     */
+    const val ERROR_DECODE_FAILED = 1
+
+    /** Export formats accepted by [startExport]. */
+    const val EXPORT_FORMAT_WAV = 0
+    const val EXPORT_FORMAT_FLAC = 1
+    const val EXPORT_FORMAT_OPUS = 2
+    const val EXPORT_FORMAT_VORBIS = 3
+    const val EXPORT_FORMAT_MP3 = 4
+
+    /** Results passed to [AudioCallback.onExportFinished]. */
+    const val EXPORT_OK = 0
+    const val EXPORT_CANCELLED = 1
+    const val EXPORT_ERROR_DEVICE = 2
+    const val EXPORT_ERROR_LOAD = 3
+    const val EXPORT_ERROR_OUTPUT = 4
+
     private var callback: AudioCallback? = null
 
+    /**
+     * Sound identifier returned when a sound could not be created, never used by a sound.
+     *
+     * Identifiers of stopped or finished sounds are never reused either, so calls with a stale
+     * identifier are ignored instead of reaching another sound.
+     */
+    const val INVALID_SOUND_ID = 0L
+
+    /**
+     * Default size budget of the decoded PCM cache set up by [init].
+     */
+    const val DEFAULT_DECODE_CACHE_BYTES = 512L * 1024 * 1024
+
+    /**
+     * Output setups accepted by [initOpenAL], see [getPowerStats] to compare them. The default
+     * leaves everything to OpenAL Soft and the device. Low latency uses 5 ms mixer updates and a
+     * 200 Hz motion tick, for the most responsive 8D motion. Battery saver uses 50 ms updates, a
+     * 20 Hz motion tick, linear resampling and cheaper HRTF rendering.
+     */
+    const val DEVICE_PROFILE_DEFAULT = 0
+    const val DEVICE_PROFILE_LOW_LATENCY = 1
+    const val DEVICE_PROFILE_BATTERY_SAVER = 2
+
 
     /**
      * Initializes the OpenAL audio engine with the specified HRTF name.
      *
+     * The profile's output rate, refresh rate and output mode are requested from the device on
+     * every initialization. Its OpenAL Soft options (period size and count, resampler, HRTF mode)
+     * are written to a config file in [configDirectory], and only take effect if this is the
+     * first initialization in the process.
+     *
      * @param selectedHrtf The Head-Related Transfer Function name to use.
+     * @param profile One of the `DEVICE_PROFILE_*` constants.
+     * @param configDirectory A writable directory for the config file, or empty to skip the options.
      * @return `true` if initialization was successful, `false` otherwise.
      *
      * @throws IllegalStateException if the audio engine is already initialized
      */
-    external fun initOpenAL(selectedHrtf: String): Boolean
+    external fun initOpenAL(
+        selectedHrtf: String,
+        profile: Int = DEVICE_PROFILE_DEFAULT,
+        configDirectory: String = ""
+    ): Boolean
 
     /**
      * Cleans up and shuts down the OpenAL audio engine, releasing all resources.
@@ -56,29 +171,100 @@ object tOpenAlAudioEngine {
      *
      * @param filePath The absolute path to the audio file to load.
      * @return A unique sound identifier that can be used to reference this sound in other operations,
-     *         or `null` if the sound could not be loaded.
+     *         or [INVALID_SOUND_ID] if the sound could not be loaded.
      *
      * @throws IllegalArgumentException if the file path is invalid or the file doesn't exist
      * @throws IllegalStateException if the audio engine is not initialized
      */
-    external fun createSound(filePath: String): String?
+    external fun createSound(filePath: String): Long
+
+    /**
+     * Creates a streaming sound instance from the specified audio file.
+     *
+     * Unlike [createSound], the file is decoded in small chunks while it plays, so memory usage
+     * stays constant regardless of the track length and only the first chunk is decoded
+     * before this returns. Useful for long tracks such as DJ mixes.
+     *
+     * @param filePath The absolute path to the audio file to load.
+     * @return A unique sound identifier, or [INVALID_SOUND_ID] if the sound could not be loaded.
+     */
+    external fun createStreamingSound(filePath: String): Long
+
+    /**
+     * Creates a sound instance from a range of an open file descriptor, as given by an
+     * [AssetFileDescriptor], without copying it to a temporary file.
+     *
+     * The descriptor is duplicated, so the caller can close its own right after this returns.
+     *
+     * @param fd The file descriptor to read from.
+     * @param offset The offset of the audio data in the file, in bytes.
+     * @param length The length of the audio data in bytes, or a negative value to read to the end.
+     * @param name A name used in logs.
+     * @param streaming Whether to create a streaming sound, see [createStreamingSound].
+     * @return The sound identifier, or [INVALID_SOUND_ID] if the sound could not be loaded.
+     */
+    external fun createSoundFromFd(
+        fd: Int,
+        offset: Long,
+        length: Long,
+        name: String,
+        streaming: Boolean = false
+    ): Long
+
+    /**
+     * Creates a sound instance from an encoded audio file held in memory.
+     *
+     * The buffer is referenced, not copied, so it must not be modified while the sound exists.
+     *
+     * @param buffer A direct [ByteBuffer] holding the whole encoded file.
+     * @param name A name used in logs.
+     * @param streaming Whether to create a streaming sound, see [createStreamingSound].
+     * @return The sound identifier, or [INVALID_SOUND_ID] if the sound could not be loaded.
+     */
+    external fun createSoundFromMemory(buffer: ByteBuffer, name: String, streaming: Boolean = false): Long
+
+    /**
+     * Creates a sound instance without blocking the calling thread.
+     *
+     * The file is loaded on a native worker pool, and [AudioCallback.onSoundLoaded] is called
+     * once it is ready to play or failed to load. This allows preparing the next track while
+     * the current one plays.
+     *
+     * @param filePath The absolute path to the audio file to load.
+     * @param streaming Whether to create a streaming sound, see [createStreamingSound].
+     * @return The sound identifier, usable with [cancelSoundLoad] right away and with the
+     *         playback functions once loaded.
+     */
+    external fun createSoundAsync(filePath: String, streaming: Boolean = false): Long
+
+    /**
+     * Cancels a load started with [createSoundAsync].
+     *
+     * @param soundId The unique identifier returned by [createSoundAsync].
+     * @return `true` if the load was cancelled, `false` if it already completed or is unknown.
+     */
+    external fun cancelSoundLoad(soundId: Long): Boolean
 
     /**
      * Starts playback of the specified sound.
      *
+     * Like the other playback and position calls, this only queues the request and returns
+     * right away; the native control thread applies requests in order within a few
+     * milliseconds, so calls never wait for the engine.
+     *
      * @param soundId The unique identifier of the sound to play.
      *
      * @throws IllegalArgumentException if the soundId is not valid
      * @throws IllegalStateException if the audio engine is not initialized
      */
-    external fun playSound(soundId: String)
+    external fun playSound(soundId: Long)
 
     /**
      * Stops playback of the specified sound and releases its resources.
      *
      * @param soundId The unique identifier of the sound to stop.
      */
-    external fun stopSound(soundId: String)
+    external fun stopSound(soundId: Long)
 
     /**
      * Stops playback of all currently active sounds and releases all resources.
@@ -95,7 +281,7 @@ object tOpenAlAudioEngine {
      *
      * @throws IllegalArgumentException if the soundId is not valid
      */
-    external fun pauseSound(soundId: String)
+    external fun pauseSound(soundId: Long)
 
     /**
      * Resumes playback of a previously paused sound.
@@ -105,7 +291,7 @@ object tOpenAlAudioEngine {
      * @throws IllegalArgumentException if the soundId is not valid
      * @throws IllegalStateException if the sound is not paused
      */
-    external fun resumeSound(soundId: String)
+    external fun resumeSound(soundId: Long)
 
     /**
      * Sets the 3D position of a sound in spherical coordinates.
@@ -117,7 +303,15 @@ object tOpenAlAudioEngine {
      *
      * @throws IllegalArgumentException if the soundId is not valid
      */
-    external fun setSoundPosition(soundId: String, angle: Float, radius: Float, height: Float)
+    external fun setSoundPosition(soundId: Long, angle: Float, radius: Float, height: Float)
+
+    /**
+     * Sets the volume of a sound.
+     *
+     * @param soundId The unique identifier of the sound.
+     * @param gain The volume factor, 1 for the original volume and 0 for silence.
+     */
+    external fun setSoundGain(soundId: Long, gain: Float)
 
     /**
      * Seeks to a specific position in the sound playback.
@@ -127,15 +321,97 @@ object tOpenAlAudioEngine {
      *
      * @throws IllegalArgumentException if the soundId is not valid or position is out of bounds
      */
-    external fun setPlaybackTime(soundId: String, seconds: Float)
+    external fun setPlaybackTime(soundId: Long, seconds: Float)
+
+    /**
+     * Queues a sound to start when another one ends, for gapless playback or crossfades.
+     *
+     * Where the device supports it, the next sound is started on the device clock at the exact
+     * sample the current one ends (or the crossfade begins). Load the next sound ahead, e.g. with
+     * [createSoundAsync], and don't play it yourself. Stopping the current sound cancels the
+     * transition, while pausing or seeking it moves the transition along. The current sound
+     * still reports [AudioCallback.onSoundFinished] once it ends.
+     *
+     * @param currentSoundId The sound playing now.
+     * @param nextSoundId The sound to start after it, replacing any sound queued before.
+     * @param crossfadeSeconds Length of the equal-power crossfade over the end of the current
+     *        sound, 0 for gapless playback. Clamped to 30 seconds.
+     */
+    external fun queueNext(currentSoundId: Long, nextSoundId: Long, crossfadeSeconds: Float = 0f)
+
+    /**
+     * Cancels [queueNext] for a sound, unless the next sound already started.
+     *
+     * @param currentSoundId The sound the next one was queued after.
+     */
+    external fun clearQueuedNext(currentSoundId: Long)
+
+    /**
+     * Renders a track to a file as it would be heard through the engine, with the same HRTF
+     * and stereo angle, faster than real time on a thread of its own. Playback keeps running
+     * meanwhile. Progress and the result are reported through [AudioCallback.onExportProgress]
+     * and [AudioCallback.onExportFinished]. Only one export runs at a time.
+     *
+     * @param inputPath Path of the track to export.
+     * @param outputPath Path of the file to write, removed again if the export fails.
+     * @param format One of the `EXPORT_FORMAT_*` constants, e.g. [EXPORT_FORMAT_FLAC].
+     * @param trajectorySoundId A sound whose trajectory, or fixed position if it has none,
+     *        the track follows. [INVALID_SOUND_ID] keeps it in front of the listener.
+     * @return The export identifier, or 0 if another export is still running.
+     */
+    external fun startExport(
+        inputPath: String,
+        outputPath: String,
+        format: Int,
+        trajectorySoundId: Long = INVALID_SOUND_ID
+    ): Long
+
+    /**
+     * Stops an export started with [startExport], its output file is removed.
+     *
+     * @return `true` if the export was running.
+     */
+    external fun cancelExport(exportId: Long): Boolean
+
+    /**
+     * Gets the progress of the running or last export, from 0 to 1.
+     */
+    external fun getExportProgress(): Float
 
     /**
      * Gets the current playback time of the specified sound.
      *
+     * This is the position being heard, behind what the mixer has played by the output latency,
+     * so lyrics and the progress bar stay in time on Bluetooth outputs too. Read from the state
+     * last published by the control thread and interpolated in between, so it is cheap to poll,
+     * never goes backwards unless the sound is seeked, and may not reflect requests made in the
+     * last few milliseconds yet.
+     *
      * @param soundId The unique identifier of the sound.
      * @return The current playback time in seconds, or -1 if the sound is not found or an error occurred.
      */
-    external fun getPlaybackTime(soundId: String): Float
+    external fun getPlaybackTime(soundId: Long): Float
+
+    /**
+     * The clock of a playing sound.
+     *
+     * @property positionSeconds Position being heard, as returned by [getPlaybackTime].
+     * @property latencySeconds Output latency, the time between a sample being mixed and heard.
+     */
+    data class PlaybackClock(val positionSeconds: Float, val latencySeconds: Float)
+
+    /**
+     * Gets the heard position of the specified sound along with the output latency behind it.
+     *
+     * @param soundId The unique identifier of the sound.
+     * @return The clock, or null if the sound is not found or still loading.
+     */
+    fun getPlaybackClock(soundId: Long): PlaybackClock? {
+        val values = getPlaybackClockNative(soundId) ?: return null
+        return PlaybackClock(values[0], values[1])
+    }
+
+    private external fun getPlaybackClockNative(soundId: Long): FloatArray?
 
     /**
      * Gets the total duration of the specified sound.
@@ -143,7 +419,7 @@ object tOpenAlAudioEngine {
      * @param soundId The unique identifier of the sound.
      * @return The total duration of the sound in seconds, or 0 if the sound is not found.
      */
-    external fun getSoundDuration(soundId: String): Float
+    external fun getSoundDuration(soundId: Long): Float
 
     /**
      * Sets the stereo separation angle for stereo sounds.
@@ -152,6 +428,210 @@ object tOpenAlAudioEngine {
      */
     external fun setStereoAngle(angle: Float)
 
+    /**
+     * Configures the on-disk cache of decoded audio.
+     *
+     * Loaded tracks are stored already decoded, so loading the same file again (same path,
+     * size and modification time) skips decoding entirely. The least recently used entries
+     * are deleted once the cache grows over the budget.
+     *
+     * @param directory The directory holding the cache entries, created if needed.
+     * @param budgetBytes The maximum size of the cache in bytes, or 0 to disable it.
+     */
+    external fun setDecodeCache(directory: String, budgetBytes: Long)
+
+    /**
+     * Sets how much memory the loaded buffers of stopped sounds may keep.
+     *
+     * Sounds created from the same file share their decoded buffers, and buffers of stopped
+     * sounds are kept (least recently used are dropped first) so replaying a track, e.g. with
+     * repeat-one, needs no decoding at all. Streaming sounds are not shared, progressively loaded
+     * ones only once their decode finished.
+     *
+     * @param idleBytes The memory budget in bytes for unused buffers, 0 to free them on stop.
+     */
+    external fun setBufferCacheBudget(idleBytes: Long)
+
+    /**
+     * Usage of the native scratch memory that sounds are decoded into before being uploaded.
+     *
+     * @property acquires Scratch buffers handed out to loads.
+     * @property reuses How many of those reused memory kept from an earlier load.
+     * @property allocations Blocks allocated from the native heap.
+     * @property frees Blocks given back to the native heap.
+     * @property bytesInUse Memory currently used by running loads.
+     * @property bytesRetained Idle memory kept for the next loads.
+     * @property peakBytes High-water mark of [bytesInUse] + [bytesRetained].
+     * @property capBytes Limit on [bytesRetained], 0 if unlimited.
+     */
+    data class ScratchStats(
+        val acquires: Long,
+        val reuses: Long,
+        val allocations: Long,
+        val frees: Long,
+        val bytesInUse: Long,
+        val bytesRetained: Long,
+        val peakBytes: Long,
+        val capBytes: Long
+    )
+
+    /**
+     * Channel alignment of multichannel sounds. Each channel plays on its own source, and
+     * playing sounds are checked every second for channels that drifted apart, which are then
+     * realigned on the first channel.
+     *
+     * @property checks Sounds measured.
+     * @property corrections Sounds realigned because their channels were more than a few frames apart.
+     * @property maxFrames Largest drift measured, in frames.
+     */
+    data class DriftStats(
+        val checks: Long,
+        val corrections: Long,
+        val maxFrames: Long
+    )
+
+    /**
+     * Gets the channel alignment counters.
+     */
+    fun getDriftStats(): DriftStats {
+        val values = getDriftStatsNative()
+        return DriftStats(values[0], values[1], values[2])
+    }
+
+    private external fun getDriftStatsNative(): LongArray
+
+    /**
+     * Usage of the AL sources, all generated by [initOpenAL] up to the device's mixing limit
+     * and reused by every sound. Stereo sounds take two.
+     *
+     * @property capacity Sources in the pool.
+     * @property inUse Sources held by loaded sounds.
+     * @property peakInUse High-water mark of [inUse].
+     * @property acquires Sources handed out to sounds.
+     * @property releases Sources given back by stopped sounds.
+     * @property exhaustions Sounds that failed to load because no source was left.
+     */
+    data class SourcePoolStats(
+        val capacity: Long,
+        val inUse: Long,
+        val peakInUse: Long,
+        val acquires: Long,
+        val releases: Long,
+        val exhaustions: Long
+    )
+
+    /**
+     * Gets the usage of the AL source pool.
+     */
+    fun getSourcePoolStats(): SourcePoolStats {
+        val values = getSourcePoolStatsNative()
+        return SourcePoolStats(values[0], values[1], values[2], values[3], values[4], values[5])
+    }
+
+    private external fun getSourcePoolStatsNative(): LongArray
+
+    /**
+     * CPU use and wakeups since the engine was initialized, to compare device profiles.
+     *
+     * The counters cover the whole process, so measure with the rest of the app idle (e.g. with
+     * the screen off) and take the difference between two reads over a minute or so of playback.
+     *
+     * @property wallNs Time since initialization.
+     * @property cpuNs CPU time used by the process.
+     * @property voluntarySwitches Times a thread went to sleep, about one per wakeup.
+     * @property involuntarySwitches Times a thread was preempted.
+     * @property frequency Output rate the device ended up with, in Hz.
+     * @property refresh Mixer updates per second the device ended up with.
+     */
+    data class PowerStats(
+        val wallNs: Long,
+        val cpuNs: Long,
+        val voluntarySwitches: Long,
+        val involuntarySwitches: Long,
+        val frequency: Long,
+        val refresh: Long
+    ) {
+        /** Average share of one core used, from 0 to 1 per core. */
+        val cpuLoad: Double get() = if (wallNs > 0) cpuNs.toDouble() / wallNs else 0.0
+
+        /** Average wakeups per second. */
+        val wakeupsPerSecond: Double get() = if (wallNs > 0) voluntarySwitches * 1e9 / wallNs else 0.0
+    }
+
+    /**
+     * Gets the CPU and wakeup counters since initialization, or null if the engine is gone.
+     */
+    fun getPowerStats(): PowerStats? {
+        val values = getPowerStatsNative() ?: return null
+        return PowerStats(values[0], values[1], values[2], values[3], values[4], values[5])
+    }
+
+    private external fun getPowerStatsNative(): LongArray?
+
+    /**
+     * Limits the idle scratch memory kept between loads.
+     *
+     * Decode buffers are reused across loads to avoid fragmenting the native heap. By default a
+     * few MB are kept, and buffers of whole tracks are always freed once the load is done.
+     *
+     * @param capBytes The maximum idle memory in bytes, or 0 for no limit.
+     */
+    external fun setScratchCap(capBytes: Long)
+
+    /**
+     * Frees all the idle scratch memory, e.g. when the app is trimming memory.
+     */
+    external fun trimScratch()
+
+    /**
+     * Gets the usage of the scratch memory used while loading sounds.
+     */
+    fun getScratchStats(): ScratchStats {
+        val values = getScratchStatsNative()
+        return ScratchStats(
+            values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7]
+        )
+    }
+
+    private external fun getScratchStatsNative(): LongArray
+
+    /**
+     * Enables converting sounds to the device's mixing rate while they are loaded.
+     *
+     * Sounds whose sample rate differs from the output (e.g. 44.1 kHz tracks on a 48 kHz device)
+     * are resampled once with a high-quality filter, and cached that way if the decode cache is
+     * enabled, so the mixer doesn't resample them on every period. Loading takes a bit longer.
+     * Only applies to sounds loaded afterwards, streaming sounds keep their own rate.
+     *
+     * @param enabled Whether to resample at load time, disabled by default.
+     */
+    external fun setLoadResampling(enabled: Boolean)
+
+    /**
+     * Lets uncached tracks longer than a minute start playing while the rest is still decoding.
+     *
+     * Those tracks play at their own rate, skipping the load-time resampling. Once their decode
+     * finished they are also loaded into the shared buffers and the decode cache like any other
+     * sound, so they take about twice their memory while they play. Only applies to sounds loaded
+     * afterwards.
+     *
+     * @param enabled Whether to load long tracks progressively, disabled by default.
+     */
+    external fun setProgressiveLoading(enabled: Boolean)
+
+    /**
+     * Enables the engine's trace sections and counters.
+     *
+     * Sound loads (open, format detection, decode, deinterleave, upload), seeks, source
+     * acquisition, callback delivery and every native call are recorded as ATrace sections,
+     * along with counters for active sources, bytes held in AL buffers and decode throughput.
+     * They appear in Perfetto or systrace captures that include the app's atrace category.
+     * While disabled each trace point costs a single check, so this can be left in release builds.
+     *
+     * @param enabled Whether to record trace events, disabled by default.
+     */
+    external fun setTracingEnabled(enabled: Boolean)
+
     /**
      * Sets the callback for receiving audio playback events.
      *
@@ -164,40 +644,82 @@ object tOpenAlAudioEngine {
 
     private external fun setCallbackNative(callback: Any?)
 
+    /**
+     * Sets how often [AudioCallback.onPositionTick] is called for playing sounds.
+     *
+     * @param intervalMs Interval in milliseconds, 0 (the default) turns the ticks off.
+     */
+    external fun setPositionTickInterval(intervalMs: Long)
+
+    /**
+     * Delivery counters of the callback thread. Latencies run from the event happening to
+     * the callback returning, call times cover the callback alone.
+     *
+     * @property delivered Events handed to the callback.
+     * @property dropped Events lost because the callback was missing, or too slow to keep up.
+     * @property batches Wakeups of the callback thread, each delivering every waiting event.
+     * @property totalLatencyNs Latency summed over the delivered events.
+     * @property maxLatencyNs Highest latency of a delivered event.
+     * @property totalCallNs Time spent in the callback, summed over the delivered events.
+     * @property maxCallNs Longest callback call.
+     */
+    data class CallbackStats(
+        val delivered: Long,
+        val dropped: Long,
+        val batches: Long,
+        val totalLatencyNs: Long,
+        val maxLatencyNs: Long,
+        val totalCallNs: Long,
+        val maxCallNs: Long
+    )
+
+    /**
+     * Gets the delivery counters of the callback thread, or null if they could not be read.
+     */
+    fun getCallbackStats(): CallbackStats? {
+        val values = getCallbackStatsNative() ?: return null
+        return CallbackStats(values[0], values[1], values[2], values[3], values[4], values[5], values[6])
+    }
+
+    private external fun getCallbackStatsNative(): LongArray?
+
 
     /**
      * Initializes the audio engine with default settings.
      *
      * @param context The application context used for file operations.
      * @param selectedHrtf The HRTF name to use.
+     * @param profile One of the `DEVICE_PROFILE_*` constants.
      * @return `true` if initialization was successful, `false` otherwise.
      */
-    fun init(context: Context, selectedHrtf: String): Boolean {
-        return initOpenAL(selectedHrtf)
+    fun init(context: Context, selectedHrtf: String, profile: Int = DEVICE_PROFILE_DEFAULT): Boolean {
+        val initialized = initOpenAL(selectedHrtf, profile, context.filesDir.absolutePath)
+        if (initialized) {
+            setDecodeCache(File(context.cacheDir, "pcm").absolutePath, DEFAULT_DECODE_CACHE_BYTES)
+        }
+        return initialized
     }
 
     /**
      * Creates a sound instance from an audio file in the assets folder.
      *
+     * Uncompressed assets are read in place from the APK, compressed ones are read into memory.
+     *
      * @param context The application context.
      * @param assetPath The path to the audio file in the assets folder (e.g., "sounds/music.wav").
-     * @return The sound identifier, or `null` if the sound could not be loaded.
+     * @return The sound identifier, or [INVALID_SOUND_ID] if the sound could not be loaded.
      */
-    fun createSoundFromAssets(context: Context, assetPath: String): String? {
+    fun createSoundFromAssets(context: Context, assetPath: String): Long {
         return try {
-            // Copy asset to temporary file
-            val tempFile = File.createTempFile("audio_", null, context.cacheDir)
-            tempFile.deleteOnExit()
-
-            context.assets.open(assetPath).use { input ->
-                tempFile.outputStream().use { output ->
-                    input.copyTo(output)
-                }
+            val afd = try {
+                context.assets.openFd(assetPath)
+            } catch (_: Exception) {
+                null // Compressed in the APK, so there is no descriptor for it
             }
-
-            createSound(tempFile.absolutePath)
+            afd?.use { createSoundFromAssetFd(it, assetPath) }
+                ?: context.assets.open(assetPath).use { createSoundFromStream(it, assetPath) }
         } catch (_: Exception) {
-            null
+            INVALID_SOUND_ID
         }
     }
 
@@ -206,26 +728,58 @@ object tOpenAlAudioEngine {
      *
      * @param context The application context.
      * @param resId The resource ID of the audio file.
-     * @return The sound identifier, or `null` if the sound could not be loaded.
+     * @return The sound identifier, or [INVALID_SOUND_ID] if the sound could not be loaded.
      */
-    fun createSoundFromResource(context: Context, resId: Int): String? {
+    fun createSoundFromResource(context: Context, resId: Int): Long {
         return try {
-            // Copy resource to temporary file
-            val tempFile = File.createTempFile("audio_", null, context.cacheDir)
-            tempFile.deleteOnExit()
-
-            context.resources.openRawResource(resId).use { input ->
-                tempFile.outputStream().use { output ->
-                    input.copyTo(output)
-                }
+            val name = context.resources.getResourceEntryName(resId)
+            val afd = try {
+                context.resources.openRawResourceFd(resId)
+            } catch (_: Exception) {
+                null // Compressed in the APK, so there is no descriptor for it
             }
+            afd?.use { createSoundFromAssetFd(it, name) }
+                ?: context.resources.openRawResource(resId).use { createSoundFromStream(it, name) }
+        } catch (_: Exception) {
+            INVALID_SOUND_ID
+        }
+    }
 
-            createSound(tempFile.absolutePath)
-        } catch (e: Exception) {
-            null
+    /**
+     * Creates a sound instance from a content or file [Uri], e.g. one picked with the
+     * storage access framework, reading it through its file descriptor.
+     *
+     * @param context The application context.
+     * @param uri The Uri of the audio file.
+     * @param streaming Whether to create a streaming sound, see [createStreamingSound].
+     * @return The sound identifier, or [INVALID_SOUND_ID] if the sound could not be loaded.
+     */
+    fun createSoundFromUri(context: Context, uri: Uri, streaming: Boolean = false): Long {
+        return try {
+            context.contentResolver.openAssetFileDescriptor(uri, "r")?.use {
+                createSoundFromAssetFd(it, uri.lastPathSegment ?: "uri", streaming)
+            } ?: INVALID_SOUND_ID
+        } catch (_: Exception) {
+            INVALID_SOUND_ID
         }
     }
 
+    private fun createSoundFromAssetFd(
+        afd: AssetFileDescriptor,
+        name: String,
+        streaming: Boolean = false
+    ): Long {
+        val length = if (afd.length == AssetFileDescriptor.UNKNOWN_LENGTH) -1L else afd.length
+        return createSoundFromFd(afd.parcelFileDescriptor.fd, afd.startOffset, length, name, streaming)
+    }
+
+    private fun createSoundFromStream(input: InputStream, name: String): Long {
+        val bytes = input.readBytes()
+        val buffer = ByteBuffer.allocateDirect(bytes.size).put(bytes)
+        buffer.flip()
+        return createSoundFromMemory(buffer, name)
+    }
+
     /**
      * Sets the 3D position of a sound using Cartesian coordinates.
      *
@@ -234,7 +788,7 @@ object tOpenAlAudioEngine {
      * @param y The Y coordinate (up/down).
      * @param z The Z coordinate (front/back).
      */
-    fun setSoundPositionCartesian(soundId: String, x: Float, y: Float, z: Float) {
+    fun setSoundPositionCartesian(soundId: Long, x: Float, y: Float, z: Float) {
         // Convert Cartesian to spherical coordinates
         val radius = sqrt((x*x + y*y + z*z).toDouble()).toFloat()
         val angle = Math.toDegrees(atan2(x.toDouble(), z.toDouble())).toFloat()
@@ -244,25 +798,357 @@ object tOpenAlAudioEngine {
     }
 
     /**
-     * TODO
-     * Smoothly changes the position of a sound over time.
+     * Smoothly moves a sound to a new position, eased in and out.
+     *
+     * The animation runs natively on the sound's playback clock, so it pauses with the sound
+     * and needs no calls per frame. Setting a position or another motion replaces it.
      *
      * @param soundId The unique identifier of the sound to animate.
-     * @param targetAngle The target horizontal angle in degrees.
+     * @param targetAngle The target horizontal angle, in radians like [setSoundPosition].
      * @param targetRadius The target distance from the listener.
      * @param targetHeight The target vertical position.
-     * @param durationMs The duration of the animation in milliseconds.
+     * @param durationMs The duration of the animation in milliseconds of playback.
      */
-    fun animateSoundPosition(
-        soundId: String,
+    external fun animateSoundPosition(
+        soundId: Long,
         targetAngle: Float,
         targetRadius: Float,
         targetHeight: Float,
         durationMs: Long
-    ) {
-        // This would typically be implemented with a coroutine or ValueAnimator
-        // For now, this is a placeholder for the animation API
-        setSoundPosition(soundId, targetAngle, targetRadius, targetHeight)
+    )
+
+    /**
+     * Rotates a sound around the listener at a constant rate, the classic 8D effect.
+     *
+     * Motions are evaluated natively against the sound's playback position, so they stay in
+     * sync with the music through pauses and seeks. Angles are in radians, like
+     * [setSoundPosition]. Calling [setSoundPosition] stops the motion.
+     *
+     * @param soundId The unique identifier of the sound.
+     * @param startAngle The angle at the current playback position.
+     * @param radius The distance from the listener.
+     * @param height The vertical position relative to the listener.
+     * @param revolutionsPerSecond Turns per second, negative to turn the other way.
+     */
+    external fun setSoundOrbit(
+        soundId: Long,
+        startAngle: Float,
+        radius: Float,
+        height: Float,
+        revolutionsPerSecond: Float
+    )
+
+    /**
+     * Sweeps a sound back and forth around a center angle, slowing down at both ends.
+     *
+     * @param soundId The unique identifier of the sound.
+     * @param centerAngle The angle the sweep is centered on.
+     * @param angleExtent How far the sweep goes to each side.
+     * @param radius The distance from the listener.
+     * @param height The vertical position relative to the listener.
+     * @param cyclesPerSecond Full back-and-forth sweeps per second.
+     */
+    external fun setSoundPingPong(
+        soundId: Long,
+        centerAngle: Float,
+        angleExtent: Float,
+        radius: Float,
+        height: Float,
+        cyclesPerSecond: Float
+    )
+
+    /**
+     * Moves a sound along a figure eight, swinging sideways and up and down.
+     *
+     * @param soundId The unique identifier of the sound.
+     * @param centerAngle The angle the figure is centered on.
+     * @param angleExtent How far the figure goes to each side.
+     * @param radius The distance from the listener.
+     * @param height The vertical position of the figure's center.
+     * @param heightExtent How far the figure goes up and down.
+     * @param cyclesPerSecond Full figures per second.
+     */
+    external fun setSoundFigureEight(
+        soundId: Long,
+        centerAngle: Float,
+        angleExtent: Float,
+        radius: Float,
+        height: Float,
+        heightExtent: Float,
+        cyclesPerSecond: Float
+    )
+
+    /**
+     * Adds an up and down wobble on top of the current motion, or of the current position
+     * if the sound isn't moving.
+     *
+     * @param soundId The unique identifier of the sound.
+     * @param depth How far the sound moves up and down, 0 to remove the wobble.
+     * @param cyclesPerSecond Wobbles per second.
+     */
+    external fun setSoundWobble(soundId: Long, depth: Float, cyclesPerSecond: Float)
+
+    /**
+     * Moves a sound through a path of keyframes. All arrays must have the same length.
+     *
+     * @param soundId The unique identifier of the sound.
+     * @param times Seconds of playback since the call at which each keyframe is reached.
+     * @param angles The horizontal angle of each keyframe.
+     * @param radii The distance of each keyframe.
+     * @param heights The vertical position of each keyframe.
+     * @param easings How to move into each keyframe from the previous one, see [Easing].
+     * @param loop Whether to start over after the last keyframe.
+     */
+    external fun setSoundKeyframes(
+        soundId: Long,
+        times: FloatArray,
+        angles: FloatArray,
+        radii: FloatArray,
+        heights: FloatArray,
+        easings: IntArray,
+        loop: Boolean = false
+    )
+
+    /**
+     * Easing curves for [setSoundKeyframes].
+     */
+    object Easing {
+        const val LINEAR = 0
+        const val EASE_IN = 1
+        const val EASE_OUT = 2
+        const val EASE_IN_OUT = 3
+
+        /** Jumps to the keyframe once it is reached. */
+        const val STEP = 4
+    }
+
+    /**
+     * Stops the motion of a sound, leaving it where it currently is.
+     *
+     * @param soundId The unique identifier of the sound.
+     */
+    external fun clearSoundMotion(soundId: Long)
+
+    /**
+     * Sets how often moving sounds are updated, 120 Hz by default.
+     *
+     * @param hz Updates per second, clamped to 10-1000.
+     */
+    external fun setMotionRate(hz: Float)
+
+    /**
+     * Returns the memory shared with the native engine for positions and playback state,
+     * see [SoundParameterBlock]. Call it again after [initOpenAL], it attaches the block to the
+     * new engine; the same memory, and the same instance, is returned every time, so its writers
+     * share one lock.
+     *
+     * @return The parameter block, or `null` if it could not be allocated.
+     */
+    @Synchronized
+    fun getParameterBlock(): SoundParameterBlock? {
+        val buffer = getParameterBlockNative() ?: return null
+        return parameterBlock ?: SoundParameterBlock(buffer).also { parameterBlock = it }
+    }
+
+    private var parameterBlock: SoundParameterBlock? = null
+
+    private external fun getParameterBlockNative(): ByteBuffer?
+
+    /**
+     * Positions, gains and playback positions of the sounds in memory shared with the native
+     * engine, so moving sounds at UI rate and polling their progress takes no JNI call.
+     *
+     * There is one record per sound, guarded by a sequence counter on each side. Writes are
+     * picked up by the native control thread on its next tick, which runs while a sound plays
+     * (until then, use [setSoundPosition] and [setSoundGain]), and the playback state is
+     * refreshed on every tick. Sounds without a record, see [hasRecord], must use the
+     * regular calls.
+     */
+    class SoundParameterBlock internal constructor(buffer: ByteBuffer) {
+        private val buffer = buffer.order(ByteOrder.nativeOrder())
+        private val recordCount = this.buffer.getInt(HEADER_RECORD_COUNT)
+
+        init {
+            require(this.buffer.getInt(HEADER_MAGIC) == MAGIC && this.buffer.getInt(HEADER_VERSION) == VERSION) {
+                "Parameter block layout mismatch"
+            }
+        }
+
+        /**
+         * Whether the sound has a record in the block, only the first few hundred slots do.
+         */
+        fun hasRecord(soundId: Long): Boolean = recordOffset(soundId) >= 0
+
+        /**
+         * Moves a sound like [setSoundPosition], without a JNI call.
+         *
+         * @return `false` if the sound has no record, see [hasRecord].
+         */
+        @Synchronized
+        fun setPosition(soundId: Long, angle: Float, radius: Float, height: Float): Boolean {
+            val offset = recordOffset(soundId)
+            if (offset < 0) return false
+
+            val sequence = beginWrite(offset)
+            buffer.putLong(offset + INPUT_SOUND_ID, soundId)
+            buffer.putFloat(offset + INPUT_ANGLE, angle)
+            buffer.putFloat(offset + INPUT_RADIUS, radius)
+            buffer.putFloat(offset + INPUT_HEIGHT, height)
+            buffer.putInt(offset + INPUT_POSITION_SERIAL, buffer.getInt(offset + INPUT_POSITION_SERIAL) + 1)
+            endWrite(offset, sequence)
+            return true
+        }
+
+        /**
+         * Sets the volume of a sound like [setSoundGain], without a JNI call.
+         *
+         * @return `false` if the sound has no record, see [hasRecord].
+         */
+        @Synchronized
+        fun setGain(soundId: Long, gain: Float): Boolean {
+            val offset = recordOffset(soundId)
+            if (offset < 0) return false
+
+            val sequence = beginWrite(offset)
+            buffer.putLong(offset + INPUT_SOUND_ID, soundId)
+            buffer.putFloat(offset + INPUT_GAIN, gain)
+            buffer.putInt(offset + INPUT_GAIN_SERIAL, buffer.getInt(offset + INPUT_GAIN_SERIAL) + 1)
+            endWrite(offset, sequence)
+            return true
+        }
+
+        /**
+         * Playback position as of the control thread's last tick.
+         *
+         * @return The position in seconds, or -1 if the sound is unknown, loading or has no record.
+         */
+        fun getPlaybackTime(soundId: Long): Float = readOutput(soundId) { offset ->
+            buffer.getFloat(offset + OUTPUT_POSITION)
+        } ?: -1f
+
+        /**
+         * @return The duration in seconds, or 0 if the sound is unknown, loading or has no record.
+         */
+        fun getDuration(soundId: Long): Float = readOutput(soundId) { offset ->
+            buffer.getFloat(offset + OUTPUT_DURATION)
+        } ?: 0f
+
+        /**
+         * @return One of the `STATE_` constants.
+         */
+        fun getState(soundId: Long): Int = readOutput(soundId) { offset ->
+            buffer.getInt(offset + OUTPUT_STATE)
+        } ?: STATE_EMPTY
+
+        private fun recordOffset(soundId: Long): Int {
+            val index = soundId and 0xffffffffL
+            if (soundId == INVALID_SOUND_ID || index >= recordCount) return -1
+            return HEADER_SIZE + index.toInt() * RECORD_SIZE
+        }
+
+        private fun beginWrite(offset: Int): Int {
+            val sequence = buffer.getInt(offset + INPUT_SEQUENCE) + 1
+            buffer.putInt(offset + INPUT_SEQUENCE, sequence)
+            MemoryFences.release()
+            return sequence
+        }
+
+        private fun endWrite(offset: Int, sequence: Int) {
+            MemoryFences.release()
+            buffer.putInt(offset + INPUT_SEQUENCE, sequence + 1)
+        }
+
+        // Retries while the control thread is writing the record
+        private inline fun <T> readOutput(soundId: Long, read: (Int) -> T): T? {
+            val offset = recordOffset(soundId)
+            if (offset < 0) return null
+
+            while (true) {
+                val sequence = buffer.getInt(offset + OUTPUT_SEQUENCE)
+                if ((sequence and 1) != 0) continue
+                MemoryFences.acquire()
+                val recordSoundId = buffer.getLong(offset + OUTPUT_SOUND_ID)
+                val value = read(offset)
+                MemoryFences.acquire()
+                if (buffer.getInt(offset + OUTPUT_SEQUENCE) == sequence) {
+                    return if (recordSoundId == soundId) value else null
+                }
+            }
+        }
+
+        /**
+         * Fences around the plain buffer accesses, which otherwise may be reordered across the
+         * sequence accesses. VarHandle fences need API 33, older releases use Unsafe's, bound
+         * once to method handles so the per-access cost is a direct call.
+         */
+        private object MemoryFences {
+            private val unsafe: Any? = try {
+                Class.forName("sun.misc.Unsafe").getDeclaredField("theUnsafe")
+                    .apply { isAccessible = true }.get(null)
+            } catch (_: Exception) {
+                null
+            }
+            private val loadFence = bindFence("loadFence")
+            private val storeFence = bindFence("storeFence")
+
+            // Loads before it stay before the loads and stores after it
+            fun acquire() {
+                if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
+                    VarHandle.acquireFence()
+                } else {
+                    loadFence?.invoke()
+                }
+            }
+
+            // Loads and stores before it stay before the stores after it
+            fun release() {
+                if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
+                    VarHandle.releaseFence()
+                } else {
+                    storeFence?.invoke()
+                }
+            }
+
+            private fun bindFence(name: String): MethodHandle? {
+                if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU || unsafe == null) return null
+                return try {
+                    MethodHandles.lookup().unreflect(unsafe.javaClass.getMethod(name)).bindTo(unsafe)
+                } catch (_: Exception) {
+                    null
+                }
+            }
+        }
+
+        companion object {
+            const val STATE_EMPTY = 0
+            const val STATE_LOADED = 1
+            const val STATE_PLAYING = 2
+            const val STATE_PAUSED = 3
+
+            // Mirrors parameterBlock.h
+            private const val MAGIC = 0x50443353
+            private const val VERSION = 1
+            private const val HEADER_MAGIC = 0
+            private const val HEADER_VERSION = 4
+            private const val HEADER_RECORD_COUNT = 8
+            private const val HEADER_SIZE = 64
+            private const val RECORD_SIZE = 64
+
+            private const val INPUT_SEQUENCE = 0
+            private const val INPUT_POSITION_SERIAL = 4
+            private const val INPUT_GAIN_SERIAL = 8
+            private const val INPUT_SOUND_ID = 16
+            private const val INPUT_ANGLE = 24
+            private const val INPUT_RADIUS = 28
+            private const val INPUT_HEIGHT = 32
+            private const val INPUT_GAIN = 36
+
+            private const val OUTPUT_SEQUENCE = 40
+            private const val OUTPUT_STATE = 44
+            private const val OUTPUT_SOUND_ID = 48
+            private const val OUTPUT_POSITION = 56
+            private const val OUTPUT_DURATION = 60
+        }
     }
 
     /**
@@ -273,7 +1159,7 @@ object tOpenAlAudioEngine {
      * @hide Internal use only
      */
     @Suppress("unused")
-    private fun onSoundFinished(soundId: String) {
+    private fun onSoundFinished(soundId: Long) {
         callback?.onSoundFinished(soundId)
     }
 }
\ No newline at end of file